@@ -2,6 +2,8 @@
 #define ARGHANDLER_H
 
 #include "debugPrint.h"
+#include "OutputSink.h"
+#include "SessionConfig.h"
 #include <string>
 #include <cstdint>
 #include <cstring>
@@ -13,35 +15,19 @@
 
 using namespace std;
 
-enum class ProtocolType {
-    TCP,
-    UDP
-};
-
 struct ParsedArgs {
-    ProtocolType proto;       // -t
-    string host;              // -s
-    uint16_t port = 4567;     // -p
-    uint16_t timeout = 250;   // -d
-    uint8_t retries = 3;      // -h
+    SessionConfig session;    // -t -s -p -d -r -w -P -b -R -B -A -W -M
+    bool printStats = false;  // -S
+    string daemonSocket;      // -D, serve local processes instead of reading stdin
+    OutputFormat outputFormat = OutputFormat::TEXT; // -o
+    string filterRules;       // -f
+    int pasteWindowMs = -1;   // -L, merge chat lines of one paste arriving within this quiet interval, -1 = off
 };
 
 class ArgHandler {
 public:
     static ParsedArgs parse(int argc, char* argv[]);
     static void printHelp();
-private:
-
-    /**
-     * @brief Resolves the address of the target (domain name or IP address).
-     * @param host The target address to resolve.
-     *
-     * This function uses the `getaddrinfo()` function to resolve the given
-     * target (either a domain name or IP address) into a list of addresses.
-     *
-     * @throws runtime_error If `getaddrinfo()` fails.
-     */
-    string static resolve_address(string host);
 };
 
 #endif //ARGHANDLER_H
@@ -0,0 +1,197 @@
+#ifndef CHATSESSION_H
+#define CHATSESSION_H
+
+#include "debugPrint.h"
+#include "SessionConfig.h"
+#include "LatencyHistogram.h"
+#include "NetworkTuning.h"
+#include "Notifier.h"
+#include "OutputSink.h"
+#include "OutboundScheduler.h"
+#include "RequestTracker.h"
+#include "SendPacer.h"
+#include "SpscQueue.h"
+#include "TCPClient.h"
+#include "TimerWheel.h"
+#include "UDPClient.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <poll.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+using namespace std;
+
+enum class InboundEventType {
+    MESSAGE,        // Parsed message from the server
+    PARSE_ERROR,    // Server sent something that could not be parsed
+    DROPPED,        // Coalesced notice about MSGs dropped while the consumer was behind
+    FAILED,         // Transport error, the network thread is finishing
+    REPLY_TIMEOUT,  // An AUTH or JOIN got no REPLY within the deadline
+    LOG,            // Diagnostic line in error: a tuning option the system refused, a receive buffer resize
+};
+
+// Network thread -> caller's thread
+struct InboundEvent {
+    InboundEventType type = InboundEventType::MESSAGE;
+    unique_ptr<Message> message;
+    uint64_t kernelNs = 0;          // Kernel receive timestamp, 0 if unavailable
+    uint64_t receivedNs = 0;        // Wall clock, read from the socket
+    uint64_t publishedNs = 0;       // Handed to the caller's thread
+    int32_t messageId = -1;         // UDP only
+    uint32_t requestTag = 0;        // REPLY and REPLY_TIMEOUT: the request it belongs to, 0 = none
+    uint32_t dropped = 0;
+    string error;
+};
+
+// Caller's thread -> network thread
+struct OutboundCommand {
+    unique_ptr<Message> message;   // May be empty for a bare close request
+    bool close = false;            // Close the connection once the message is sent
+    uint64_t enqueuedNs = 0;       // For the outbound queue delay
+    uint32_t requestTag = 0;       // AUTH/JOIN: tracked until its REPLY, 0 = not a request
+};
+
+// How and when a received message arrived
+struct MessageInfo {
+    uint64_t kernelNs = 0;          // Kernel receive timestamp, 0 if unavailable
+    uint64_t receivedNs = 0;        // Wall clock, read from the socket
+    int32_t messageId = -1;         // UDP only
+    uint32_t request = 0;           // REPLY: what auth()/join() returned for the request it answers, 0 = none
+};
+
+// Invoked from poll() on the caller's thread, unset callbacks are skipped. They may call back into the session.
+struct SessionCallbacks {
+    // Every server message except CONFIRM and PING: MSG, REPLY, ERR, BYE (the session closes after ERR and BYE)
+    function<void(const Message& message, const MessageInfo& info)> onMessage;
+    // An auth()/join() got no REPLY in time, the session sends ERR and closes
+    function<void(uint32_t request)> onRequestTimeout;
+    // MSGs the network thread dropped because poll() fell behind
+    function<void(uint32_t count)> onDropped;
+    // The session failed: a transport error, or a malformed server message (answered with ERR)
+    function<void(const string& error)> onError;
+    // Diagnostics that don't affect the session, worth a line in the application's log
+    function<void(const string& line)> onLog;
+};
+
+/**
+ * @brief One IPK25 session over TCP or UDP, without any terminal I/O.
+ *
+ * A network thread owns the transport: it sends what the API calls queued, retransmits, confirms, matches REPLYs
+ * to requests and enforces their deadline. The calls below only queue and never block (except close(), which
+ * waits for the BYE). What the network thread received is handed over in a bounded queue and dispatched to the
+ * callbacks by poll(); run it from your own event loop when eventFd() is readable, or use runOnce().
+ * All methods must be called from one thread.
+ */
+class ChatSession {
+public:
+    // config.host may be a hostname. Throws runtime_error if it doesn't resolve or the transport can't be opened (TCP connects here).
+    explicit ChatSession(const SessionConfig& config, SessionCallbacks callbacks = {});
+    ~ChatSession();
+    ChatSession(const ChatSession&) = delete;
+    ChatSession& operator=(const ChatSession&) = delete;
+
+    /**
+     * @brief Queue an AUTH or JOIN. Throws invalid_argument for values the protocol does not allow.
+     * @return Request id, reported with the REPLY (MessageInfo::request) or to onRequestTimeout; 0 if the queue was full.
+     */
+    uint32_t auth(string_view username, string_view secret, string_view displayName);
+    uint32_t join(string_view channel);
+    // Queues a chat message under the current display name, false if the queue is full
+    bool send(string_view content);
+    // Display name of the following messages, the server learns it with the next one
+    void rename(string_view displayName);
+    /**
+     * @brief Says BYE (if authenticated) and stops the network thread once it went out. Safe to call twice.
+     * @param afterQueued Let queued chat messages go out before the BYE.
+     */
+    void close(bool afterQueued = false);
+
+    // Dispatches everything received so far, never blocks. Returns false once the session has ended.
+    bool poll();
+    // Waits up to timeoutMs (-1 = indefinitely) for something to dispatch, then poll()
+    bool runOnce(int timeoutMs);
+    // Readable while poll() has work, for the caller's own poll()/select()
+    int eventFd() const { return inboundReady.fd(); }
+    // Makes eventFd() readable, async-signal-safe
+    void wake() { inboundReady.notify(); }
+
+    bool isOpen() const { return open; }
+    bool isAuthenticated() const { return authenticated; }
+    // Chat messages queued but not handed to the transport yet (pacing, or a slow UDP round trip)
+    size_t queuedMessages() const { return outbound.pendingCount(TrafficClass::BULK); }
+
+    // Statistics, the ones the network thread writes are consistent once the session is closed
+    LatencyProfile& latencyProfile() { return profile; }
+    const WakeupStats& wakeups() const { return wakeupStats; }
+    const SendPacer& sendPacer() const { return pacer; }
+    // How long the oldest chat message waiting to be sent has been queued, 0 if none; live, unlike the statistics
+    uint64_t queueDelayNs() const { return pacer.queueDelayNs(); }
+    const LatencyStats& outboundLatency(TrafficClass cls) const { return outboundDelay[static_cast<size_t>(cls)]; }
+    const LatencyStats& confirmLatency() const { return client->confirmLatency(); }
+    // UDP over a real socket only, nullptr otherwise
+    const ReceiveBufferStats* receiveBuffer() const { return client->receiveBuffer(); }
+
+private:
+    static constexpr size_t INBOUND_CAPACITY = 1024;
+    static constexpr size_t OUTBOUND_CAPACITY = 256;
+    // Slots that bulk MSGs may not take, so REPLY/ERR/BYE still fit when the consumer is behind
+    static constexpr size_t INBOUND_CONTROL_RESERVE = 64;
+
+    SessionConfig config;
+    SessionCallbacks callbacks;
+    bool open = true;
+    bool authenticated = false;
+    DisplayNameField<>::value_type displayName;
+    unordered_map<uint32_t, MessageType> issued;    // Requests waiting for their REPLY, by id
+    uint32_t nextRequest = 1;
+    std::atomic<bool> networkFinished{false};
+    unique_ptr<ProtocolClient> client;              // Network thread only once it is started, which uses its concrete type
+    thread networkThread;
+
+    SpscQueue<InboundEvent, INBOUND_CAPACITY> inbound;
+    OutboundScheduler<OutboundCommand, OUTBOUND_CAPACITY> outbound;
+    Notifier inboundReady;
+    Notifier outboundReady;
+
+    // Network thread only
+    deque<InboundEvent> inboundBacklog;         // Control events waiting for a free slot, unbounded as none may be lost
+    uint32_t droppedMessages = 0;               // Dropped MSGs not yet reported
+    WakeupStats wakeupStats;                    // Low-latency mode (-P/-b)
+    LatencyProfile profile;                     // Stages are written by the thread they happen on
+    SendPacer pacer;                            // Paces bulk messages only
+    LatencyStats outboundDelay[TRAFFIC_CLASS_COUNT];    // Enqueue to send
+    RequestTracker requests;                    // AUTH/JOIN in flight
+    TimerWheel timers;                          // Reply deadlines, the cookie is the request's tag
+
+    bool enqueue(unique_ptr<Message> message, bool close = false, bool afterQueued = false, uint32_t requestTag = 0);
+    uint32_t request(unique_ptr<Message> message);
+    void dispatch(InboundEvent& event);
+    // Protocol error on our side of the session: tell the server, then end it
+    void abort(string_view reason);
+
+    bool lowLatency() const { return config.cpuCore >= 0 || config.busyPollUs > 0; }
+    // The protocol is chosen once here, the network thread's loop is instantiated per transport
+    template <SessionTransport Transport>
+    void startNetwork(unique_ptr<Transport> transport);
+    template <SessionTransport Transport>
+    void networkLoop(Transport& transport);
+    template <SessionTransport Transport>
+    bool drainOutbound(Transport& transport);
+    int pollTimeout(bool backlogged);
+    void expireTimers();
+    template <SessionTransport Transport>
+    void receiveAvailable(Transport& transport);
+    void publish(InboundEvent&& event);
+    void log(string line);
+    // Network thread setup the caller asked for: CPU pinning, busy polling
+    void tuneNetworkThread(int fd);
+    // Reports what the transport did to its receive buffer since last time
+    void reportReceiveBuffer(const ReceiveBufferStats& stats, ReceiveBufferStats& reported);
+    bool flushBacklog();
+};
+
+#endif //CHATSESSION_H
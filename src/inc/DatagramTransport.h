@@ -0,0 +1,90 @@
+#ifndef DATAGRAMTRANSPORT_H
+#define DATAGRAMTRANSPORT_H
+
+#include "debugPrint.h"
+#include "NetworkTuning.h"
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Datagram I/O and clocks used by UDPClient. The client talks to a real socket by default,
+ * tests and benchmarks plug in a simulated network instead (SimulatedNetwork.h).
+ */
+class DatagramTransport {
+public:
+    virtual ~DatagramTransport() = default;
+
+    virtual ssize_t sendTo(const uint8_t* data, size_t length, const sockaddr_in& to) = 0;
+    /**
+     * @brief Waits until a datagram can be received.
+     * @return false if none arrived within timeoutMs.
+     */
+    virtual bool wait(int timeoutMs) = 0;
+    /**
+     * @brief Receives one queued datagram without blocking.
+     * @param kernelNs Set to the kernel receive timestamp, 0 if unavailable.
+     * @return Its length, or -1 if nothing is queued.
+     */
+    virtual ssize_t receiveFrom(uint8_t* buffer, size_t length, sockaddr_in& from, uint64_t& kernelNs) = 0;
+
+    /**
+     * @brief Restricts the transport to one peer. Later sends go to it whatever address they name, datagrams from
+     * anyone else are dropped before they reach the client.
+     * @return false if the transport stayed unconnected.
+     */
+    virtual bool connect(const sockaddr_in& peer) = 0;
+    bool isConnected() const { return connected; }
+
+    // Clock for deadlines
+    virtual uint64_t monotonicNs() const = 0;
+    // Clock comparable with the kernel receive timestamps
+    virtual uint64_t wallClockNs() const = 0;
+    // Descriptor the network thread can poll, -1 if there is none
+    virtual int fd() const { return -1; }
+    virtual void close() {}
+    // Kernel drops and receive buffer sizing, nullptr if the transport has no kernel queue
+    virtual const ReceiveBufferStats* receiveBuffer() const { return nullptr; }
+
+protected:
+    bool connected = false;
+    sockaddr_in connectedPeer{};
+};
+
+/**
+ * The real thing: one UDP socket, connected once the server's port is known.
+ * The kernel reports how many datagrams it dropped because the receive buffer was full; each time that count
+ * grows the buffer is doubled, up to the ceiling, so a bursty channel stops losing datagrams to it.
+ */
+class SocketTransport : public DatagramTransport {
+public:
+    // receiveBufferCeiling: largest SO_RCVBUF (as the kernel reports it) to grow to, 0 keeps the default size
+    explicit SocketTransport(int receiveBufferCeiling = 0);
+    ~SocketTransport() override;
+
+    ssize_t sendTo(const uint8_t* data, size_t length, const sockaddr_in& to) override;
+    bool wait(int timeoutMs) override;
+    ssize_t receiveFrom(uint8_t* buffer, size_t length, sockaddr_in& from, uint64_t& kernelNs) override;
+    bool connect(const sockaddr_in& peer) override;
+    uint64_t monotonicNs() const override;
+    uint64_t wallClockNs() const override;
+    int fd() const override { return socketFd; }
+    void close() override;
+    const ReceiveBufferStats* receiveBuffer() const override { return &bufferStats; }
+
+private:
+    int socketFd = -1;
+    uint32_t dropCounter = 0;           // Kernel's running total, as last attached to a datagram
+    ReceiveBufferStats bufferStats;
+
+    void dropped(uint32_t count);
+};
+
+#endif //DATAGRAMTRANSPORT_H
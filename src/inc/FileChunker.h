@@ -0,0 +1,63 @@
+#ifndef FILECHUNKER_H
+#define FILECHUNKER_H
+
+#include "debugPrint.h"
+#include "ProtocolSpec.h"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * @brief Splits a memory-mapped text file into maximal valid MSG contents.
+ *
+ * Chunks end at the last line break that fits into CONTENT_MAX_LENGTH, a longer line is cut at the
+ * limit (content is ASCII only, so any byte is a character boundary). CRLF line endings are sent as LF, and the
+ * limit applies after the CRs are dropped. The mapping is read sequentially and never copied as a whole.
+ * The file stays open: a file truncated while it is sent ends the transfer with an error rather than SIGBUS.
+ */
+class FileChunker {
+public:
+    explicit FileChunker(const string& path);
+    ~FileChunker();
+    FileChunker(const FileChunker&) = delete;
+    FileChunker& operator=(const FileChunker&) = delete;
+
+    /**
+     * @brief Checks the whole file against the MSG content rules in one pass.
+     * @throws invalid_argument naming the offset of the first byte that cannot be sent, runtime_error if the file
+     * has been truncated.
+     */
+    void validate();
+
+    /**
+     * @brief Returns the next chunk, valid until the following call.
+     * @return false once the whole file was handed out.
+     * @throws runtime_error if the file has been truncated since it was mapped.
+     */
+    bool next(string_view& chunk);
+
+    size_t size() const { return length; }
+    // Bytes of the file covered by the chunks handed out so far
+    size_t consumed() const { return offset; }
+
+private:
+    string path;
+    int fd = -1;
+    const char* data = nullptr;
+    size_t length = 0;
+    size_t offset = 0;
+    bool hasCarriageReturns = false;
+    string scratch;             // Chunk with CRs removed, only used for CRLF files
+
+    void checkSize() const;
+    string_view nextNormalized();
+};
+
+#endif //FILECHUNKER_H
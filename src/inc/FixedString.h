@@ -0,0 +1,69 @@
+#ifndef FIXEDSTRING_H
+#define FIXEDSTRING_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+using namespace std;
+
+/**
+ * @brief String with inline storage for at most N characters (kept NUL terminated).
+ *
+ * Used for the bounded protocol fields, so messages never allocate for their identifiers.
+ * Assigning a longer value throws invalid_argument.
+ */
+template <size_t N>
+class FixedString {
+    static_assert(N > 0 && N < UINT32_MAX, "FixedString capacity out of range");
+
+public:
+    using size_type = conditional_t<(N <= UINT8_MAX), uint8_t, conditional_t<(N <= UINT16_MAX), uint16_t, uint32_t>>;
+
+    FixedString() noexcept { buffer[0] = '\0'; }
+    FixedString(string_view value) { assign(value); }
+    FixedString(const char* value) { assign(value); }
+
+    FixedString& operator=(string_view value) {
+        assign(value);
+        return *this;
+    }
+
+    void assign(string_view value) {
+        if (value.size() > N) {
+            throw invalid_argument("Value exceeds maximum length of " + to_string(N));
+        }
+        memcpy(buffer, value.data(), value.size());
+        length = static_cast<size_type>(value.size());
+        buffer[length] = '\0';
+    }
+
+    void clear() noexcept {
+        length = 0;
+        buffer[0] = '\0';
+    }
+
+    static constexpr size_t capacity() noexcept { return N; }
+    size_t size() const noexcept { return length; }
+    bool empty() const noexcept { return length == 0; }
+    const char* data() const noexcept { return buffer; }
+    const char* c_str() const noexcept { return buffer; }
+    const char* begin() const noexcept { return buffer; }
+    const char* end() const noexcept { return buffer + length; }
+
+    string_view view() const noexcept { return {buffer, length}; }
+    operator string_view() const noexcept { return view(); }
+
+    friend bool operator==(const FixedString& a, string_view b) noexcept { return a.view() == b; }
+    friend ostream& operator<<(ostream& out, const FixedString& value) { return out << value.view(); }
+
+private:
+    size_type length = 0;
+    char buffer[N + 1];
+};
+
+#endif //FIXEDSTRING_H
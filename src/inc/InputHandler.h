@@ -3,19 +3,57 @@
 
 #include "debugPrint.h"
 #include "ArgHandler.h"
-#include "TCPClient.h"
-#include "UDPClient.h"
+#include "ChatSession.h"
+#include "FileChunker.h"
+#include "KeywordFilter.h"
+#include "Multiplexer.h"
+#include "OutputSink.h"
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <chrono>
+#include <poll.h>
 #include <sys/select.h>
 #include <unistd.h>
 #include <atomic>
-#include <thread>
+#include <deque>
+#include <unordered_map>
 
 using namespace std;
 
+// Request the user issued, waiting for its REPLY
+struct IssuedRequest {
+    string description;            // "JOIN general", for the output and timeout errors
+    uint64_t subscriber = 0;       // Daemon mode: id of who sent the command (0 = none), gets the REPLY
+};
+
+// /sendfile in progress
+struct FileTransfer {
+    string path;
+    FileChunker chunker;
+    string nextChunk;                   // Read but not yet accepted by the session's queue
+    bool chunkWaiting = false;
+    uint64_t messages = 0;
+    chrono::steady_clock::time_point started;
+    chrono::steady_clock::time_point lastReport;
+
+    explicit FileTransfer(const string& path) : path(path), chunker(path) {}
+};
+
+// Chat lines of a paste being merged into as few MSGs as CONTENT_MAX_LENGTH allows (-L)
+struct PasteBuffer {
+    string content;                     // Lines joined by '\n', not sent yet
+    bool active = false;                // A burst is in progress, it ends after the quiet interval
+    chrono::steady_clock::time_point quietUntil;
+    uint64_t lines = 0;                 // Totals, for the burst-to-frame ratio
+    uint64_t bursts = 0;
+    uint64_t frames = 0;
+};
+
+/**
+ * @brief Command line frontend of a ChatSession: turns stdin lines (or daemon subscribers' lines) into session
+ * calls and renders what the session delivers. All terminal I/O of the client is here.
+ */
 class InputHandler
 {
 
@@ -23,20 +61,69 @@ public:
     InputHandler(ParsedArgs args);
     ~InputHandler();
     void run();
-    void stop();
+    // Daemon mode (-D): serves the session to local processes on a Unix domain socket instead of stdin
+    void serve();
+    bool daemonMode() const { return !arguments.daemonSocket.empty(); }
+    // afterQueued lets chat messages already queued go out before the BYE
+    void stop(bool afterQueued = false);
+    // Async-signal-safe request to stop, handled by run()
+    void interrupt();
+    // Async-signal-safe request to dump the latency histograms to stderr
+    void requestStats();
 private:
-    std::atomic<bool> authenticated{false};
-    std::atomic<bool> running{true};
+    // File chunks queued ahead of the network thread, bounds the memory of a /sendfile
+    static constexpr size_t FILE_WINDOW = 8;
+    // Chat messages queued ahead of the network thread before stdin lines wait in pendingInput
+    static constexpr size_t INPUT_WINDOW = 128;
+
+    std::atomic<bool> interrupted{false};
+    std::atomic<bool> statsRequested{false};
     ParsedArgs arguments;
-    string displayName;
-    unique_ptr<TCPClient> tcpClient;
-    unique_ptr<UDPClient> udpClient;
-    thread receiveThread;
+    unique_ptr<FileTransfer> transfer;
+    string stdinBuffer;                         // Read from stdin without a complete line yet
+    deque<string> pendingInput;                 // Complete lines waiting for room in the session's queue
+    PasteBuffer paste;
+    ostream* output = &cout;                    // Subscribers' buffer in daemon mode
+    OutputSink sink;
+    unordered_map<uint32_t, IssuedRequest> issued;  // By the session's request id
+    uint64_t lineOrigin = 0;                    // Daemon mode: subscriber whose line is being processed
+    Multiplexer* subscribers = nullptr;         // Daemon mode only
+    unique_ptr<KeywordFilter> filter;           // -f
+    unique_ptr<ChatSession> session;
+    uint32_t unflushed = 0;                     // Messages rendered since the last flush, for the output_flushed probe
+    uint64_t unflushedSinceNs = 0;              // Receive time of the first of them
 
+    ostream& out() { return *output; }
+    void print(string_view text) { sink.notice(out(), text); }
+    void processLine(const string& input);
+    // One read() from stdin, complete lines go to pendingInput. False at end of input (the rest is a line then)
+    bool readInput();
+    void drainInput();
+    // A stdin line: chat lines join the current paste with -L, everything else is processed right away
+    void inputLine(const string& line);
+    void sendPaste();
+    // Sends what is left of the paste once its quiet interval passed (or now, if force)
+    void endPaste(bool force);
+    void reportPaste(ostream& out) const;
+    // Chat messages waiting to be sent and the current queue delay, for /stats
+    void reportQueue(ostream& out) const;
     void handleCommand(const string& command);
     void handleMessage(const string& message);
-    void processIncomingMessage();
-    static void printHelp();
+    void startTransfer(const string& path);
+    void pumpTransfer();
+    void reportTransfer(bool finished);
+    void checkStatsRequest();
+    void outputFlushed();
+    void filterCommand(string_view rest);
+    void printHelp();
+    // Remembers who issued a request, so its REPLY (or the lack of one) can be attributed
+    void issue(uint32_t request, string description);
+
+    // Session callbacks
+    void onMessage(const Message& msg, const MessageInfo& info);
+    void onRequestTimeout(uint32_t request);
+
+    bool lowLatency() const { return arguments.session.cpuCore >= 0 || arguments.session.busyPollUs > 0; }
 };
 
 #endif //INPUTHANDLER_H
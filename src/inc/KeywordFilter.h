@@ -0,0 +1,164 @@
+#ifndef KEYWORDFILTER_H
+#define KEYWORDFILTER_H
+
+#include "debugPrint.h"
+#include "Message.h"
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * @brief Aho-Corasick automaton matching many patterns in one pass, ASCII case-insensitively.
+ *
+ * Built once, then read-only. Bytes are mapped to classes (all bytes no pattern contains share one), states are
+ * numbered breadth first and the shallow ones, which the scan spends most of its time in, get a full transition
+ * row of the classes within a fixed budget. Deeper states keep their few edges in one flat sorted array and fall
+ * back along failure links to a dense row, so 100k patterns cost tens of megabytes rather than a row per state.
+ * Transition targets carry a flag when the target ends a pattern, plain steps never touch the output lists.
+ * While the automaton sits in the root state, scan() skips bytes that start no pattern: on x86 with SSSE3 it tests
+ * 16 bytes per step against a bitmap of all start bytes, however many there are, otherwise it uses the root row.
+ */
+class AhoCorasick {
+public:
+    explicit AhoCorasick(const vector<string>& patterns);
+
+    // Calls onMatch(patternIndex) for every occurrence, overlapping ones included
+    template <typename F>
+    void scan(string_view text, F&& onMatch) const;
+
+    size_t stateCount() const { return fail.size(); }
+
+private:
+    static constexpr uint32_t MATCH = 1u << 31;         // Target state ends a pattern, itself or on its fail chain
+    static constexpr size_t DENSE_ENTRIES = 1 << 20;    // 4 MB of full transition rows
+
+    uint8_t byteClass[256] = {};        // Raw byte -> class, case folded, 0 = in no pattern
+    uint32_t classCount = 1;
+    uint32_t rootNext[256] = {};        // Raw byte -> target, the root's row for the prefilter
+    uint32_t denseCount = 0;            // States below this have a row in dense
+    vector<uint32_t> dense;             // [state * classCount + class] -> target
+    vector<uint32_t> edgeStart;         // State s has edges [edgeStart[s], edgeStart[s + 1]), used for sparse states
+    vector<uint8_t> edgeClass;          // Sorted within a state
+    vector<uint32_t> edgeTarget;
+    vector<uint32_t> fail;
+    vector<uint32_t> dictLink;          // Nearest state on the fail chain that ends a pattern, 0 = none
+    vector<uint32_t> outputStart;       // State s ends patterns outputs[outputStart[s] .. outputStart[s + 1])
+    vector<uint32_t> outputs;
+    alignas(16) uint8_t startLow[16] = {};  // Low nibble -> bit (high nibble & 7) of the raw bytes with a root edge
+    bool anyStart = false;
+    bool shuffleSkip = false;           // The CPU has SSSE3 for the 16 byte prefilter
+
+    uint32_t step(uint32_t state, uint8_t cls) const;
+    const uint8_t* skipToStart(const uint8_t* p, const uint8_t* end) const;
+};
+
+enum FilterAction : uint8_t {
+    FILTER_HIGHLIGHT = 1,   // Render the message as an alert
+    FILTER_COUNT = 2,       // Only count matches, see /filter
+    FILTER_FORWARD = 4,     // Also write the message to the forward target
+    FILTER_SUPPRESS = 8,    // Do not show the message
+};
+
+enum class FilterField : uint8_t {
+    SENDER = 1,
+    CONTENT = 2,
+    ANY = 3,
+};
+
+struct FilterRule {
+    FilterAction action;
+    FilterField field;
+    string pattern;
+    uint64_t hits = 0;
+};
+
+/**
+ * @brief Rules file compiled into one automaton, applied to received MSG and ERR messages on the UI thread.
+ *
+ * Rules file, one rule per line, '#' starts a comment:
+ *   <highlight|count|forward|suppress> <sender|content|any> <pattern...>
+ *   forward-to <path>          (where forwarded messages go, default: the target the application passes)
+ * Patterns are substrings matched ASCII case-insensitively, the rest of the line after the field is the pattern.
+ * The file is reloaded when its modification time changes, a broken file keeps the previous rules.
+ */
+class KeywordFilter {
+public:
+    /**
+     * @brief Compiles the rules file. Throws invalid_argument naming the offending line.
+     * @param defaultTarget Receives forwarded messages while the rules name no forward-to file.
+     * @param defaultTargetName How the report calls it ("stderr").
+     */
+    KeywordFilter(const string& path, ostream& defaultTarget, string defaultTargetName);
+
+    /**
+     * @brief Matches a received message against every rule.
+     * @return FilterAction bits of the rules that matched, 0 for other types or no match.
+     */
+    uint8_t apply(const Message& msg);
+    // Writes a matched message to the forward target
+    void forward(const Message& msg);
+    /**
+     * @brief Recompiles the rules if the file changed (checked at most once per second unless forced).
+     * @return false with error set if the new file is invalid, the old rules stay active.
+     */
+    bool reloadIfChanged(bool force, string& error);
+    void report(ostream& out) const;
+
+private:
+    string path;
+    timespec modified{};
+    chrono::steady_clock::time_point nextCheck;
+    vector<FilterRule> rules;
+    unique_ptr<AhoCorasick> automaton;
+    vector<uint32_t> patternRule;   // Automaton pattern index -> rule
+    vector<uint64_t> lastHit;       // Per rule, serial of the last message it matched, so it counts once per message
+    uint64_t serial = 0;
+    uint64_t scanned = 0;
+    uint64_t matched = 0;
+    uint64_t suppressed = 0;
+    string forwardPath;
+    unique_ptr<ofstream> forwardFile;
+    ostream* defaultTarget;
+    string defaultTargetName;
+    double compileMs = 0;
+
+    void load();
+    void match(string_view text, FilterField field, uint8_t& actions);
+};
+
+template <typename F>
+void AhoCorasick::scan(string_view text, F&& onMatch) const {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+    const uint8_t* end = p + text.size();
+    uint32_t state = 0;
+    while (p < end) {
+        uint32_t next;
+        if (state == 0) {
+            p = skipToStart(p, end);
+            if (p == end) {
+                return;
+            }
+            next = rootNext[*p++];
+        } else {
+            next = step(state, byteClass[*p++]);
+        }
+        state = next & ~MATCH;
+        if (next & MATCH) {
+            for (uint32_t s = outputStart[state] != outputStart[state + 1] ? state : dictLink[state]; s != 0; s = dictLink[s]) {
+                for (uint32_t i = outputStart[s]; i < outputStart[s + 1]; ++i) {
+                    onMatch(outputs[i]);
+                }
+            }
+        }
+    }
+}
+
+#endif //KEYWORDFILTER_H
@@ -0,0 +1,95 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+using namespace std;
+
+/**
+ * @brief HDR-style log-linear histogram of nanosecond latencies.
+ *
+ * Every power of two is split into HALF linear sub-buckets, so any recorded value is reported within
+ * ~3 % over the whole range (1 ns to ~18 min, larger values land in the last bucket).
+ * Storage is a fixed array, recording never allocates.
+ *
+ * Single writer: record() must only be called from one thread, any thread may read or print.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 6;
+    static constexpr uint64_t HALF = uint64_t(1) << (SUB_BITS - 1);
+    static constexpr unsigned MAX_SHIFT = 35;
+    static constexpr size_t BUCKETS = (MAX_SHIFT + 2) * HALF;
+
+    void record(uint64_t ns) {
+        bump(counts[indexOf(ns)], 1);
+        bump(total, 1);
+        bump(sum, ns);
+        if (ns < minimum.load(memory_order_relaxed)) minimum.store(ns, memory_order_relaxed);
+        if (ns > maximum.load(memory_order_relaxed)) maximum.store(ns, memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+    uint64_t min() const { return count() ? minimum.load(memory_order_relaxed) : 0; }
+    uint64_t max() const { return maximum.load(memory_order_relaxed); }
+    double mean() const { return count() ? double(sum.load(memory_order_relaxed)) / count() : 0; }
+    // Value at the given percentile (0-100), the midpoint of the bucket it falls into
+    uint64_t percentile(double p) const;
+
+    void print(ostream& out, const char* name) const;
+
+    static size_t indexOf(uint64_t ns) {
+        if (ns < 2 * HALF) {
+            return static_cast<size_t>(ns);
+        }
+        unsigned shift = static_cast<unsigned>(bit_width(ns)) - SUB_BITS;
+        if (shift > MAX_SHIFT) {
+            return BUCKETS - 1;
+        }
+        return static_cast<size_t>(shift * HALF + (ns >> shift));
+    }
+    static uint64_t lowerBound(size_t index) {
+        if (index < 2 * HALF) {
+            return index;
+        }
+        unsigned shift = static_cast<unsigned>(index / HALF - 1);
+        return (index - shift * HALF) << shift;
+    }
+
+private:
+    array<atomic<uint64_t>, BUCKETS> counts{};
+    atomic<uint64_t> total{0};
+    atomic<uint64_t> sum{0};
+    atomic<uint64_t> minimum{numeric_limits<uint64_t>::max()};
+    atomic<uint64_t> maximum{0};
+
+    // Plain load/store instead of fetch_add, there is only one writer
+    static void bump(atomic<uint64_t>& value, uint64_t by) { value.store(value.load(memory_order_relaxed) + by, memory_order_relaxed); }
+};
+
+enum class LatencyStage {
+    KERNEL_TO_USER,     // Kernel receive timestamp to recvmsg() returning (network thread)
+    PARSE,              // recvmsg() returning to the owned message being ready (network thread)
+    QUEUE,              // Handed to the inbound ring to picked up by the UI thread
+    RENDER,             // Picked up to written to the output (UI thread)
+    CONFIRM_RTT,        // UDP message sent to its CONFIRM received (network thread)
+};
+inline constexpr size_t LATENCY_STAGE_COUNT = 5;
+
+// One histogram per stage of a received message's way through the client
+class LatencyProfile {
+public:
+    void record(LatencyStage stage, uint64_t ns) { stages[static_cast<size_t>(stage)].record(ns); }
+    const LatencyHistogram& get(LatencyStage stage) const { return stages[static_cast<size_t>(stage)]; }
+    void print(ostream& out) const;
+
+private:
+    array<LatencyHistogram, LATENCY_STAGE_COUNT> stages;
+};
+
+#endif //LATENCYHISTOGRAM_H
@@ -2,113 +2,211 @@
 #define MESSAGE_H
 
 #include "debugPrint.h"
+#include "ProtocolSpec.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
-#include <regex>
 #include <memory>
 #include <iostream>
-#include <regex>
+#include <span>
 #include <stdexcept>
-#include <sstream>
+#include <tuple>
 
 using namespace std;
 
-enum class MessageType {
-    AUTH,       // Used for client authentication (signing in) using a user-provided username, display name and password
-    JOIN,       // Represents the client's request to join a chat channel by its identifier
-    MSG,        // Contains user display name and a message for the joined channel
-    REPLY,      // Contains positive/negative confirmation for certain requests
-    ERR,        // Indicates an error occurred, resulting in graceful termination of communication
-    BYE,        // Indicates that the conversation/connection is to be terminated
-    CONFIRM,    // UDP only: Explicitly confirms the successful delivery of the message
-    PING,       // UDP only: Aliveness check mechanism sent periodically by the server
-};
-
 class Message {
 protected:
     MessageType type;
 public:
     Message(MessageType t) : type(t) {}
+    // The only virtual member: owned messages cross to the caller's thread as unique_ptr<Message>
     virtual ~Message() = default;
 
     // Pro TCP
-    virtual string serialize() const = 0;
+    string serialize() const;
     // Pro UDP (binární rámec)
-    virtual vector<uint8_t> serializeUDP(uint16_t msgId) const = 0;
+    vector<uint8_t> serializeUDP(uint16_t msgId) const;
+    // Append to out instead, the transports reuse one buffer and don't allocate per message
+    void serialize(string& out) const;
+    void serializeUDP(vector<uint8_t>& out, uint16_t msgId) const;
 
     MessageType getType() const { return type; }
+    // Renders a received message for the user (the class's render(), nothing for types without one),
+    // parsing itself never touches the terminal
+    void print(ostream& out) const;
+};
+
+// --- Borrowed views ---
+// Text fields point into the receive buffer and are only valid until the next receive on that connection
+
+class AuthMessage;
+class JoinMessage;
+class MsgMessage;
+class ReplyMessage;
+class ErrMessage;
+class ByeMessage;
+class ConfirmMessage;
+class PingMessage;
+
+struct AuthView {
+    using Owned = AuthMessage;
+    string_view username, displayName, secret;
+    auto fields() const { return tie(username, displayName, secret); }
+};
+
+struct JoinView {
+    using Owned = JoinMessage;
+    string_view channelID, displayName;
+    auto fields() const { return tie(channelID, displayName); }
+};
+
+struct MsgView {
+    using Owned = MsgMessage;
+    string_view displayName, messageContent;
+    auto fields() const { return tie(displayName, messageContent); }
+};
 
-    static void validateLength(const string& value, size_t maxLength, const string& fieldName);
-    static void validateRegex(const string& value, const string& pattern, const string& fieldName);
+struct ReplyView {
+    using Owned = ReplyMessage;
+    bool success;
+    uint16_t refMsgId;
+    string_view messageContent;
+    auto fields() const { return tie(success, refMsgId, messageContent); }
+};
+
+struct ErrView {
+    using Owned = ErrMessage;
+    string_view displayName, messageContent;
+    auto fields() const { return tie(displayName, messageContent); }
+};
+
+struct ByeView {
+    using Owned = ByeMessage;
+    string_view displayName;
+    auto fields() const { return tie(displayName); }
+};
+
+struct ConfirmView {
+    using Owned = ConfirmMessage;
+    auto fields() const { return tuple<>(); }
+};
+
+struct PingView {
+    using Owned = PingMessage;
+    auto fields() const { return tuple<>(); }
 };
 
 // --- Deklarace jednotlivých zpráv ---
+// Each message names its ProtocolSpec and exposes its fields in wire order, the codecs are generated from that
 
 class AuthMessage : public Message {
-    string username, displayName, secret;
+    UsernameField::value_type username;
+    DisplayNameField<>::value_type displayName;
+    SecretField::value_type secret;
 public:
-    AuthMessage(const string& username, const string& displayName, const string& secret);
-    string serialize() const override;
-    vector<uint8_t> serializeUDP(uint16_t msgId) const override;
+    using Spec = AuthSpec;
+    using View = AuthView;
+    AuthMessage(string_view username, string_view displayName, string_view secret);
+    auto fields() const { return tie(username, displayName, secret); }
 };
 
 class JoinMessage : public Message {
-    string channelID, displayName;
+    ChannelField::value_type channelID;
+    DisplayNameField<>::value_type displayName;
 public:
-    JoinMessage(const string& channelID, const string& displayName);
-    string serialize() const override;
-    vector<uint8_t> serializeUDP(uint16_t msgId) const override;
+    using Spec = JoinSpec;
+    using View = JoinView;
+    JoinMessage(string_view channelID, string_view displayName);
+    auto fields() const { return tie(channelID, displayName); }
 };
 
 class MsgMessage : public Message {
-    string displayName, messageContent;
+    DisplayNameField<>::value_type displayName;
+    ContentField::value_type messageContent;
 public:
-    MsgMessage(const string& displayName, const string& messageContent);
-    string serialize() const override;
-    vector<uint8_t> serializeUDP(uint16_t msgId) const override;
+    using Spec = MsgSpec;
+    using View = MsgView;
+    MsgMessage(string_view displayName, string_view messageContent);
+    auto fields() const { return tie(displayName, messageContent); }
+    void render(ostream& out) const;
 };
 
 class ReplyMessage : public Message {
     bool success;
-    string messageContent;
     uint16_t refMsgId;
+    ContentField::value_type messageContent;
 public:
-    ReplyMessage(bool success, const string& messageContent, uint16_t refMsgId);
-    string serialize() const override;
-    vector<uint8_t> serializeUDP(uint16_t msgId) const override;
+    using Spec = ReplySpec;
+    using View = ReplyView;
+    ReplyMessage(bool success, uint16_t refMsgId, string_view messageContent);
+    auto fields() const { return tie(success, refMsgId, messageContent); }
+    void render(ostream& out) const;
     // Returns true if the reply indicates success
     bool isSuccess() const { return success; }
+    // MessageID of the request this answers, only meaningful over UDP
+    uint16_t getRefMsgId() const { return refMsgId; }
 };
 
 class ErrMessage : public Message {
-    string displayName, messageContent;
+    DisplayNameField<>::value_type displayName;
+    ContentField::value_type messageContent;
 public:
-    ErrMessage(const string& displayName, const string& messageContent);
-    string serialize() const override;
-    vector<uint8_t> serializeUDP(uint16_t msgId) const override;
+    using Spec = ErrSpec;
+    using View = ErrView;
+    ErrMessage(string_view displayName, string_view messageContent);
+    auto fields() const { return tie(displayName, messageContent); }
+    void render(ostream& out) const;
 };
 
 class ByeMessage : public Message {
-    string displayName;
+    DisplayNameField<>::value_type displayName;
 public:
-    ByeMessage(const string& displayName);
-    string serialize() const override;
-    vector<uint8_t> serializeUDP(uint16_t msgId) const override;
+    using Spec = ByeSpec;
+    using View = ByeView;
+    ByeMessage(string_view displayName);
+    auto fields() const { return tie(displayName); }
 };
 
 class ConfirmMessage : public Message {
 public:
+    using Spec = ConfirmSpec;
+    using View = ConfirmView;
     ConfirmMessage();
-    string serialize() const override;
-    vector<uint8_t> serializeUDP(uint16_t msgId) const override;
+    auto fields() const { return tuple<>(); }
 };
 
 class PingMessage : public Message {
 public:
+    using Spec = PingSpec;
+    using View = PingView;
     PingMessage();
-    string serialize() const override;
-    vector<uint8_t> serializeUDP(uint16_t msgId) const override;
+    auto fields() const { return tuple<>(); }
+};
+
+using Protocol = ProtocolTable<Message, ConfirmMessage, ReplyMessage, AuthMessage, JoinMessage, MsgMessage, PingMessage, ErrMessage, ByeMessage>;
+
+/**
+ * @brief A received message that has not been copied out of the receive buffer.
+ *
+ * Routing, counting or filtering can use get<MsgView>() etc. directly, materialize() creates the
+ * owned Message for consumers that need to keep it past the next receive.
+ */
+class MessageView {
+public:
+    MessageView() = default;
+    MessageView(Protocol::ViewVariant view, int32_t messageId = -1) : view(view), messageId(messageId) {}
+
+    MessageType getType() const { return Protocol::typeOf(view); }
+    // UDP MessageID of the frame, -1 for TCP
+    int32_t getMessageId() const { return messageId; }
+    template <typename V>
+    const V* get() const { return get_if<V>(&view); }
+    unique_ptr<Message> materialize() const { return Protocol::materialize(view); }
+
+private:
+    Protocol::ViewVariant view;
+    int32_t messageId = -1;
 };
 
 class MessageFactory {
@@ -116,17 +214,20 @@ public:
     /**
      * @brief Creates a Message instance based on the provided type and parameters.
      * @param MessageType type
-     * @param vector<string>& params
-         * MessageType.AUTH => [string& username, string& secret, string& displayName]
-         * MessageType.JOIN => [string& channelID, string& displayName]
-         * MessageType.ERR => [string& displayName, string& messageContent]
-         * MessageType.BYE => [string& displayName]
-         * MessageType.MSG => [string& displayName, string& messageContent]
-         * MessageType.REPLY => [bool success, string& messageContent]
+     * @param params Fields in this order, e.g. an array or a vector (throws invalid_argument if too few):
+         * MessageType.AUTH => [username, displayName, secret]
+         * MessageType.JOIN => [channelID, displayName]
+         * MessageType.ERR => [displayName, messageContent]
+         * MessageType.BYE => [displayName]
+         * MessageType.MSG => [displayName, messageContent]
+         * MessageType.REPLY => ["true"|"false", messageContent, refMsgId]
      */
-    static unique_ptr<Message> createMessage(MessageType type, const vector<string>& params);
+    static unique_ptr<Message> createMessage(MessageType type, span<const string_view> params);
     static unique_ptr<Message> parseMessage(const string& input);
     static unique_ptr<Message> parseUDP(const uint8_t* data, size_t length);
+    // Zero-copy variants, the view borrows from the input
+    static MessageView parseView(string_view frame);
+    static MessageView parseUDPView(const uint8_t* data, size_t length);
 };
 
 #endif // MESSAGE_H
@@ -0,0 +1,87 @@
+#ifndef MULTIPLEXER_H
+#define MULTIPLEXER_H
+
+#include "debugPrint.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// One local process attached to the daemon
+struct Subscriber {
+    uint64_t id;                // Never reused, unlike the fd, so late replies cannot reach a newer subscriber
+    int fd;
+    string input;               // Received bytes without a complete line yet
+    string output;              // Not yet written, bounded by Multiplexer::OUTPUT_LIMIT
+    size_t droppedBytes = 0;    // Output discarded while the subscriber was not reading
+    bool readClosed = false;    // Sent EOF (e.g. shutdown(SHUT_WR)) but may still wait for its replies
+};
+
+/**
+ * @brief Unix domain socket server letting local processes share the daemon's chat session.
+ *
+ * Subscribers send the same lines a user would type, every line is handed to the session in arrival
+ * order. Output is written non-blocking, a subscriber that stops reading loses output beyond its
+ * buffer limit (reported to it once it catches up) instead of stalling the others. A subscriber that
+ * half-closes stays attached until its requests are answered and its output is written.
+ */
+class Multiplexer {
+public:
+    static constexpr size_t OUTPUT_LIMIT = 1 << 20;
+    // Longest accepted input line: a maximal MSG plus room for a command
+    static constexpr size_t INPUT_LIMIT = 65536;
+
+    explicit Multiplexer(const string& path);
+    ~Multiplexer();
+    Multiplexer(const Multiplexer&) = delete;
+    Multiplexer& operator=(const Multiplexer&) = delete;
+
+    // Appends the listening socket and every subscriber to a poll() set
+    void addPollFds(vector<pollfd>& fds) const;
+
+    /**
+     * @brief Accepts, reads and writes as reported by poll().
+     * @param lines Receives complete input lines with the id of the subscriber that sent them.
+     */
+    void process(const vector<pollfd>& fds, vector<pair<uint64_t, string>>& lines);
+
+    // Disconnects read-closed subscribers with all output written and nothing pending
+    void closeFinished(const function<bool(uint64_t)>& pending);
+
+    void sendTo(uint64_t id, string_view text);
+    void broadcast(string_view text);
+    size_t subscriberCount() const { return subscribers.size(); }
+
+private:
+    string path;
+    int listener = -1;
+    // The socket file this daemon created, the destructor leaves anything else at the path alone
+    dev_t socketDevice = 0;
+    ino_t socketInode = 0;
+    vector<Subscriber> subscribers;
+    uint64_t nextId = 1;
+
+    // Removes a socket file whose daemon is gone, refuses a live daemon's socket and any other kind of file
+    static void removeStaleSocket(const string& path, const sockaddr_un& address);
+    void accept();
+    // Returns false when the subscriber disconnected or misbehaved
+    bool readFrom(Subscriber& subscriber, vector<pair<uint64_t, string>>& lines);
+    bool flush(Subscriber& subscriber);
+    void enqueue(Subscriber& subscriber, string_view text);
+};
+
+#endif //MULTIPLEXER_H
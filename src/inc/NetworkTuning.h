@@ -0,0 +1,97 @@
+#ifndef NETWORKTUNING_H
+#define NETWORKTUNING_H
+
+#include "debugPrint.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+using namespace std;
+
+// Delay between the kernel receiving a datagram and the network thread picking it up
+struct WakeupStats {
+    uint64_t spinWakeups = 0;     // Data found while busy-polling
+    uint64_t sleepWakeups = 0;    // Data found after sleeping in poll()
+    uint64_t samples = 0;
+    int64_t minNs = numeric_limits<int64_t>::max();
+    int64_t maxNs = 0;
+    int64_t totalNs = 0;
+
+    void add(int64_t ns);
+    void print(ostream& out) const;
+};
+
+// Time from an event to the moment it was acted upon, e.g. enqueue to send
+struct LatencyStats {
+    uint64_t samples = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+
+    void add(uint64_t ns);
+    void print(ostream& out, const char* name) const;
+};
+
+// Receive queue of a UDP socket: datagrams the kernel dropped because it was full, and how it was grown in response
+struct ReceiveBufferStats {
+    uint64_t drops = 0;             // Counted by SO_RXQ_OVFL
+    int initialBytes = 0;           // SO_RCVBUF as the kernel reports it (twice what was asked for)
+    int bytes = 0;
+    int ceilingBytes = 0;           // Growth stops here, or earlier if the kernel refuses more
+    uint32_t resizes = 0;
+    bool limited = false;           // The kernel refused to grow it further (net.core.rmem_max)
+
+    void print(ostream& out) const;
+};
+
+class NetworkTuning {
+public:
+    /**
+     * @brief Restricts the calling thread to a single CPU core.
+     * @return false with the reason in error if the affinity could not be set.
+     */
+    static bool pinCurrentThread(int core, string& error);
+
+    // Sets SO_BUSY_POLL where the kernel supports it, blocking reads then spin in the driver. False with the reason in error
+    static bool enableBusyPoll(int fd, uint32_t budgetUs, string& error);
+
+    /**
+     * @brief Like poll(), but first spins with zero-timeout polls for up to budgetUs.
+     * @param spun Set to true when the descriptors became ready during the spin.
+     */
+    static int spinThenPoll(pollfd* fds, nfds_t count, int timeoutMs, uint32_t budgetUs, bool& spun);
+
+    // Asks the kernel for software receive timestamps (SO_TIMESTAMPING, falling back to SO_TIMESTAMPNS)
+    static bool enableRxTimestamps(int fd);
+
+    // Asks the kernel to attach its count of receive queue overflows to every datagram (SO_RXQ_OVFL)
+    static bool enableDropCounter(int fd);
+
+    // SO_RCVBUF as the kernel reports it, bookkeeping included
+    static int receiveBufferSize(int fd);
+
+    /**
+     * @brief Sets SO_RCVBUF so the kernel reports bytes, past net.core.rmem_max with SO_RCVBUFFORCE where permitted.
+     * @return The size the kernel settled on.
+     */
+    static int setReceiveBufferSize(int fd, int bytes);
+
+    /**
+     * @brief recvfrom() that also returns the kernel receive timestamp of the data.
+     * @param kernelNs Wall clock nanoseconds, 0 when the kernel attached no timestamp.
+     * @param dropCounter If given, updated with the socket's overflow count when the kernel attached one.
+     */
+    static ssize_t receiveTimestamped(int fd, void* buffer, size_t length, int flags, sockaddr* from, socklen_t* fromLength,
+                                      uint64_t& kernelNs, uint32_t* dropCounter = nullptr);
+};
+
+#endif //NETWORKTUNING_H
@@ -0,0 +1,29 @@
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+#include "debugPrint.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * @brief Wakes a thread sleeping in select()/poll() (eventfd based).
+ *
+ * notify() is a single non-blocking write(), so it is safe from other threads and signal handlers.
+ */
+class Notifier {
+public:
+    Notifier();
+    ~Notifier();
+
+    void notify();
+    void clear();
+    int fd() const { return efd; }
+
+private:
+    int efd;
+};
+
+#endif //NOTIFIER_H
@@ -0,0 +1,83 @@
+#ifndef OUTBOUNDSCHEDULER_H
+#define OUTBOUNDSCHEDULER_H
+
+#include "ProtocolSpec.h"
+#include "SpscQueue.h"
+#include <cstdint>
+
+using namespace std;
+
+// Queued outgoing traffic in priority order. CONFIRMs never queue: the UDP transport sends them the moment it reads
+// a server datagram, ahead of both classes and also while it waits for the CONFIRM of its own message.
+enum class TrafficClass : uint8_t {
+    CONTROL,    // AUTH, JOIN, BYE, ERR
+    BULK,       // Chat MSGs
+};
+inline constexpr size_t TRAFFIC_CLASS_COUNT = 2;
+
+inline TrafficClass trafficClassOf(MessageType type) {
+    return type == MessageType::MSG ? TrafficClass::BULK : TrafficClass::CONTROL;
+}
+
+inline const char* trafficClassName(TrafficClass cls) {
+    switch (cls) {
+        case TrafficClass::CONTROL: return "control";
+        case TrafficClass::BULK: return "bulk";
+    }
+    return "?";
+}
+
+/**
+ * @brief Per-class outbound queues with a strict or weighted priority scheduler.
+ *
+ * Each class has its own SPSC ring, so control messages never wait behind a MSG backlog.
+ * With a control weight of 0 control is always served first, with weight N one bulk message is
+ * let through after every N consecutive control messages while both have work.
+ */
+template <typename T, size_t Capacity>
+class OutboundScheduler {
+public:
+    explicit OutboundScheduler(uint32_t controlWeight = 0) : controlWeight(controlWeight) {}
+
+    // Producer side
+    bool tryPush(TrafficClass cls, T&& item) { return queue(cls).tryPush(std::move(item)); }
+
+    /**
+     * @brief Pops the next item in scheduling order (consumer side).
+     * @param admit Called with the class about to be served, returning false skips that class
+     *              for this call (e.g. bulk while the pacer has no token).
+     */
+    template <typename Admit>
+    bool tryPop(T& item, TrafficClass& cls, Admit&& admit) {
+        bool bulkTurn = controlWeight > 0 && controlStreak >= controlWeight && bulk.size() > 0;
+        const TrafficClass order[2] = {bulkTurn ? TrafficClass::BULK : TrafficClass::CONTROL,
+                                       bulkTurn ? TrafficClass::CONTROL : TrafficClass::BULK};
+        for (TrafficClass candidate : order) {
+            auto& q = queue(candidate);
+            if (q.size() == 0 || !admit(candidate) || !q.tryPop(item)) {
+                continue;
+            }
+            cls = candidate;
+            controlStreak = candidate == TrafficClass::BULK ? 0 : controlStreak + 1;
+            return true;
+        }
+        return false;
+    }
+
+    // Consumer side: the next item of a class, nullptr if it has none
+    const T* front(TrafficClass cls) { return queue(cls).front(); }
+
+    bool hasPending(TrafficClass cls) const { return queue(cls).size() > 0; }
+    size_t pendingCount(TrafficClass cls) const { return queue(cls).size(); }
+
+private:
+    SpscQueue<T, Capacity> control;
+    SpscQueue<T, Capacity> bulk;
+    uint32_t controlWeight;
+    uint32_t controlStreak = 0;     // Consumer only
+
+    SpscQueue<T, Capacity>& queue(TrafficClass cls) { return cls == TrafficClass::BULK ? bulk : control; }
+    const SpscQueue<T, Capacity>& queue(TrafficClass cls) const { return cls == TrafficClass::BULK ? bulk : control; }
+};
+
+#endif //OUTBOUNDSCHEDULER_H
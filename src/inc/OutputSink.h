@@ -0,0 +1,98 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include "debugPrint.h"
+#include "Message.h"
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+enum class OutputFormat {
+    TEXT,       // Human readable lines ("Action Success: ...")
+    JSON,       // One JSON object per line (NDJSON)
+    BINARY,     // Length-prefixed records, see OutputSink
+};
+
+/**
+ * @brief Formats what the client shows: received messages and local notices.
+ *
+ * JSON and binary records are built with to_chars in one reused buffer, so formatting a message does
+ * not allocate once the buffer has grown to the largest record.
+ *
+ * NDJSON: {"type":"MSG","kernelNs":..,"rxNs":..,"outNs":..,"messageId":..,"sender":"..","content":".."}
+ *   kernelNs is the kernel receive timestamp (when available), REPLY carries "success" and "refMsgId", messageId is only present for UDP, "alert":true marks a highlighted message,
+ *   a REPLY matched to the AUTH/JOIN it answers names it in "request" ("JOIN general"), local notices
+ *   (errors, help, progress) have type "LOCAL" and a "text". Timestamps are Unix epoch nanoseconds.
+ *
+ * Binary record (little-endian):
+ *   u32 length of the rest | u8 type (protocol code, 0xF0 local) | u64 kernelNs (0 none) | u64 rxNs | u64 outNs | i32 messageId (-1 none) |
+ *   u8 flags (bit 0 success, bit 1 refMsgId present, bit 2 alert) | u16 refMsgId | u8 sender length | sender | u32 content length | content |
+ *   u8 request length (0 none) | request
+ */
+class OutputSink {
+public:
+    static constexpr uint8_t LOCAL_RECORD = 0xF0;
+    // Prefix of a highlighted text line where no colour can be shown
+    static constexpr string_view ALERT_MARKER = "[!] ";
+
+    // colour: highlight with ANSI escapes, only for a terminal
+    explicit OutputSink(OutputFormat format, bool colour = false) : format(format), colour(colour) {}
+
+    /**
+     * @brief Writes a message received from the server.
+     * @param kernelNs Kernel receive timestamp, 0 if unavailable.
+     * @param receivedNs Wall clock time the network thread read it from the socket.
+     * @param messageId UDP MessageID, -1 over TCP.
+     * @param alert Matched a highlight rule of the keyword filter.
+     * @param request REPLY only: the request it answers, empty if unknown.
+     */
+    void message(ostream& out, const Message& msg, uint64_t kernelNs, uint64_t receivedNs, int32_t messageId, bool alert = false,
+                 string_view request = {});
+    // Writes a local notice, text has no trailing newline
+    void notice(ostream& out, string_view text);
+
+    OutputFormat getFormat() const { return format; }
+    void setColour(bool enabled) { colour = enabled; }
+    static uint64_t wallClockNs();
+
+private:
+    OutputFormat format;
+    bool colour;
+    string buffer;
+
+    struct Record {
+        uint8_t code = LOCAL_RECORD;
+        string_view type = "LOCAL";
+        uint64_t kernelNs = 0;
+        uint64_t receivedNs = 0;
+        int32_t messageId = -1;
+        bool hasResult = false;
+        bool success = false;
+        bool hasRefId = false;
+        uint16_t refMsgId = 0;
+        bool alert = false;
+        string_view sender;
+        string_view content;
+        string_view request;
+    };
+
+    void write(ostream& out, const Record& record);
+    void appendJson(const Record& record);
+    void appendBinary(const Record& record);
+
+    template <typename T>
+    void appendNumber(T value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr);
+    }
+    void appendEscaped(string_view text);
+    void appendLE(uint64_t value, size_t bytes);
+};
+
+#endif //OUTPUTSINK_H
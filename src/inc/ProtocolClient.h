@@ -3,11 +3,21 @@
 
 #include "debugPrint.h"
 #include "Message.h"
+#include "LatencyHistogram.h"
+#include "NetworkTuning.h"
+#include "TrafficCapture.h"
 #include <unistd.h>
+#include <concepts>
 #include <string>
 
 using namespace std;
 
+// When the data of the last receive arrived, wall clock nanoseconds
+struct ReceiveTimes {
+    uint64_t kernelNs = 0;      // Kernel receive timestamp, 0 if the kernel gave none
+    uint64_t userNs = 0;        // recvmsg() returned
+};
+
 class ProtocolClient {
 public:
     ProtocolClient(string host, uint16_t port);
@@ -15,7 +25,32 @@ public:
 
     virtual void stop() = 0;
     virtual void sendMessage(unique_ptr<Message> message) = 0;
-    virtual unique_ptr<Message> receiveMessage() = 0;
+    /**
+     * @brief Receives the next message without copying it out of the receive buffer.
+     * @return false if nothing was delivered (timeout, CONFIRM, duplicate or closed connection).
+     *
+     * The view is valid until the next receive on this client.
+     */
+    virtual bool receiveView(MessageView& view) = 0;
+    // Owned variant of receiveView()
+    unique_ptr<Message> receiveMessage();
+    // True when a complete message is already buffered, so receiveMessage() won't touch the socket
+    virtual bool hasBufferedMessage() const { return false; }
+
+    int socketFd() const { return ip_socket; }
+    bool isOpen() const { return ip_socket != 0; }
+    // Messages sent again because no CONFIRM arrived in time (always 0 for TCP)
+    uint64_t retransmits() const { return retransmitCount; }
+    // Kernel receive of a server message to its CONFIRM leaving (UDP only)
+    const LatencyStats& confirmLatency() const { return confirmStats; }
+    // Kernel drops and receive buffer sizing of a UDP socket, nullptr otherwise
+    virtual const ReceiveBufferStats* receiveBuffer() const { return nullptr; }
+    // MessageID the last sendMessage() used, 0 over TCP
+    uint16_t lastMessageId() const { return lastSentId; }
+    // Arrival of the message last returned by receiveView()
+    const ReceiveTimes& lastReceive() const { return receiveTimes; }
+    // Receives kernel-to-user and CONFIRM round trip samples, recorded on the receiving thread
+    void attachProfile(LatencyProfile* profile) { this->profile = profile; }
     // virtual void connect();
     // virtual void disconnect();
 
@@ -23,8 +58,28 @@ protected:
     string host;
     uint16_t port;
     int ip_socket = 0;
+    unique_ptr<TrafficCapture> capture;     // Optional raw inbound traffic recorder (-w)
+    uint64_t retransmitCount = 0;
+    uint16_t lastSentId = 0;
+    LatencyStats confirmStats;
+    ReceiveTimes receiveTimes;
+    LatencyProfile* profile = nullptr;
+
+    // Timestamps data that was just read (userNs 0 = now) and records its kernel-to-user latency
+    void stampReceive(uint64_t kernelNs, uint64_t userNs = 0);
 
 };
 
+/**
+ * What the network thread needs from a transport. TCPClient and UDPClient are final, so a loop instantiated
+ * for one of them calls it directly (and can inline it) instead of going through the vtable.
+ */
+template <typename T>
+concept SessionTransport = derived_from<T, ProtocolClient> && requires(T& client, MessageView& view, unique_ptr<Message> message) {
+    { client.receiveView(view) } -> same_as<bool>;
+    client.sendMessage(move(message));
+    { client.hasBufferedMessage() } -> same_as<bool>;
+    { client.socketFd() } -> same_as<int>;
+};
 
 #endif //PROTOCOLCLIENT_H
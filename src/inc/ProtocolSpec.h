@@ -0,0 +1,388 @@
+#ifndef PROTOCOLSPEC_H
+#define PROTOCOLSPEC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "FixedString.h"
+
+using namespace std;
+
+enum class MessageType {
+    AUTH,       // Used for client authentication (signing in) using a user-provided username, display name and password
+    JOIN,       // Represents the client's request to join a chat channel by its identifier
+    MSG,        // Contains user display name and a message for the joined channel
+    REPLY,      // Contains positive/negative confirmation for certain requests
+    ERR,        // Indicates an error occurred, resulting in graceful termination of communication
+    BYE,        // Indicates that the conversation/connection is to be terminated
+    CONFIRM,    // UDP only: Explicitly confirms the successful delivery of the message
+    PING,       // UDP only: Aliveness check mechanism sent periodically by the server
+};
+
+// String literal usable as a template argument
+template <size_t N>
+struct Literal {
+    char text[N];
+    constexpr Literal(const char (&s)[N]) { copy_n(s, N, text); }
+    constexpr string_view view() const { return {text, N - 1}; }
+};
+
+static constexpr size_t ID_MAX_LENGTH = 20;
+static constexpr size_t SECRET_MAX_LENGTH = 128;
+static constexpr size_t DISPLAY_NAME_MAX_LENGTH = 20;
+static constexpr size_t CONTENT_MAX_LENGTH = 60000;
+
+enum class FieldClass {
+    ID,             // [A-Za-z0-9_-]+, Username and ChannelID
+    SECRET,         // [A-Za-z0-9_-]+
+    DISPLAY_NAME,   // Printable characters 0x21-7E
+    CONTENT,        // Printable characters 0x20-7E and LF, takes the rest of a TCP line
+    RESULT,         // UDP: one byte, TCP: "OK" / "NOK"
+    REF_ID,         // UDP: big-endian u16, not transmitted over TCP
+};
+
+/**
+ * @brief Describes one message field.
+ * @tparam Name Field name used in validation errors.
+ * @tparam TcpPrefix Keyword that precedes the value in the TCP grammar ("" for none).
+ *
+ * value_type is how a message stores the field (bounded text inline in a FixedString),
+ * view_type is what the codecs read and write.
+ */
+template <FieldClass C, size_t MaxLength, Literal Name, Literal TcpPrefix>
+struct Field {
+    static constexpr FieldClass fieldClass = C;
+    static constexpr size_t maxLength = MaxLength;
+    static constexpr string_view name = Name.view();
+    static constexpr string_view tcpPrefix = TcpPrefix.view();
+    static constexpr bool isText = C != FieldClass::RESULT && C != FieldClass::REF_ID;
+    static constexpr size_t udpSize = isText ? MaxLength + 1 : MaxLength;
+    static constexpr bool isInline = isText && C != FieldClass::CONTENT;
+    using view_type = conditional_t<C == FieldClass::RESULT, bool, conditional_t<C == FieldClass::REF_ID, uint16_t, string_view>>;
+    using value_type = conditional_t<isInline, FixedString<MaxLength>, conditional_t<isText, string, view_type>>;
+
+    static_assert(!isText || MaxLength > 0, "Text fields need a maximum length");
+    static_assert(C != FieldClass::RESULT || MaxLength == 1, "Result is a single byte");
+    static_assert(C != FieldClass::REF_ID || (MaxLength == 2 && TcpPrefix.view().empty()), "Ref_MessageID is a UDP-only u16");
+
+    static constexpr bool validChar(char c) {
+        switch (C) {
+            case FieldClass::ID:
+            case FieldClass::SECRET:
+                return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+            case FieldClass::DISPLAY_NAME:
+                return c >= 0x21 && c <= 0x7E;
+            case FieldClass::CONTENT:
+                return (c >= 0x20 && c <= 0x7E) || c == '\n';
+            default:
+                return true;
+        }
+    }
+
+    static void validate(view_type value) {
+        if constexpr (isText) {
+            if (value.size() > MaxLength) {
+                throw invalid_argument(string(name) + " exceeds maximum length of " + to_string(MaxLength));
+            }
+            if (value.empty() || !all_of(value.begin(), value.end(), validChar)) {
+                throw invalid_argument(string(name) + " contains invalid characters.");
+            }
+        }
+    }
+};
+
+using UsernameField = Field<FieldClass::ID, ID_MAX_LENGTH, "Username", "">;
+using ChannelField = Field<FieldClass::ID, ID_MAX_LENGTH, "ChannelID", "">;
+using SecretField = Field<FieldClass::SECRET, SECRET_MAX_LENGTH, "Secret", "USING">;
+template <Literal Prefix = "">
+using DisplayNameField = Field<FieldClass::DISPLAY_NAME, DISPLAY_NAME_MAX_LENGTH, "DisplayName", Prefix>;
+using ContentField = Field<FieldClass::CONTENT, CONTENT_MAX_LENGTH, "MessageContent", "IS">;
+using ResultField = Field<FieldClass::RESULT, 1, "Result", "">;
+using RefIdField = Field<FieldClass::REF_ID, 2, "Ref_MessageID", "">;
+
+// Reads fields of a UDP frame following the [type][MessageID] header, text is returned as views into the frame
+struct UDPFieldReader {
+    const uint8_t* ptr;
+    size_t remaining;
+
+    template <typename F>
+    typename F::view_type read() {
+        if constexpr (F::fieldClass == FieldClass::RESULT) {
+            need(1);
+            remaining -= 1;
+            return *ptr++ != 0;
+        } else if constexpr (F::fieldClass == FieldClass::REF_ID) {
+            need(2);
+            uint16_t value = (uint16_t(ptr[0]) << 8) | ptr[1];
+            ptr += 2;
+            remaining -= 2;
+            return value;
+        } else {
+            const void* end = memchr(ptr, 0, remaining);
+            if (!end) throw invalid_argument("Malformed UDP string");
+            size_t length = static_cast<const uint8_t*>(end) - ptr;
+            string_view value(reinterpret_cast<const char*>(ptr), length);
+            ptr += length + 1;
+            remaining -= length + 1;
+            return value;
+        }
+    }
+
+    void need(size_t bytes) const {
+        if (remaining < bytes) throw invalid_argument("Malformed UDP frame: truncated field");
+    }
+};
+
+// Reads fields of a TCP line positioned right after the message keyword, text is returned as views into the line
+struct TCPFieldReader {
+    string_view line;
+
+    template <typename F>
+    typename F::view_type read() {
+        if constexpr (F::fieldClass == FieldClass::REF_ID) {
+            return 0;
+        } else {
+            if constexpr (!F::tcpPrefix.empty()) {
+                expect(F::tcpPrefix);
+            }
+            if (line.empty() || line.front() != ' ') throw invalid_argument("Malformed TCP message: missing " + string(F::name));
+            line.remove_prefix(1);
+            string_view token = line;
+            if constexpr (F::fieldClass != FieldClass::CONTENT) {
+                token = line.substr(0, line.find(' '));
+            }
+            line.remove_prefix(token.size());
+            if constexpr (F::fieldClass == FieldClass::RESULT) {
+                if (token != "OK" && token != "NOK") throw invalid_argument("Malformed TCP message: bad result " + string(token));
+                return token == "OK";
+            } else {
+                return token;
+            }
+        }
+    }
+
+    void expect(string_view keyword) {
+        if (line.size() < keyword.size() + 1 || line.front() != ' ' || line.substr(1, keyword.size()) != keyword) {
+            throw invalid_argument("Malformed TCP message: expected " + string(keyword));
+        }
+        line.remove_prefix(keyword.size() + 1);
+    }
+};
+
+/**
+ * @brief Compile-time description of one message type, generating both wire codecs.
+ *
+ * Fields are listed in UDP wire order, the TCP grammar is derived from their prefixes:
+ *   TCP: {Keyword}[ {TcpPrefix}] {Value}...\r\n
+ *   UDP: [Code][MessageID u16][Value]...   (text values are NUL terminated)
+ */
+template <MessageType T, uint8_t Code, Literal Keyword, typename... Fields>
+struct MessageSpec {
+    static constexpr MessageType type = T;
+    static constexpr uint8_t code = Code;
+    static constexpr string_view keyword = Keyword.view();
+    static constexpr size_t fieldCount = sizeof...(Fields);
+    static constexpr size_t udpHeaderSize = 3;
+    static constexpr size_t maxUDPSize = udpHeaderSize + (Fields::udpSize + ... + 0);
+    // Longest TCP line including CRLF (an upper bound, every field counted with its prefix and both spaces)
+    static constexpr size_t maxTCPSize = keyword.size() + 2 + ((Fields::tcpPrefix.size() + 2 + (Fields::isText ? Fields::maxLength : 3)) + ... + 0);
+    using FieldTypes = tuple<Fields...>;
+    using Values = tuple<typename Fields::view_type...>;
+
+    static constexpr bool contentIsLast() {
+        constexpr FieldClass classes[] = {Fields::fieldClass..., FieldClass::RESULT};
+        for (size_t i = 0; i + 1 < fieldCount; ++i) {
+            if (classes[i] == FieldClass::CONTENT) return false;
+        }
+        return true;
+    }
+
+    static_assert(!keyword.empty() && keyword.find(' ') == string_view::npos, "Keyword must be a single token");
+    static_assert(contentIsLast(), "MessageContent spans the rest of a TCP line, it must be the last field");
+    static_assert(maxUDPSize <= 65507, "Largest frame must fit into one UDP datagram");
+
+    static void validate(const typename Fields::view_type&... values) { (Fields::validate(values), ...); }
+
+    static string encodeTCP(const typename Fields::view_type&... values) {
+        string out;
+        encodeTCP(out, values...);
+        return out;
+    }
+
+    // Appends the frame, a buffer reused for every message stops allocating once it fits the largest one
+    static void encodeTCP(string& out, const typename Fields::view_type&... values) {
+        out.reserve(out.size() + keyword.size() + 2 + ((Fields::tcpPrefix.size() + 2 + tcpLength<Fields>(values)) + ... + 0));
+        out.append(keyword);
+        (appendTCP<Fields>(out, values), ...);
+        out.append("\r\n");
+    }
+
+    static vector<uint8_t> encodeUDP(uint16_t msgId, const typename Fields::view_type&... values) {
+        vector<uint8_t> buf;
+        encodeUDP(buf, msgId, values...);
+        return buf;
+    }
+
+    static void encodeUDP(vector<uint8_t>& buf, uint16_t msgId, const typename Fields::view_type&... values) {
+        buf.reserve(buf.size() + udpHeaderSize + (udpLength<Fields>(values) + ... + 0));
+        buf.push_back(code);
+        buf.push_back(msgId >> 8);
+        buf.push_back(msgId & 0xFF);
+        (appendUDP<Fields>(buf, values), ...);
+    }
+
+    // Views in the result point into data and are only valid as long as it is
+    static Values decodeUDP(const uint8_t* data, size_t length) {
+        [[maybe_unused]] UDPFieldReader reader{data + udpHeaderSize, length - udpHeaderSize};
+        // Braced initialization evaluates the reads left to right
+        return Values{reader.read<Fields>()...};
+    }
+
+    // @param rest Line without the keyword and without the trailing CRLF
+    static Values decodeTCP(string_view rest) {
+        [[maybe_unused]] TCPFieldReader reader{rest};
+        Values values{reader.read<Fields>()...};
+        if (!reader.line.empty()) throw invalid_argument("Malformed TCP message: trailing data");
+        return values;
+    }
+
+private:
+    template <typename F>
+    static size_t tcpLength(const typename F::view_type& value) {
+        if constexpr (F::isText) return value.size();
+        else return 3;
+    }
+
+    template <typename F>
+    static size_t udpLength(const typename F::view_type& value) {
+        if constexpr (F::isText) return value.size() + 1;
+        else return F::udpSize;
+    }
+
+    template <typename F>
+    static void appendTCP(string& out, const typename F::view_type& value) {
+        if constexpr (F::fieldClass != FieldClass::REF_ID) {
+            if constexpr (!F::tcpPrefix.empty()) {
+                out += ' ';
+                out.append(F::tcpPrefix);
+            }
+            out += ' ';
+            if constexpr (F::fieldClass == FieldClass::RESULT) out.append(value ? "OK" : "NOK");
+            else out.append(value);
+        }
+    }
+
+    template <typename F>
+    static void appendUDP(vector<uint8_t>& buf, const typename F::view_type& value) {
+        if constexpr (F::fieldClass == FieldClass::RESULT) {
+            buf.push_back(value ? 1 : 0);
+        } else if constexpr (F::fieldClass == FieldClass::REF_ID) {
+            buf.push_back(value >> 8);
+            buf.push_back(value & 0xFF);
+        } else {
+            buf.insert(buf.end(), value.begin(), value.end());
+            buf.push_back(0);
+        }
+    }
+};
+
+using ConfirmSpec = MessageSpec<MessageType::CONFIRM, 0x00, "CONFIRM">;
+using ReplySpec = MessageSpec<MessageType::REPLY, 0x01, "REPLY", ResultField, RefIdField, ContentField>;
+using AuthSpec = MessageSpec<MessageType::AUTH, 0x02, "AUTH", UsernameField, DisplayNameField<"AS">, SecretField>;
+using JoinSpec = MessageSpec<MessageType::JOIN, 0x03, "JOIN", ChannelField, DisplayNameField<"AS">>;
+using MsgSpec = MessageSpec<MessageType::MSG, 0x04, "MSG", DisplayNameField<"FROM">, ContentField>;
+using PingSpec = MessageSpec<MessageType::PING, 0xFD, "PING">;
+using ErrSpec = MessageSpec<MessageType::ERR, 0xFE, "ERR", DisplayNameField<"FROM">, ContentField>;
+using ByeSpec = MessageSpec<MessageType::BYE, 0xFF, "BYE", DisplayNameField<"FROM">>;
+
+/**
+ * @brief Dispatch over every message class of the protocol (each with a nested Spec, View and fields()).
+ *
+ * The folds below are chains of comparisons, one per class in the order of the list: of the type tag (visit),
+ * the UDP type code or the TCP keyword. The first match calls the fully inlined codec of that concrete class,
+ * so no virtual call is involved. With eight classes that costs at most eight compares; GCC's if-to-switch
+ * conversion may still turn the integer chains into a jump table, the keyword chain stays string compares.
+ */
+template <typename Base, typename... Messages>
+struct ProtocolTable {
+    static constexpr bool uniqueCodes() {
+        constexpr uint8_t codes[] = {Messages::Spec::code...};
+        constexpr string_view keywords[] = {Messages::Spec::keyword...};
+        for (size_t i = 0; i < sizeof...(Messages); ++i) {
+            for (size_t j = i + 1; j < sizeof...(Messages); ++j) {
+                if (codes[i] == codes[j] || keywords[i] == keywords[j]) return false;
+            }
+        }
+        return true;
+    }
+    static_assert(uniqueCodes(), "Type codes and keywords must be unique");
+
+    static constexpr size_t maxTCPFrame = max({Messages::Spec::maxTCPSize...});
+
+    template <typename F>
+    static decltype(auto) visit(const Base& msg, F&& f) {
+        using Result = decltype(f(declval<const tuple_element_t<0, tuple<Messages...>>&>()));
+        if constexpr (is_void_v<Result>) {
+            bool found = ((msg.getType() == Messages::Spec::type && (f(static_cast<const Messages&>(msg)), true)) || ...);
+            if (!found) throw invalid_argument("Unknown message type");
+        } else {
+            Result result{};
+            bool found = ((msg.getType() == Messages::Spec::type && (result = f(static_cast<const Messages&>(msg)), true)) || ...);
+            if (!found) throw invalid_argument("Unknown message type");
+            return result;
+        }
+    }
+
+    // Decoded message borrowing its text from the frame (each message class names its View)
+    using ViewVariant = variant<typename Messages::View...>;
+
+    static ViewVariant decodeUDPView(const uint8_t* data, size_t length) {
+        if (length < 3) throw invalid_argument("UDP frame too short");
+        ViewVariant result;
+        bool found = ((data[0] == Messages::Spec::code && (result = makeView<Messages>(Messages::Spec::decodeUDP(data, length)), true)) || ...);
+        if (!found) throw invalid_argument("Unknown UDP message type code: " + to_string(data[0]));
+        return result;
+    }
+
+    static ViewVariant decodeTCPView(string_view frame) {
+        if (frame.size() >= 2 && frame.substr(frame.size() - 2) == "\r\n") frame.remove_suffix(2);
+        string_view keyword = frame.substr(0, frame.find(' '));
+        string_view rest = frame.substr(keyword.size());
+        ViewVariant result;
+        bool found = ((keyword == Messages::Spec::keyword && (result = makeView<Messages>(Messages::Spec::decodeTCP(rest)), true)) || ...);
+        if (!found) throw invalid_argument("Unknown message type: " + string(keyword));
+        return result;
+    }
+
+    // Copies a view into an owned message
+    static unique_ptr<Base> materialize(const ViewVariant& view) {
+        return std::visit([](const auto& v) -> unique_ptr<Base> {
+            using M = typename decay_t<decltype(v)>::Owned;
+            return apply([](const auto&... fields) { return make_unique<M>(fields...); }, v.fields());
+        }, view);
+    }
+
+    static MessageType typeOf(const ViewVariant& view) {
+        return std::visit([](const auto& v) { return decay_t<decltype(v)>::Owned::Spec::type; }, view);
+    }
+
+private:
+    // Views are validated like owned messages, so a consumer never sees a frame the constructors would reject
+    template <typename M, typename Values>
+    static typename M::View makeView(const Values& values) {
+        return apply([](const auto&... fields) {
+            M::Spec::validate(fields...);
+            return typename M::View{fields...};
+        }, values);
+    }
+};
+
+#endif //PROTOCOLSPEC_H
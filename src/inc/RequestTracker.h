@@ -0,0 +1,51 @@
+#ifndef REQUESTTRACKER_H
+#define REQUESTTRACKER_H
+
+#include "debugPrint.h"
+#include "ProtocolSpec.h"
+#include "TimerWheel.h"
+#include <cstdint>
+#include <deque>
+
+using namespace std;
+
+// The protocol gives the server 5 s to answer AUTH and JOIN with a REPLY
+static constexpr uint64_t REPLY_TIMEOUT_NS = 5000000000ULL;
+
+// AUTH or JOIN waiting for its REPLY
+struct PendingRequest {
+    uint32_t tag = 0;           // Chosen by whoever queued the request, comes back with the REPLY or the timeout
+    MessageType type = MessageType::AUTH;
+    uint16_t messageId = 0;     // UDP MessageID the REPLY refers to, unused over TCP
+    TimerWheel::Handle deadline = 0;    // Cancelled when the REPLY arrives
+    uint64_t sentNs = 0;        // TimerWheel::now() at the send
+};
+
+/**
+ * @brief Requests in flight, matched to their REPLYs.
+ *
+ * UDP REPLYs name the request in Ref_MessageID. TCP REPLYs carry no reference, the server answers in order,
+ * so the oldest request gets the next REPLY. The deadlines are timers of the owner's TimerWheel, the table only
+ * remembers their handles. Network thread only.
+ */
+class RequestTracker {
+public:
+    explicit RequestTracker(bool byMessageId) : byMessageId(byMessageId) {}
+
+    // Registers a request the transport has just sent, deadline is the timer of its reply deadline
+    void sent(uint32_t tag, MessageType type, uint16_t messageId, TimerWheel::Handle deadline, uint64_t sentNs = 0);
+    /**
+     * @brief Takes the request a REPLY answers.
+     * @return false for a REPLY nobody is waiting for (unknown reference, or already timed out).
+     */
+    bool matchReply(uint16_t refMsgId, PendingRequest& request);
+    // Takes the request whose deadline timer fired, false if it was answered meanwhile
+    bool expire(uint32_t tag, PendingRequest& request);
+    size_t inFlight() const { return pending.size(); }
+
+private:
+    bool byMessageId;
+    deque<PendingRequest> pending;      // Send order
+};
+
+#endif //REQUESTTRACKER_H
@@ -0,0 +1,79 @@
+#ifndef SENDPACER_H
+#define SENDPACER_H
+
+#include "debugPrint.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+struct PacerStats {
+    uint64_t sent = 0;
+    uint64_t throttled = 0;         // Messages that had to wait for a token, each counted once
+    uint64_t rateDecreases = 0;     // Adaptive back-offs after retransmissions
+    uint64_t maxQueueDelayNs = 0;
+    uint64_t totalQueueDelayNs = 0;
+
+    void print(ostream& out, double currentRate) const;
+};
+
+/**
+ * @brief Token bucket limiting outgoing messages to a rate (messages/s) with a burst allowance.
+ *
+ * Used by the network thread in front of either transport. With adaptive pacing the rate is halved
+ * whenever the transport reports new retransmissions and creeps back towards the configured rate
+ * while sends go through cleanly (AIMD).
+ */
+class SendPacer {
+public:
+    // A rate of 0 disables pacing
+    SendPacer(double rate, uint32_t burst, bool adaptive);
+
+    bool enabled() const { return configuredRate > 0; }
+
+    // Takes one token for the head of the bulk queue if available, refilling the bucket up to now
+    bool tryAcquire(uint64_t nowNs);
+    // Time until the next token is available, 0 if one is available now
+    uint64_t waitNs(uint64_t nowNs);
+
+    /**
+     * @brief Accounts a message that left the outbound queue.
+     * @param queueDelayNs Time the message spent between enqueueing and sending.
+     * @param retransmits Running retransmission count of the transport, drives the adaptation.
+     */
+    void sent(uint64_t queueDelayNs, uint64_t retransmits);
+
+    // Enqueue time of the chat message now first in the outbound queue, 0 when none is waiting (network thread)
+    void queueHead(uint64_t enqueuedNs) { headEnqueuedNs.store(enqueuedNs, memory_order_relaxed); }
+    // Current queue delay: how long the first waiting chat message has been queued, 0 if none. Safe from any thread.
+    uint64_t queueDelayNs(uint64_t nowNs = now()) const;
+
+    double currentRate() const { return rate; }
+    const PacerStats& stats() const { return counters; }
+
+    static uint64_t now();
+
+private:
+    // Successful sends without a retransmission before the rate is raised again
+    static constexpr uint32_t INCREASE_INTERVAL = 32;
+    static constexpr double MIN_RATE = 1.0;
+
+    double configuredRate;
+    double rate;
+    double burst;
+    bool adaptive;
+    double tokens;
+    uint64_t lastRefillNs = 0;
+    uint64_t lastRetransmits = 0;
+    uint32_t cleanSends = 0;
+    bool headThrottled = false;     // The message waiting for a token is counted already, it is polled until one is free
+    atomic<uint64_t> headEnqueuedNs{0};
+    PacerStats counters;
+
+    void refill(uint64_t nowNs);
+};
+
+#endif //SENDPACER_H
@@ -0,0 +1,38 @@
+#ifndef SESSIONCONFIG_H
+#define SESSIONCONFIG_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+enum class ProtocolType {
+    TCP,
+    UDP
+};
+
+// How a ChatSession connects and behaves, the defaults are the client's
+struct SessionConfig {
+    ProtocolType proto = ProtocolType::TCP;
+    string host;                    // Hostname or IPv4 address
+    uint16_t port = 4567;
+    uint16_t timeout = 250;         // UDP confirmation timeout in ms
+    uint8_t retries = 3;            // UDP retransmissions of an unconfirmed message
+    string captureFile;             // Record raw inbound traffic, empty = off
+    int cpuCore = -1;               // Pin the network thread, -1 = not pinned
+    uint32_t busyPollUs = 0;        // Spin budget before the network thread sleeps
+    double sendRate = 0;            // Outgoing messages per second, 0 = unpaced
+    uint32_t sendBurst = 10;        // Messages allowed above the rate
+    bool adaptiveRate = false;      // Back off on UDP retransmissions
+    uint32_t controlWeight = 0;     // 0 = strict priority of control over bulk messages
+    int receiveBufferMax = 4 << 20; // UDP receive buffer ceiling in bytes, 0 = fixed
+};
+
+/**
+ * @brief Resolves a hostname (or passes an IPv4 address through) to a dotted IPv4 address.
+ * @throws runtime_error If the name does not resolve to any IPv4 address.
+ */
+string resolveHost(const string& host);
+
+#endif //SESSIONCONFIG_H
@@ -0,0 +1,178 @@
+#ifndef SIMULATEDNETWORK_H
+#define SIMULATEDNETWORK_H
+
+#include "debugPrint.h"
+#include "DatagramTransport.h"
+#include "Message.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+// Impairments applied to every datagram crossing the simulated network
+struct NetworkConditions {
+    double loss = 0;                    // Probability a datagram is dropped
+    double duplicate = 0;               // Probability it is delivered twice
+    double reorder = 0;                 // Probability it is held back so later datagrams overtake it
+    uint64_t delayNs = 1000000;         // One-way delay
+    uint64_t jitterNs = 0;              // Uniform extra delay on top of delayNs
+    uint64_t reorderDelayNs = 5000000;  // How long a reordered datagram is held back
+    double portChange = 0;              // Probability the server moves to a new port before sending a message
+};
+
+struct NetworkStats {
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+    uint64_t duplicated = 0;
+    uint64_t reordered = 0;
+    uint64_t delivered = 0;             // Copies handed to a bound port
+    uint64_t unreachable = 0;           // Arrived at a port nobody is bound to
+};
+
+/**
+ * Discrete event simulation of a lossy IPv4 network between ports of 127.0.0.1.
+ *
+ * Time only moves when runUntil() processes events, so simulating an hour of retransmit timeouts takes as long
+ * as the handlers run. All randomness comes from one seeded generator: the same seed and the same sequence of
+ * calls replay exactly the same losses, duplicates and delays.
+ */
+class SimulatedNetwork {
+public:
+    using Handler = function<void(const sockaddr_in& from, const vector<uint8_t>& data)>;
+
+    // The virtual clock starts at 1 s, so no timestamp is ever 0 (which means "none")
+    static constexpr uint64_t START_NS = 1000000000;
+
+    SimulatedNetwork(const NetworkConditions& conditions, uint64_t seed);
+
+    void bind(uint16_t port, Handler handler);
+    void unbind(uint16_t port);
+    void send(uint16_t fromPort, const sockaddr_in& to, const uint8_t* data, size_t length);
+    // Sends with any source address, e.g. a stray or spoofed datagram from another host
+    void send(const sockaddr_in& from, const sockaddr_in& to, const uint8_t* data, size_t length);
+    // Runs action when the clock reaches atNs
+    void schedule(uint64_t atNs, function<void()> action);
+    /**
+     * @brief Processes events in time order until done() holds or the next event is past deadlineNs.
+     * @return done(). When it is false the clock has been moved to deadlineNs.
+     */
+    bool runUntil(uint64_t deadlineNs, const function<bool()>& done);
+
+    uint64_t now() const { return clockNs; }
+    bool chance(double probability);
+    const NetworkConditions& getConditions() const { return conditions; }
+    const NetworkStats& stats() const { return networkStats; }
+
+    static sockaddr_in address(uint16_t port, const char* ip = "127.0.0.1");
+
+private:
+    struct Event {
+        uint64_t atNs;
+        uint64_t sequence;      // Keeps events at the same time in scheduling order
+        function<void()> action;
+        bool operator>(const Event& other) const {
+            return atNs != other.atNs ? atNs > other.atNs : sequence > other.sequence;
+        }
+    };
+
+    NetworkConditions conditions;
+    mt19937_64 rng;
+    uint64_t clockNs = START_NS;
+    uint64_t nextSequence = 0;
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+    map<uint16_t, Handler> endpoints;
+    NetworkStats networkStats;
+
+    void deliver(const sockaddr_in& from, uint16_t toPort, vector<uint8_t> data, uint64_t delayNs);
+};
+
+// DatagramTransport for a UDPClient living on the simulated network
+class SimulatedTransport : public DatagramTransport {
+public:
+    SimulatedTransport(SimulatedNetwork& network, uint16_t port);
+    ~SimulatedTransport() override;
+
+    ssize_t sendTo(const uint8_t* data, size_t length, const sockaddr_in& to) override;
+    bool wait(int timeoutMs) override;
+    ssize_t receiveFrom(uint8_t* buffer, size_t length, sockaddr_in& from, uint64_t& kernelNs) override;
+    bool connect(const sockaddr_in& peer) override;
+    uint64_t monotonicNs() const override { return network.now(); }
+    uint64_t wallClockNs() const override { return network.now(); }
+    void close() override;
+    // Datagrams dropped because they did not come from the connected peer
+    uint64_t filtered() const { return filteredCount; }
+
+private:
+    struct Arrival {
+        sockaddr_in from;
+        vector<uint8_t> data;
+        uint64_t atNs;
+    };
+
+    SimulatedNetwork& network;
+    uint16_t port;
+    bool bound = true;
+    uint64_t filteredCount = 0;
+    deque<Arrival> inbox;
+};
+
+struct ServerStats {
+    uint64_t received = 0;          // Datagrams other than CONFIRM
+    uint64_t duplicates = 0;        // ... of which already seen
+    uint64_t messages = 0;          // Distinct MSG delivered
+    uint64_t contentBytes = 0;      // Their content
+    uint64_t pushed = 0;            // Messages sent to the client (REPLY and MSG)
+    uint64_t pushConfirmed = 0;
+    uint64_t pushFailed = 0;        // Gave up after the retries
+    uint64_t retransmits = 0;
+    uint64_t portChanges = 0;
+};
+
+/**
+ * Minimal IPK25 UDP server on the simulated network: CONFIRMs and dedupes everything, answers AUTH and JOIN
+ * with a successful REPLY from a dynamic port and retransmits its own messages until they are confirmed.
+ * It keeps accepting on every port it has used, but always sends from the newest one.
+ */
+class SimulatedServer {
+public:
+    SimulatedServer(SimulatedNetwork& network, uint16_t port, uint16_t timeoutMs, uint8_t retries);
+
+    // Sends a MSG to the client (which must have contacted the server before)
+    void push(string_view displayName, string_view content);
+    // Continues the session from a new port, as a misbehaving or spoofing server would
+    void changePort() { movePort(); }
+    bool idle() const { return unconfirmed.empty(); }
+    uint16_t currentPort() const { return sendPort; }
+    const ServerStats& stats() const { return serverStats; }
+    // Content of the distinct MSGs received, in arrival order
+    const vector<string>& messages() const { return received; }
+
+private:
+    SimulatedNetwork& network;
+    uint16_t timeoutMs;
+    uint8_t retries;
+    uint16_t sendPort = 0;
+    uint16_t nextPort = 50000;
+    uint16_t nextMsgId = 0;
+    sockaddr_in client{};
+    set<uint16_t> seenIds;
+    map<uint16_t, vector<uint8_t>> unconfirmed;
+    vector<string> received;
+    ServerStats serverStats;
+
+    void listen(uint16_t port);
+    void receive(const sockaddr_in& from, const vector<uint8_t>& data);
+    void movePort();
+    void sendReliable(vector<uint8_t> datagram);
+    void retransmit(uint16_t msgId, uint8_t attempt);
+};
+
+#endif //SIMULATEDNETWORK_H
@@ -0,0 +1,75 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+using namespace std;
+
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * @brief Bounded wait-free single-producer/single-consumer ring queue.
+ *
+ * Exactly one thread may call tryPush() and exactly one (other) thread may call tryPop().
+ * Producer and consumer indices live on separate cache lines, each side keeps a private
+ * copy of the other's index and only re-reads the shared one when the ring looks full/empty.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    bool tryPush(T&& item) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - cachedHead == Capacity) {
+            cachedHead = head.load(memory_order_acquire);
+            if (t - cachedHead == Capacity) {
+                return false;
+            }
+        }
+        slots[t & (Capacity - 1)] = std::move(item);
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(memory_order_acquire);
+            if (h == cachedTail) {
+                return false;
+            }
+        }
+        item = std::move(slots[h & (Capacity - 1)]);
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    // Consumer side: the item tryPop() would return next, nullptr if the ring is empty
+    const T* front() {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(memory_order_acquire);
+            if (h == cachedTail) {
+                return nullptr;
+            }
+        }
+        return &slots[h & (Capacity - 1)];
+    }
+
+    // Approximate when called concurrently, exact from either side once the other is idle
+    size_t size() const { return tail.load(memory_order_acquire) - head.load(memory_order_acquire); }
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    alignas(CACHE_LINE_SIZE) atomic<size_t> head{0};   // Next slot to pop, written by the consumer
+    alignas(CACHE_LINE_SIZE) size_t cachedTail = 0;    // Consumer's last seen tail
+    alignas(CACHE_LINE_SIZE) atomic<size_t> tail{0};   // Next slot to fill, written by the producer
+    alignas(CACHE_LINE_SIZE) size_t cachedHead = 0;    // Producer's last seen head
+    alignas(CACHE_LINE_SIZE) array<T, Capacity> slots{};
+};
+
+#endif //SPSCQUEUE_H
@@ -1,7 +1,7 @@
 #ifndef TCPCLIENT_H
 #define TCPCLIENT_H
 
-#include "ArgHandler.h"
+#include "SessionConfig.h"
 #include "ProtocolClient.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -9,18 +9,53 @@
 #include <stdexcept>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <cerrno>
 
-class TCPClient : public ProtocolClient
+/**
+ * @brief Reassembles CRLF-terminated frames in one linear buffer.
+ *
+ * Data is received straight into the buffer and frames are handed out as views into it,
+ * they stay valid until the next prepare()/append(). The buffer never grows past the longest
+ * legal frame, a peer that sends more without a CRLF gets invalid_argument like any malformed frame.
+ */
+class TCPFramer {
+public:
+    TCPFramer(size_t initialCapacity = 70000, size_t maxFrame = Protocol::maxTCPFrame) : buffer(initialCapacity), maxFrame(maxFrame) {}
+
+    // Returns space for the next recv(), compacting or growing the buffer as needed
+    char* prepare(size_t& space);
+    void commit(size_t bytes) { end += bytes; }
+    void append(const char* data, size_t length);
+
+    bool next(string_view& frame);
+    bool hasFrame() const { return findFrameEnd() != string_view::npos; }
+    size_t pending() const { return end - start; }
+
+private:
+    vector<char> buffer;
+    size_t maxFrame;
+    size_t start = 0;               // First byte not handed out as a frame yet
+    size_t end = 0;                 // End of received data
+    mutable size_t scanned = 0;     // Bytes before this offset are known not to start a CRLF
+
+    size_t findFrameEnd() const;
+};
+
+class TCPClient final : public ProtocolClient
 {
 public:
-    TCPClient(const ParsedArgs& args);
+    TCPClient(const SessionConfig& args);
     ~TCPClient();
 
     void stop() override;
     void sendMessage(unique_ptr<Message> message) override;
-    unique_ptr<Message> receiveMessage() override;
+    bool receiveView(MessageView& view) override;
+    bool hasBufferedMessage() const override { return framer.hasFrame(); }
 private:
-    std::string recvBuffer;
+    TCPFramer framer;
+    uint32_t framesParsed = 0;
+    string sendBuffer;              // Reused by every sendMessage()
 };
 #endif //TCPCLIENT_H
@@ -0,0 +1,127 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "debugPrint.h"
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Hierarchical timing wheel on the monotonic clock: O(1) schedule and cancel, no allocation per timer.
+ *
+ * Four levels of 256 slots with 1 ms ticks cover 2^32 ms (49 days), later deadlines wait in an overflow list.
+ * A timer is filed at the lowest level whose slot still distinguishes its tick from the current one and moves
+ * down a level when the wheel reaches that slot, so it is touched at most once per level. Timers are nodes of a
+ * pool linked into their slot; a handle carries the node's generation, so cancelling a timer that already fired
+ * (and whose node may be reused) does nothing. Deadlines are rounded up to the tick, timers never fire early.
+ * Not thread-safe, the owner drives it from its event loop: wait timeoutMs(), then advance().
+ */
+class TimerWheel {
+public:
+    using Handle = uint64_t;                            // 0 = no timer
+    static constexpr uint64_t TICK_NS = 1000000;
+
+    explicit TimerWheel(uint64_t nowNs = now(), size_t capacity = 64);
+
+    // Fires cookie at or after deadlineNs, a deadline in the past fires on the next advance()
+    Handle schedule(uint64_t deadlineNs, uint64_t cookie);
+    // False if the timer already fired or was cancelled
+    bool cancel(Handle handle);
+    /**
+     * @brief Fires every timer due at nowNs, in deadline order (by tick).
+     * @param fire Called with the cookie; may schedule and cancel timers, the fired one is already gone.
+     * @return Number of timers fired.
+     */
+    template <typename F>
+    size_t advance(uint64_t nowNs, F&& fire);
+    // Milliseconds until the next advance() with work to do (rounded up), -1 with nothing scheduled
+    int timeoutMs(uint64_t nowNs) const;
+    size_t size() const { return count; }
+
+    // CLOCK_MONOTONIC in ns, the clock deadlines are expected on
+    static uint64_t now();
+
+private:
+    static constexpr uint32_t LEVELS = 4;
+    static constexpr uint32_t SLOT_BITS = 8;
+    static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    static constexpr uint32_t OVERFLOW_LIST = LEVELS * SLOTS;  // Deadlines beyond the top level's rotation
+    static constexpr uint32_t DUE_LIST = OVERFLOW_LIST + 1;     // Scheduled for a tick already processed
+    static constexpr uint32_t FIRING_LIST = DUE_LIST + 1;       // Due in the tick being fired
+    static constexpr uint32_t LISTS = FIRING_LIST + 1;
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr uint32_t FREE = UINT32_MAX;              // Node::list of a pooled node
+
+    struct Node {
+        uint64_t tick = 0;              // Deadline in ticks
+        uint64_t cookie = 0;
+        uint32_t prev = NONE;
+        uint32_t next = NONE;           // Also links the free list
+        uint32_t list = FREE;           // Slot (level * SLOTS + slot) or one of the lists above
+        uint32_t generation = 1;
+    };
+
+    vector<Node> nodes;
+    uint32_t freeHead = NONE;
+    uint32_t heads[LISTS];
+    uint64_t occupied[LEVELS][SLOTS / 64] = {};     // Non-empty slots, for finding the next one without scanning
+    uint64_t currentTick;               // First tick not processed yet
+    size_t count = 0;
+
+    void file(uint32_t index);
+    void link(uint32_t index, uint32_t list);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void moveList(uint32_t from);
+    template <typename F>
+    size_t fireCollected(F& fire);
+    // Moves the timers due at currentTick to the firing list, cascading the slots that start here
+    void collect();
+    // Earliest tick with a slot to cascade or timers to fire, UINT64_MAX with none
+    uint64_t nextEventTick() const;
+};
+
+template <typename F>
+size_t TimerWheel::fireCollected(F& fire) {
+    size_t fired = 0;
+    while (heads[FIRING_LIST] != NONE) {
+        uint32_t index = heads[FIRING_LIST];
+        uint64_t cookie = nodes[index].cookie;
+        unlink(index);
+        release(index);
+        fired++;
+        fire(cookie);
+    }
+    return fired;
+}
+
+template <typename F>
+size_t TimerWheel::advance(uint64_t nowNs, F&& fire) {
+    uint64_t target = nowNs / TICK_NS;
+    // Late timers go first; ones the callbacks schedule in the past wait for the next call, so this one ends
+    while (heads[DUE_LIST] != NONE) {
+        uint32_t index = heads[DUE_LIST];
+        unlink(index);
+        link(index, FIRING_LIST);
+    }
+    size_t fired = fireCollected(fire);
+    while (count > 0) {
+        uint64_t next = nextEventTick();
+        if (next > target) {
+            break;
+        }
+        // Nothing happens in the ticks in between, skip them
+        currentTick = next;
+        collect();
+        currentTick++;
+        // Timers the callbacks schedule never land on the list being fired
+        fired += fireCollected(fire);
+    }
+    if (currentTick <= target) {
+        currentTick = target + 1;
+    }
+    return fired;
+}
+
+#endif //TIMERWHEEL_H
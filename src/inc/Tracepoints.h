@@ -0,0 +1,45 @@
+#ifndef TRACEPOINTS_H
+#define TRACEPOINTS_H
+
+/**
+ * USDT probes of provider "ipk25chat", for perf and bpftrace on any build (see src/tools/bpftrace/).
+ * A probe is a nop in the code plus a note in .note.stapsdt, the arguments are only read by an attached tracer.
+ * Without <sys/sdt.h> (systemtap-sdt-dev) or with -DNO_TRACEPOINTS the probes compile to nothing.
+ * An argument that costs work of its own (e.g. a clock read) is computed under TRACE_ENABLED(name), which tests the
+ * probe's semaphore, raised by the tracer while it is attached.
+ *
+ * Probe               Arguments
+ * frame_received      proto (0 TCP, 1 UDP), bytes, kernel receive timestamp [ns, wall clock, 0 = none]
+ * frame_parsed        MessageType, MessageID (-1 over TCP), bytes
+ * message_sent        MessageType, MessageID (-1 over TCP), bytes
+ * confirm_matched     MessageID, send to CONFIRM [ns], attempt (0 = first transmission)
+ * retransmit          MessageID, attempt, bytes
+ * duplicate_dropped   MessageID, wire type code
+ * reply_correlated    request tag, Ref_MessageID, request sent to REPLY received [ns], success
+ * output_flushed      messages in the batch, oldest one's receive to the flush [ns]
+ */
+
+#if !defined(NO_TRACEPOINTS) && __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define TRACE_PROBE(name, ...) STAP_PROBEV(ipk25chat, name, __VA_ARGS__)
+#define TRACE_ENABLED(name) __builtin_expect(ipk25chat_##name##_semaphore != 0, 0)
+#define TRACE_SEMAPHORE(name) volatile unsigned short ipk25chat_##name##_semaphore
+
+// Defined in Tracepoints.cpp, every probe note refers to the semaphore of its probe
+extern "C" {
+extern TRACE_SEMAPHORE(frame_received);
+extern TRACE_SEMAPHORE(frame_parsed);
+extern TRACE_SEMAPHORE(message_sent);
+extern TRACE_SEMAPHORE(confirm_matched);
+extern TRACE_SEMAPHORE(retransmit);
+extern TRACE_SEMAPHORE(duplicate_dropped);
+extern TRACE_SEMAPHORE(reply_correlated);
+extern TRACE_SEMAPHORE(output_flushed);
+}
+#else
+#define TRACE_PROBE(name, ...) ((void)0)
+#define TRACE_ENABLED(name) false
+#endif
+
+#endif //TRACEPOINTS_H
@@ -0,0 +1,78 @@
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include "debugPrint.h"
+#include "SessionConfig.h"
+#include "Message.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Capture file layout (integers are little-endian):
+ *   header: "IPKCAP" | u8 version | u8 protocol (0 = TCP, 1 = UDP)
+ *   record: u8 kind | u64 timestamp [ns, steady clock] | u32 length | payload[length]
+ */
+enum class CaptureRecordKind : uint8_t {
+    TCP_CHUNK = 1,      // Raw bytes returned by a single recv()
+    UDP_DATAGRAM = 2,   // One whole datagram returned by recvfrom()
+    OUTCOME = 3,        // Parse result seen live: u32 frame index | u8 MessageType (0xFF = parse error)
+};
+
+struct CaptureRecord {
+    CaptureRecordKind kind;
+    uint64_t timestampNs;
+    vector<uint8_t> payload;
+};
+
+class TrafficCapture {
+public:
+    static constexpr uint8_t VERSION = 1;
+    static constexpr uint8_t OUTCOME_ERROR = 0xFF;
+
+    TrafficCapture(const string& path, ProtocolType proto);
+    ~TrafficCapture();
+
+    /**
+     * @brief Appends one inbound TCP chunk or UDP datagram to the capture.
+     * @return Index of the record among inbound records (the UDP frame index).
+     */
+    uint32_t recordInbound(const void* data, size_t length);
+
+    /**
+     * @brief Stores how the live client parsed a frame, so a replay can detect divergence.
+     * @param outcome outcomeCode() of the parsed type or OUTCOME_ERROR when parsing threw.
+     */
+    void recordOutcome(uint32_t frameIndex, uint8_t outcome);
+
+    static uint8_t outcomeCode(MessageType type) { return static_cast<uint8_t>(type); }
+    static uint64_t now();
+
+private:
+    FILE* file = nullptr;
+    ProtocolType proto;
+    uint32_t inboundCount = 0;
+    mutex lock;
+
+    void writeRecord(CaptureRecordKind kind, const void* data, size_t length);
+};
+
+class CaptureReader {
+public:
+    CaptureReader(const string& path);
+    ~CaptureReader();
+
+    ProtocolType protocol() const { return proto; }
+    bool next(CaptureRecord& record);
+
+private:
+    FILE* file = nullptr;
+    ProtocolType proto;
+};
+
+#endif //TRAFFICCAPTURE_H
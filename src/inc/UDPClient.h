@@ -1,11 +1,16 @@
 #ifndef UDPCLIENT_H
 #define UDPCLIENT_H
 
-#include "ArgHandler.h"
+#include "SessionConfig.h"
 #include "ProtocolClient.h"
-#include <set>
+#include "DatagramTransport.h"
+#include <array>
+#include <bitset>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <poll.h>
 #include <arpa/inet.h>
-#include <atomic>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/time.h>
@@ -14,20 +19,79 @@
 #include <cstdio>
 #include <cstring>
 
-class UDPClient: public ProtocolClient {
+class UDPClient final : public ProtocolClient {
 public:
-    UDPClient(const ParsedArgs& args);
+    // Uses a real socket unless a transport (e.g. a SimulatedTransport) is given
+    UDPClient(const SessionConfig& args, unique_ptr<DatagramTransport> transport = nullptr);
     ~UDPClient();
 
     void stop() override;
     void sendMessage(unique_ptr<Message> message) override;
-    unique_ptr<Message> receiveMessage() override;
+    bool receiveView(MessageView& view) override;
+    bool hasBufferedMessage() const override { return !pendingDatagrams.empty(); }
+    // True once the first REPLY fixed the server's dynamic port and the socket was connected to it
+    bool isConnected() const { return transport->isConnected(); }
+    // Datagrams dropped because they came from a host other than the server
+    uint64_t strayDatagrams() const { return strayCount; }
+    const ReceiveBufferStats* receiveBuffer() const override { return transport->receiveBuffer(); }
+
+    /**
+     * @brief Lets control messages overtake a MSG that is being retransmitted (stop-and-wait blocks the sender).
+     * @param check Asked before every retransmission of a MSG, true parks it: sendMessage() returns, the next
+     * sendMessage() goes out while the MSG keeps its MessageID and remaining attempts for resumeParked().
+     */
+    void setPreempt(function<bool()> check) { preempt = move(check); }
+    bool hasParked() const { return parked.active; }
+    // Continues the parked MSG's retransmissions, returns at once if its CONFIRM arrived in the meantime
+    void resumeParked();
 private:
+    // Server message that arrived while sendMessage() waited for its CONFIRM, already confirmed
+    struct PendingDatagram {
+        vector<uint8_t> data;
+        uint32_t frameIndex;
+        ReceiveTimes times;
+    };
+
+    unique_ptr<DatagramTransport> transport;
+    array<uint8_t, 65536> recvBuffer;   // Backing storage of the last received view
     uint16_t timeout;
     uint8_t retries;
     uint16_t nextMsgId = 1;  // next message ID for UDP reliability
     struct sockaddr_in serverAddr;           // Remote server address (dynamic port)
-    set<uint16_t> receivedMsgIds;       // Track and dedupe incoming message IDs
-    std::atomic<bool> waitingForConfirm{false};  // skip receiveMessage while awaiting confirm
+    bitset<65536> receivedMsgIds;       // Track and dedupe incoming message IDs, one bit per ID
+    // Latest AUTH/JOIN MessageIDs sent before the server's port is known (0 = free slot). Recorded at the send because
+    // their REPLY may arrive while sendMessage() still waits for the CONFIRM, before the session's RequestTracker has them
+    array<uint16_t, 16> requestIds{};
+    size_t nextRequestSlot = 0;
+    vector<uint8_t> sendBuffer;         // Reused by every sendMessage()
+    vector<uint8_t> confirmBuffer;      // Reused by every CONFIRM
+    uint64_t strayCount = 0;
+    deque<PendingDatagram> pendingDatagrams;
+    function<bool()> preempt;
+    struct {
+        bool active = false;
+        bool confirmed = false;     // Its CONFIRM came while another message waited for its own
+        uint16_t msgId = 0;
+        int nextAttempt = 0;
+    } parked;
+    vector<uint8_t> parkedBuffer;       // The parked frame, swapped with sendBuffer
+
+    /**
+     * @brief Sends sendBuffer and waits for its CONFIRM, retransmitting up to the retry limit (throws after it).
+     * @param preemptible Consult the preempt hook before each retransmission.
+     */
+    void transmit(uint16_t msgId, int firstAttempt, bool preemptible);
+
+    /**
+     * @brief Checks that a datagram comes from the server's host. Once connected the kernel has done that already.
+     */
+    bool fromServer(const sockaddr_in& peer);
+    /**
+     * @brief CONFIRMs a freshly read server datagram to its sender and filters duplicates.
+     * The first REPLY to one of our AUTH/JOIN requests fixes the server's port and connects the socket.
+     * @return false if the datagram must not be delivered (CONFIRM or duplicate).
+     */
+    bool acknowledge(const uint8_t* buf, size_t length, const sockaddr_in& peer);
+    bool deliver(MessageView& view, size_t length, uint32_t frameIndex);
 };
 #endif //UDPCLIENT_H
@@ -9,5 +9,5 @@ fprintf(stderr, "\033[38;5;214m%s:%-4d | %15s | \033[0m\n", __FILE__, __LINE__,
 fflush(stderr); \
 } while (0)
 #else
-#define printf_debug(format, ...) (0)
+#define printf_debug(format, ...) ((void)0)
 #endif
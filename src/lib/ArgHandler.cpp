@@ -1,5 +1,22 @@
 #include "../inc/ArgHandler.h"
 
+#include <cerrno>
+#include <climits>
+
+// Whole number in [0, max], anything else is a usage error like an unknown argument
+static long long parseCount(const char* flag, const char* value, long long max) {
+    char* end = nullptr;
+    errno = 0;
+    long long number = strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || number < 0 || number > max) {
+        cout << "ERROR: CLI arguments: " << flag << " takes a number from 0 to " << max << ", not " << value << "\n"
+            << flush;
+        ArgHandler::printHelp();
+        exit(1);
+    }
+    return number;
+}
+
 ParsedArgs ArgHandler::parse(int argc, char* argv[]) {
     ParsedArgs args;
     bool valid = false;
@@ -12,11 +29,11 @@ ParsedArgs ArgHandler::parse(int argc, char* argv[]) {
         } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
             i++;
             if(strcmp(argv[i], "tcp") == 0) {
-            	args.proto = ProtocolType::TCP;
+            	args.session.proto = ProtocolType::TCP;
                 valid = true;
                 printf_debug("CLI arguments: Protocol set to TCP");
             } else if(strcmp(argv[i], "udp") == 0) {
-                args.proto = ProtocolType::UDP;
+                args.session.proto = ProtocolType::UDP;
                 valid = true;
                 printf_debug("CLI arguments: Protocol set to UDP");
             } else {
@@ -25,17 +42,74 @@ ParsedArgs ArgHandler::parse(int argc, char* argv[]) {
                 exit(1);
             }
         } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
-            args.host = resolve_address(argv[++i]);
-            printf_debug("CLI arguments: Host set to %s resolved from %s", args.host.c_str(), argv[i]);
+            // Resolved here already, an unknown host is a usage error like a bad argument
+            try {
+                args.session.host = resolveHost(argv[++i]);
+            } catch (const runtime_error& e) {
+                cout << e.what() << "\n" << flush;
+                exit(EXIT_FAILURE);
+            }
+            printf_debug("CLI arguments: Host set to %s resolved from %s", args.session.host.c_str(), argv[i]);
         } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
-            args.port = stoi(argv[++i]);
-            printf_debug("CLI arguments: Port set to %d", args.port);
+            args.session.port = stoi(argv[++i]);
+            printf_debug("CLI arguments: Port set to %d", args.session.port);
         } else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
-            args.timeout = stoi(argv[++i]);
-            printf_debug("CLI arguments: Timeout set to %d", args.timeout);
+            args.session.timeout = stoi(argv[++i]);
+            printf_debug("CLI arguments: Timeout set to %d", args.session.timeout);
         } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
-            args.retries = stoi(argv[++i]);
-            printf_debug("CLI arguments: Retries set to %d", args.retries);
+            args.session.retries = stoi(argv[++i]);
+            printf_debug("CLI arguments: Retries set to %d", args.session.retries);
+        } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            args.session.captureFile = argv[++i];
+            printf_debug("CLI arguments: Capturing inbound traffic to %s", args.session.captureFile.c_str());
+        } else if (!strcmp(argv[i], "-P") && i + 1 < argc) {
+            args.session.cpuCore = stoi(argv[++i]);
+            printf_debug("CLI arguments: Network thread pinned to CPU %d", args.session.cpuCore);
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            args.session.busyPollUs = stoul(argv[++i]);
+            printf_debug("CLI arguments: Busy-poll budget set to %u us", args.session.busyPollUs);
+        } else if (!strcmp(argv[i], "-R") && i + 1 < argc) {
+            args.session.sendRate = stod(argv[++i]);
+            printf_debug("CLI arguments: Send rate set to %.1f msg/s", args.session.sendRate);
+        } else if (!strcmp(argv[i], "-B") && i + 1 < argc) {
+            args.session.sendBurst = stoul(argv[++i]);
+            printf_debug("CLI arguments: Send burst set to %u", args.session.sendBurst);
+        } else if (!strcmp(argv[i], "-A")) {
+            args.session.adaptiveRate = true;
+            printf_debug("CLI arguments: Adaptive send rate enabled");
+        } else if (!strcmp(argv[i], "-W") && i + 1 < argc) {
+            args.session.controlWeight = stoul(argv[++i]);
+            printf_debug("CLI arguments: Control weight set to %u", args.session.controlWeight);
+        } else if (!strcmp(argv[i], "-S")) {
+            args.printStats = true;
+            printf_debug("CLI arguments: Statistics enabled");
+        } else if (!strcmp(argv[i], "-D") && i + 1 < argc) {
+            args.daemonSocket = argv[++i];
+            printf_debug("CLI arguments: Daemon mode on %s", args.daemonSocket.c_str());
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "text")) {
+                args.outputFormat = OutputFormat::TEXT;
+            } else if (!strcmp(argv[i], "json")) {
+                args.outputFormat = OutputFormat::JSON;
+            } else if (!strcmp(argv[i], "binary")) {
+                args.outputFormat = OutputFormat::BINARY;
+            } else {
+                cout << "ERROR: CLI arguments: Unknown output format "<< argv[i] << "\n" << flush;
+                printHelp();
+                exit(1);
+            }
+            printf_debug("CLI arguments: Output format set to %s", argv[i]);
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            args.filterRules = argv[++i];
+            printf_debug("CLI arguments: Keyword filter rules %s", args.filterRules.c_str());
+        } else if (!strcmp(argv[i], "-M") && i + 1 < argc) {
+            // Counted in bytes as an int like SO_RCVBUF, 0 keeps the buffer fixed
+            args.session.receiveBufferMax = static_cast<int>(parseCount("-M", argv[++i], INT_MAX / 1024) * 1024);
+            printf_debug("CLI arguments: UDP receive buffer ceiling set to %d bytes", args.session.receiveBufferMax);
+        } else if (!strcmp(argv[i], "-L") && i + 1 < argc) {
+            args.pasteWindowMs = max(stoi(argv[++i]), 0);
+            printf_debug("CLI arguments: Paste coalescing with a %d ms quiet interval", args.pasteWindowMs);
         } else {
             cout << "ERROR: CLI arguments: Unknown argument "<< argv[i] << "\n" << flush;
             printHelp();
@@ -43,52 +117,37 @@ ParsedArgs ArgHandler::parse(int argc, char* argv[]) {
         }
     }
 
-    if (!valid || args.host.empty()) {
+    if (!valid || args.session.host.empty()) {
 	    cout << "ERROR: CLI arguments: Host or Protocol not specified" << "\n" << flush;
 	    printHelp();
 	    exit(1);
     }
-    printf_debug("CLI arguments: returning p=%s h=%s p=%d t=%d r=%d", args.proto == ProtocolType::TCP ? "tcp" : "udp", args.host.c_str(), args.port, args.timeout, args.retries);
+    printf_debug("CLI arguments: returning p=%s h=%s p=%d t=%d r=%d", args.session.proto == ProtocolType::TCP ? "tcp" : "udp", args.session.host.c_str(), args.session.port, args.session.timeout, args.session.retries);
     return args;
 }
 
-// Resolve the target address (either domain or IP)
-// https://stackoverflow.com/questions/4780021/c-retrieve-the-ip-from-a-name-from-the-dns-linux/4780047
-string ArgHandler::resolve_address(string host) {
-    addrinfo hints = {};
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-
-    addrinfo* address_list = nullptr; // Deklarace address_list
-    int status = getaddrinfo(host.c_str(), nullptr, &hints, &address_list);
-    if (status != 0) {
-        cout << "Error: Couldn't resolve address: " << host << endl;
-        exit(EXIT_FAILURE);
-    }
-
-    char ip_str[INET_ADDRSTRLEN];
-    for (addrinfo* addr = address_list; addr != nullptr; addr = addr->ai_next) {
-        sockaddr_in* ipv4 = reinterpret_cast<sockaddr_in*>(addr->ai_addr);
-        if (inet_ntop(AF_INET, &(ipv4->sin_addr), ip_str, sizeof(ip_str))) {
-            freeaddrinfo(address_list);
-            return string(ip_str);
-        }
-    }
-
-    freeaddrinfo(address_list);
-    cout << "Error: No valid IPv4 address found for: " << host << endl;
-    exit(EXIT_FAILURE);
-}
-
 void ArgHandler::printHelp() {
     cout <<
-        "Usage: ./ipk25-chat -t tcp|udp -s server [-p port] [-d timeout] [-r retries]\n"
+        "Usage: ./ipk25-chat -t tcp|udp -s server [-p port] [-d timeout] [-r retries] [-w capture] [-P cpu] [-b budget] [-R rate] [-B burst] [-A] [-W weight] [-S] [-D socket] [-o format] [-f rules] [-M KiB] [-L ms]\n"
         "Options:\n"
         "  -t <tcp|udp>    Transport protocol used for connection (required)\n"
         "  -s <address>    Server IP or hostname (required)\n"
         "  -p <port>       Server port (default: 4567)\n"
         "  -d <timeout>    UDP confirmation timeout in milliseconds (default: 250)\n"
         "  -r <retries>    Maximum number of UDP retransmissions (default: 3)\n"
+        "  -w <file>       Record raw inbound traffic into a capture file for ipk25chat-replay\n"
+        "  -P <cpu>        Pin the network thread to the given CPU core\n"
+        "  -b <us>         Busy-poll the socket for up to <us> microseconds before sleeping\n"
+        "  -R <msg/s>      Pace outgoing messages to at most <msg/s> (default: unpaced)\n"
+        "  -B <count>      Burst of messages allowed above the pacing rate (default: 10)\n"
+        "  -A              Lower the pacing rate while UDP retransmissions occur\n"
+        "  -W <n>          Let one chat message through after every <n> control messages (default: strict priority)\n"
+        "  -S              Print statistics to stderr on exit: outbound latency per class, latency profile, receive buffer, paste coalescing\n"
+        "  -D <path>       Run as a daemon sharing one session with local processes over a Unix socket\n"
+        "  -o <format>     Output format: text (default), json (NDJSON) or binary records\n"
+        "  -f <file>       Filter received messages by the keyword rules in <file>, reloaded when it changes\n"
+        "  -M <KiB>        Grow the UDP receive buffer up to <KiB> when the kernel drops datagrams (default: 4096, 0 = fixed)\n"
+        "  -L <ms>         Merge chat lines pasted in one burst (one read, or gaps under <ms>) into as few messages as fit\n"
         "  -h              Prints this program help output and exits\n"
          << flush;
 }
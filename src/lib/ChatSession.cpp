@@ -0,0 +1,442 @@
+#include "../inc/ChatSession.h"
+#include "../inc/Tracepoints.h"
+
+ChatSession::ChatSession(const SessionConfig& config, SessionCallbacks callbacks) :
+    config(config), callbacks(move(callbacks)), outbound(config.controlWeight),
+    pacer(config.sendRate, config.sendBurst, config.adaptiveRate), requests(config.proto == ProtocolType::UDP) {
+    printf_debug("ChatSession: Constructing...");
+    // The transports take an address
+    this->config.host = resolveHost(config.host);
+    if (config.proto == ProtocolType::TCP) {
+        printf_debug("ChatSession: Creating TCPClient and thread");
+        startNetwork(make_unique<TCPClient>(this->config));
+    } else {
+        printf_debug("ChatSession: Creating UDPClient and thread");
+        startNetwork(make_unique<UDPClient>(this->config));
+    }
+}
+
+template <SessionTransport Transport>
+void ChatSession::startNetwork(unique_ptr<Transport> transport) {
+    Transport& session = *transport;
+    client = move(transport);
+    client->attachProfile(&profile);
+    if constexpr (is_same_v<Transport, UDPClient>) {
+        // A MSG stuck in retransmissions holds control traffic back for one CONFIRM timeout, not for all its retries
+        session.setPreempt([this]() { return outbound.hasPending(TrafficClass::CONTROL); });
+    }
+    networkThread = thread([this, &session]() { networkLoop(session); });
+}
+
+ChatSession::~ChatSession() {
+    printf_debug("ChatSession: Destructing...");
+    close();
+}
+
+uint32_t ChatSession::auth(string_view username, string_view secret, string_view displayName) {
+    auto message = make_unique<AuthMessage>(username, displayName, secret);
+    this->displayName = displayName;
+    return request(move(message));
+}
+
+uint32_t ChatSession::join(string_view channel) {
+    return request(make_unique<JoinMessage>(channel, displayName));
+}
+
+bool ChatSession::send(string_view content) {
+    return enqueue(make_unique<MsgMessage>(displayName, content));
+}
+
+void ChatSession::rename(string_view displayName) {
+    DisplayNameField<>::validate(displayName);
+    this->displayName = displayName;
+}
+
+uint32_t ChatSession::request(unique_ptr<Message> message) {
+    uint32_t tag = nextRequest++;
+    MessageType type = message->getType();
+    // The REPLY is dispatched on this thread too, so registering after the push cannot miss it
+    if (!enqueue(move(message), false, false, tag)) {
+        return 0;
+    }
+    issued[tag] = type;
+    return tag;
+}
+
+bool ChatSession::enqueue(unique_ptr<Message> message, bool close, bool afterQueued, uint32_t requestTag) {
+    TrafficClass cls = afterQueued || (message && trafficClassOf(message->getType()) == TrafficClass::BULK)
+        ? TrafficClass::BULK : TrafficClass::CONTROL;
+    OutboundCommand command{move(message), close, SendPacer::now(), requestTag};
+    if (close) {
+        // A close request must not be lost, wait for the network thread to make room
+        while (!outbound.tryPush(cls, move(command))) {
+            if (networkFinished.load(std::memory_order_acquire)) {
+                return false;
+            }
+            this_thread::yield();
+        }
+    } else if (!outbound.tryPush(cls, move(command))) {
+        return false;
+    }
+    outboundReady.notify();
+    return true;
+}
+
+void ChatSession::close(bool afterQueued) {
+    open = false;
+    if (!networkThread.joinable()) {
+        return;
+    }
+    printf_debug("ChatSession: Closing...");
+    unique_ptr<Message> bye;
+    if (authenticated) {
+        bye = make_unique<ByeMessage>(displayName);
+    }
+    enqueue(move(bye), true, afterQueued);
+    networkThread.join();
+}
+
+void ChatSession::abort(string_view reason) {
+    if (!displayName.empty()) {
+        enqueue(make_unique<ErrMessage>(displayName, reason));
+    }
+    close();
+}
+
+bool ChatSession::poll() {
+    inboundReady.clear();
+    InboundEvent event;
+    while (open && inbound.tryPop(event)) {
+        dispatch(event);
+    }
+    if (networkFinished.load(std::memory_order_acquire)) {
+        // Everything the network thread published is visible now
+        while (open && inbound.tryPop(event)) {
+            dispatch(event);
+        }
+        close();
+    }
+    return open;
+}
+
+bool ChatSession::runOnce(int timeoutMs) {
+    pollfd fd = {inboundReady.fd(), POLLIN, 0};
+    ::poll(&fd, 1, timeoutMs);
+    return poll();
+}
+
+void ChatSession::dispatch(InboundEvent& event) {
+    switch (event.type) {
+        case InboundEventType::MESSAGE: {
+            const Message& msg = *event.message;
+            uint64_t dispatchedNs = OutputSink::wallClockNs();
+            profile.record(LatencyStage::QUEUE, dispatchedNs - min(dispatchedNs, event.publishedNs));
+            MessageInfo info{event.kernelNs, event.receivedNs, event.messageId, 0};
+            if (msg.getType() == MessageType::REPLY) {
+                // A REPLY nothing waits for (unknown reference, past its deadline) is passed on but changes nothing
+                auto request = issued.find(event.requestTag);
+                if (request != issued.end()) {
+                    info.request = request->first;
+                    // Only a successful reply to an AUTH authenticates
+                    if (request->second == MessageType::AUTH && static_cast<const ReplyMessage&>(msg).isSuccess()) {
+                        authenticated = true;
+                    }
+                    issued.erase(request);
+                }
+            }
+            if (callbacks.onMessage) {
+                callbacks.onMessage(msg, info);
+            }
+            if (msg.getType() == MessageType::ERR || msg.getType() == MessageType::BYE) {
+                close();
+            }
+            break;
+        }
+        case InboundEventType::PARSE_ERROR:
+            printf_debug("ChatSession: Error processing message: %s", event.error.c_str());
+            if (callbacks.onError) {
+                callbacks.onError("ERROR: Invalid message.");
+            }
+            abort("Invalid message");
+            break;
+        case InboundEventType::DROPPED:
+            if (callbacks.onDropped) {
+                callbacks.onDropped(event.dropped);
+            }
+            break;
+        case InboundEventType::FAILED:
+            printf_debug("ChatSession: Network thread fatal error: %s", event.error.c_str());
+            open = false;
+            if (callbacks.onError) {
+                callbacks.onError(event.error);
+            }
+            break;
+        case InboundEventType::LOG:
+            if (callbacks.onLog) {
+                callbacks.onLog(event.error);
+            }
+            break;
+        case InboundEventType::REPLY_TIMEOUT:
+            issued.erase(event.requestTag);
+            if (callbacks.onRequestTimeout) {
+                callbacks.onRequestTimeout(event.requestTag);
+            }
+            // A server that stops answering is a protocol error like a malformed message
+            abort("No REPLY in time");
+            break;
+    }
+}
+
+// --- Network thread ---
+// Sole owner of the client: sends queued commands, receives and publishes events, never calls back.
+// Works on the concrete transport, so the per-message calls are direct.
+
+template <SessionTransport Transport>
+void ChatSession::networkLoop(Transport& transport) {
+    tuneNetworkThread(transport.socketFd());
+    // UDP over a real socket: its resizes are reported as they happen
+    const ReceiveBufferStats* receiveBuffer = transport.receiveBuffer();
+    ReceiveBufferStats reported;
+    try {
+        while (drainOutbound(transport) && transport.isOpen()) {
+            expireTimers();
+            bool backlogged = !flushBacklog();
+            if (transport.hasBufferedMessage()) {
+                receiveAvailable(transport);
+                continue;
+            }
+            pollfd fds[2] = {{transport.socketFd(), POLLIN, 0}, {outboundReady.fd(), POLLIN, 0}};
+            bool spun = false;
+            if (NetworkTuning::spinThenPoll(fds, 2, pollTimeout(backlogged), config.busyPollUs, spun) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("ERROR: poll failed");
+            }
+            // The wake-up ends here, the receive and parse below are not part of it
+            uint64_t wokeNs = lowLatency() ? OutputSink::wallClockNs() : 0;
+            if (fds[1].revents & POLLIN) {
+                outboundReady.clear();
+            }
+            if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+                receiveAvailable(transport);
+                if (receiveBuffer) {
+                    reportReceiveBuffer(*receiveBuffer, reported);
+                }
+                if (lowLatency()) {
+                    (spun ? wakeupStats.spinWakeups : wakeupStats.sleepWakeups)++;
+                    // Only data read by this wakeup counts, a message buffered earlier has an older read time
+                    const ReceiveTimes& times = transport.lastReceive();
+                    if (times.kernelNs != 0 && times.userNs >= wokeNs && wokeNs >= times.kernelNs) {
+                        wakeupStats.add(static_cast<int64_t>(wokeNs - times.kernelNs));
+                    }
+                }
+            }
+        }
+    } catch (const exception& e) {
+        printf_debug("ChatSession: Network thread fatal error: %s", e.what());
+        InboundEvent event;
+        event.type = InboundEventType::FAILED;
+        event.error = e.what();
+        publish(move(event));
+    }
+
+    transport.stop();
+    flushBacklog();
+    networkFinished.store(true, std::memory_order_release);
+    inboundReady.notify();
+}
+
+template <SessionTransport Transport>
+bool ChatSession::drainOutbound(Transport& transport) {
+    uint64_t now = SendPacer::now();
+    OutboundCommand command;
+    TrafficClass cls;
+    // Control traffic bypasses the pacer, bulk waits in its queue until a token is available and no MSG is parked
+    auto admit = [&](TrafficClass candidate) {
+        if (candidate != TrafficClass::BULK) {
+            return true;
+        }
+        if constexpr (is_same_v<Transport, UDPClient>) {
+            if (transport.hasParked()) {
+                return false;
+            }
+        }
+        return pacer.tryAcquire(now);
+    };
+    // The current queue delay follows the head of the bulk queue, also while a UDP send waits for its CONFIRM
+    auto trackHead = [&]() {
+        const OutboundCommand* head = outbound.front(TrafficClass::BULK);
+        pacer.queueHead(head ? head->enqueuedNs : 0);
+    };
+    trackHead();
+    while (true) {
+        if constexpr (is_same_v<Transport, UDPClient>) {
+            // A MSG parked for control traffic continues once that went out
+            if (transport.hasParked() && !outbound.hasPending(TrafficClass::CONTROL)) {
+                transport.resumeParked();
+                now = SendPacer::now();
+            }
+        }
+        if (!outbound.tryPop(command, cls, admit)) {
+            break;
+        }
+        if (cls == TrafficClass::BULK) {
+            trackHead();
+        }
+        if (command.message) {
+            MessageType type = command.message->getType();
+            transport.sendMessage(move(command.message));
+            now = SendPacer::now();
+            if (command.requestTag) {
+                // The deadline runs from the send, not from the moment the request was queued
+                uint64_t sentNs = TimerWheel::now();
+                TimerWheel::Handle deadline = timers.schedule(sentNs + REPLY_TIMEOUT_NS, command.requestTag);
+                requests.sent(command.requestTag, type, transport.lastMessageId(), deadline, sentNs);
+            }
+            outboundDelay[static_cast<size_t>(cls)].add(now - command.enqueuedNs);
+            if (cls == TrafficClass::BULK) {
+                pacer.sent(now - command.enqueuedNs, transport.retransmits());
+            }
+        }
+        if (command.close) {
+            pacer.queueHead(0);
+            return false;
+        }
+    }
+    trackHead();
+    return true;
+}
+
+int ChatSession::pollTimeout(bool backlogged) {
+    // While events are backlogged retry them shortly even if nothing else happens
+    int timeoutMs = backlogged ? 10 : -1;
+    if (outbound.hasPending(TrafficClass::BULK)) {
+        // Wake up when the pacer has the next token
+        int tokenMs = static_cast<int>((pacer.waitNs(SendPacer::now()) + 999999) / 1000000);
+        timeoutMs = timeoutMs < 0 ? tokenMs : min(timeoutMs, tokenMs);
+    }
+    int timerMs = timers.timeoutMs(TimerWheel::now());
+    if (timerMs >= 0) {
+        timeoutMs = timeoutMs < 0 ? timerMs : min(timeoutMs, timerMs);
+    }
+    return timeoutMs;
+}
+
+void ChatSession::expireTimers() {
+    timers.advance(TimerWheel::now(), [this](uint64_t tag) {
+        PendingRequest request;
+        if (!requests.expire(static_cast<uint32_t>(tag), request)) {
+            return;
+        }
+        printf_debug("ChatSession: Request %u timed out", request.tag);
+        InboundEvent event;
+        event.type = InboundEventType::REPLY_TIMEOUT;
+        event.requestTag = request.tag;
+        publish(move(event));
+    });
+}
+
+template <SessionTransport Transport>
+void ChatSession::receiveAvailable(Transport& transport) {
+    InboundEvent event;
+    MessageView view;
+    try {
+        if (!transport.receiveView(view)) {
+            return;
+        }
+    } catch (const logic_error& e) {
+        // invalid_argument/out_of_range come from the parsers, transport failures are runtime_errors
+        event.type = InboundEventType::PARSE_ERROR;
+        event.error = e.what();
+        publish(move(event));
+        return;
+    }
+    if (view.getType() == MessageType::PING || view.getType() == MessageType::CONFIRM) {
+        return;
+    }
+    // Only messages that cross to the caller's thread are copied out of the receive buffer
+    event.message = view.materialize();
+    event.kernelNs = transport.lastReceive().kernelNs;
+    event.receivedNs = transport.lastReceive().userNs;
+    event.messageId = view.getMessageId();
+    if (view.getType() == MessageType::REPLY) {
+        const ReplyMessage& reply = static_cast<const ReplyMessage&>(*event.message);
+        PendingRequest request;
+        if (requests.matchReply(reply.getRefMsgId(), request)) {
+            timers.cancel(request.deadline);
+            event.requestTag = request.tag;
+            if (TRACE_ENABLED(reply_correlated)) {
+                TRACE_PROBE(reply_correlated, request.tag, reply.getRefMsgId(), TimerWheel::now() - request.sentNs, reply.isSuccess());
+            }
+        }
+    }
+    event.publishedNs = OutputSink::wallClockNs();
+    profile.record(LatencyStage::PARSE, event.publishedNs - min(event.publishedNs, event.receivedNs));
+    publish(move(event));
+}
+
+void ChatSession::log(string line) {
+    InboundEvent event;
+    event.type = InboundEventType::LOG;
+    event.error = move(line);
+    publish(move(event));
+}
+
+void ChatSession::tuneNetworkThread(int fd) {
+    string error;
+    if (config.cpuCore >= 0 && !NetworkTuning::pinCurrentThread(config.cpuCore, error)) {
+        log("Warning: " + error);
+    }
+    if (config.busyPollUs > 0 && !NetworkTuning::enableBusyPoll(fd, config.busyPollUs, error)) {
+        log("Warning: " + error);
+    }
+}
+
+void ChatSession::reportReceiveBuffer(const ReceiveBufferStats& stats, ReceiveBufferStats& reported) {
+    if (stats.resizes != reported.resizes) {
+        // Rare (a doubling each), worth seeing when tuning
+        log("UDP receive buffer grown to " + to_string(stats.bytes / 1024) + " KiB after " + to_string(stats.drops) + " kernel drops");
+    }
+    if (stats.limited && !reported.limited) {
+        log("Warning: UDP receive buffer stuck at " + to_string(stats.bytes / 1024) + " KiB, raise net.core.rmem_max");
+    }
+    reported = stats;
+}
+
+void ChatSession::publish(InboundEvent&& event) {
+    bool bulk = event.type == InboundEventType::MESSAGE && event.message->getType() == MessageType::MSG;
+    if (bulk) {
+        // Drop chat traffic rather than stall, the count is reported once the consumer catches up
+        if (!flushBacklog() || inbound.size() + INBOUND_CONTROL_RESERVE >= INBOUND_CAPACITY || !inbound.tryPush(move(event))) {
+            droppedMessages++;
+            return;
+        }
+    } else if (!flushBacklog() || !inbound.tryPush(move(event))) {
+        // Never dropped: a lost REPLY, ERR or BYE would leave the session in the wrong state
+        inboundBacklog.push_back(move(event));
+        return;
+    }
+    inboundReady.notify();
+}
+
+bool ChatSession::flushBacklog() {
+    bool pushed = false;
+    while (!inboundBacklog.empty() && inbound.tryPush(move(inboundBacklog.front()))) {
+        inboundBacklog.pop_front();
+        pushed = true;
+    }
+    if (inboundBacklog.empty() && droppedMessages > 0) {
+        InboundEvent notice;
+        notice.type = InboundEventType::DROPPED;
+        notice.dropped = droppedMessages;
+        if (inbound.tryPush(move(notice))) {
+            droppedMessages = 0;
+            pushed = true;
+        }
+    }
+    if (pushed) {
+        inboundReady.notify();
+    }
+    return inboundBacklog.empty() && droppedMessages == 0;
+}
@@ -0,0 +1,89 @@
+#include "../inc/DatagramTransport.h"
+
+SocketTransport::SocketTransport(int receiveBufferCeiling) {
+    socketFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socketFd < 0) {
+        throw runtime_error("ERROR: Unable to create UDP socket");
+    }
+    NetworkTuning::enableRxTimestamps(socketFd);
+    NetworkTuning::enableDropCounter(socketFd);
+    bufferStats.initialBytes = bufferStats.bytes = NetworkTuning::receiveBufferSize(socketFd);
+    bufferStats.ceilingBytes = max(receiveBufferCeiling, bufferStats.bytes);
+}
+
+SocketTransport::~SocketTransport() {
+    close();
+}
+
+void SocketTransport::close() {
+    if (socketFd >= 0) {
+        ::close(socketFd);
+        socketFd = -1;
+    }
+}
+
+ssize_t SocketTransport::sendTo(const uint8_t* data, size_t length, const sockaddr_in& to) {
+    // Connected: the route is cached in the socket, no per-datagram lookup
+    if (connected) {
+        return send(socketFd, data, length, 0);
+    }
+    return sendto(socketFd, data, length, 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+}
+
+bool SocketTransport::connect(const sockaddr_in& peer) {
+    if (::connect(socketFd, reinterpret_cast<const sockaddr*>(&peer), sizeof(peer)) < 0) {
+        printf_debug("SocketTransport: Could not connect UDP socket: %s", strerror(errno));
+        return false;
+    }
+    connected = true;
+    connectedPeer = peer;
+    return true;
+}
+
+bool SocketTransport::wait(int timeoutMs) {
+    pollfd pfd{socketFd, POLLIN, 0};
+    return poll(&pfd, 1, timeoutMs) > 0;
+}
+
+ssize_t SocketTransport::receiveFrom(uint8_t* buffer, size_t length, sockaddr_in& from, uint64_t& kernelNs) {
+    uint32_t counter = dropCounter;
+    ssize_t n;
+    // Connected: the kernel only queues datagrams from the peer
+    if (connected) {
+        from = connectedPeer;
+        n = NetworkTuning::receiveTimestamped(socketFd, buffer, length, MSG_DONTWAIT, nullptr, nullptr, kernelNs, &counter);
+    } else {
+        socklen_t fromLength = sizeof(from);
+        n = NetworkTuning::receiveTimestamped(socketFd, buffer, length, MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&from),
+                                              &fromLength, kernelNs, &counter);
+    }
+    if (counter != dropCounter) {
+        dropped(counter - dropCounter);
+        dropCounter = counter;
+    }
+    return n;
+}
+
+void SocketTransport::dropped(uint32_t count) {
+    bufferStats.drops += count;
+    if (bufferStats.bytes >= bufferStats.ceilingBytes) {
+        return;
+    }
+    int bytes = NetworkTuning::setReceiveBufferSize(socketFd, min(bufferStats.ceilingBytes, bufferStats.bytes * 2));
+    if (bytes <= bufferStats.bytes) {
+        // The kernel refuses more (net.core.rmem_max without CAP_NET_ADMIN), stop asking
+        bufferStats.ceilingBytes = bufferStats.bytes;
+        bufferStats.limited = true;
+        return;
+    }
+    bufferStats.bytes = bytes;
+    bufferStats.resizes++;
+}
+
+uint64_t SocketTransport::monotonicNs() const {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t SocketTransport::wallClockNs() const {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count());
+}
@@ -0,0 +1,121 @@
+#include "../inc/FileChunker.h"
+#include <cstring>
+
+FileChunker::FileChunker(const string& path) : path(path) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw runtime_error("ERROR: Unable to open file " + path);
+    }
+    struct stat info{};
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        throw runtime_error("ERROR: Not a regular file: " + path);
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length == 0) {
+        close(fd);
+        throw runtime_error("ERROR: File is empty: " + path);
+    }
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw runtime_error("ERROR: Unable to map file " + path);
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(mapping);
+    printf_debug("FileChunker: Mapped %s (%zu bytes)", path.c_str(), length);
+}
+
+FileChunker::~FileChunker() {
+    if (data) {
+        munmap(const_cast<char*>(data), length);
+        close(fd);
+    }
+}
+
+void FileChunker::checkSize() const {
+    // Pages past the new end of a truncated file raise SIGBUS when read, stop before touching them
+    struct stat info{};
+    if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < length) {
+        throw runtime_error("ERROR: File " + path + " was truncated while sending.");
+    }
+}
+
+void FileChunker::validate() {
+    checkSize();
+    for (size_t i = 0; i < length; ++i) {
+        char c = data[i];
+        if (ContentField::validChar(c)) {
+            continue;
+        }
+        if (c == '\r' && i + 1 < length && data[i + 1] == '\n') {
+            hasCarriageReturns = true;
+            continue;
+        }
+        throw invalid_argument("File contains a character that cannot be sent at byte " + to_string(i) + ".");
+    }
+}
+
+bool FileChunker::next(string_view& chunk) {
+    while (offset < length) {
+        checkSize();
+        if (hasCarriageReturns) {
+            chunk = nextNormalized();
+        } else {
+            size_t end = length;
+            size_t resume = length;
+            if (length - offset > CONTENT_MAX_LENGTH) {
+                // Prefer the last line break inside the limit or right after it, otherwise cut the line
+                const char* limit = data + offset + CONTENT_MAX_LENGTH;
+                const void* lineEnd = memrchr(data + offset, '\n', CONTENT_MAX_LENGTH + 1);
+                end = lineEnd ? static_cast<const char*>(lineEnd) - data : limit - data;
+                resume = lineEnd ? end + 1 : end;
+            } else if (data[length - 1] == '\n') {
+                end = length - 1;
+            }
+            chunk = string_view(data + offset, end - offset);
+            offset = resume;
+        }
+        // An empty line at the cut carries nothing the protocol could send
+        if (!chunk.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+string_view FileChunker::nextNormalized() {
+    // Copy with the CRs dropped until the limit is full, so the cut is made on what is sent, not on the file
+    scratch.clear();
+    size_t i = offset;
+    size_t lineEnd = string::npos;      // Length of the chunk up to its last line break
+    size_t lineResume = 0;
+    while (i < length && scratch.size() < CONTENT_MAX_LENGTH) {
+        char c = data[i++];
+        if (c == '\r') {
+            continue;
+        }
+        if (c == '\n') {
+            lineEnd = scratch.size();
+            lineResume = i;
+        }
+        scratch.push_back(c);
+    }
+    // validate() let through no CR without an LF after it
+    size_t after = i < length && data[i] == '\r' ? i + 1 : i;
+    if (after == length) {
+        if (!scratch.empty() && scratch.back() == '\n') {
+            scratch.pop_back();
+        }
+        offset = length;
+    } else if (data[after] == '\n') {
+        // The line ends right at the limit
+        offset = after + 1;
+    } else if (lineEnd != string::npos) {
+        scratch.resize(lineEnd);
+        offset = lineResume;
+    } else {
+        offset = i;
+    }
+    return scratch;
+}
@@ -1,226 +1,545 @@
 #include "../inc/InputHandler.h"
+#include "../inc/Tracepoints.h"
 
-InputHandler::InputHandler(ParsedArgs args):
-    arguments(args) {
+InputHandler::InputHandler(ParsedArgs args): arguments(args), sink(args.outputFormat, isatty(STDOUT_FILENO)) {
     printf_debug("Input: Constructing...");
-    if (args.proto == ProtocolType::TCP) {
-        printf_debug("Input: Creating TCPClient and thread");
-        tcpClient = make_unique<TCPClient>(args);
-    } else {
-        printf_debug("Input: Creating UDPClient and thread");
-        udpClient = make_unique<UDPClient>(args);
+    if (!args.filterRules.empty()) {
+        // Before connecting, a broken rules file throws to main like a failed connection
+        filter = make_unique<KeywordFilter>(args.filterRules, cerr, "stderr");
     }
-
-    thread receiveThread([this]() {
-        try {
-            while (running.load(std::memory_order_acquire)) {
-                processIncomingMessage();
-            }
-        } catch (const exception& e) {
-            printf_debug("InputHandler: Receiver thread fatal error: %s", e.what());
-        }
-
-        if (this->arguments.proto == ProtocolType::TCP) {
-            tcpClient->stop();
-        } else {
-            udpClient->stop();
-        }
-    });
-    this->receiveThread = move(receiveThread);
+    SessionCallbacks callbacks;
+    callbacks.onMessage = [this](const Message& msg, const MessageInfo& info) { onMessage(msg, info); };
+    callbacks.onRequestTimeout = [this](uint32_t request) { onRequestTimeout(request); };
+    callbacks.onDropped = [this](uint32_t count) {
+        print("ERROR: Receiver fell behind, " + to_string(count) + " messages dropped.");
+    };
+    callbacks.onError = [this](const string& error) { print(error); };
+    // Diagnostics stay out of the chat output
+    callbacks.onLog = [](const string& line) { cerr << line << "\n" << flush; };
+    session = make_unique<ChatSession>(args.session, move(callbacks));
 }
 
 InputHandler::~InputHandler() {
     printf_debug("Input: Destructing...");
-    if (receiveThread.joinable()) {
-        receiveThread.join();
+    session->close();
+    if (lowLatency()) {
+        session->wakeups().print(cerr);
+    }
+    // Kernel drops are worth a line even without -S
+    const ReceiveBufferStats* receiveBuffer = session->receiveBuffer();
+    if (receiveBuffer && (receiveBuffer->drops > 0 || arguments.printStats)) {
+        receiveBuffer->print(cerr);
+    }
+    if (session->sendPacer().enabled()) {
+        session->sendPacer().stats().print(cerr, session->sendPacer().currentRate());
+    }
+    if (arguments.printStats && arguments.pasteWindowMs >= 0) {
+        reportPaste(cerr);
+    }
+    if (arguments.printStats) {
+        cerr << "Outbound traffic (" << (arguments.session.controlWeight > 0 ? "weighted" : "strict") << " priority):\n";
+        // CONFIRMs never pass through the scheduler, the transport sends them itself
+        session->confirmLatency().print(cerr, "confirm");
+        for (TrafficClass cls : {TrafficClass::CONTROL, TrafficClass::BULK}) {
+            session->outboundLatency(cls).print(cerr, trafficClassName(cls));
+        }
+        session->latencyProfile().print(cerr);
     }
 }
 
 void InputHandler::run() {
-    string input;
-    while (running.load(std::memory_order_acquire)) {
-        // wait for stdin with timeout to allow exit without blocking
+    bool inputClosed = false;
+    while (session->isOpen()) {
+        session->poll();
+        // Machine-readable records are flushed once per batch
+        out().flush();
+        outputFlushed();
+        checkStatsRequest();
+        if (transfer) {
+            pumpTransfer();
+        }
+        drainInput();
+        if (inputClosed && !transfer && pendingInput.empty()) {
+            // A file was still being sent when stdin ended
+            endPaste(true);
+            stop(true);
+            break;
+        }
+        if (interrupted.load(std::memory_order_acquire)) {
+            // Lines of a paste still waiting for the quiet interval were typed before the interrupt
+            endPaste(true);
+            stop();
+            print("\nProgram interrupted. Closing...");
+            break;
+        }
+        if (!session->isOpen()) {
+            break;
+        }
+
+        // wait for stdin or session events; interrupts, stats requests and the session's end all signal eventFd()
         fd_set readfds;
         FD_ZERO(&readfds);
-        FD_SET(STDIN_FILENO, &readfds);
-        struct timeval tv = {0, 100000}; // 100 ms timeout
-        int ret = select(STDIN_FILENO + 1, &readfds, nullptr, nullptr, &tv);
+        // Lines still waiting for the queue hold back further input, the writer blocks instead of messages being dropped
+        if (!inputClosed && pendingInput.empty()) {
+            FD_SET(STDIN_FILENO, &readfds);
+        }
+        FD_SET(session->eventFd(), &readfds);
+        // While a file is being sent come back soon to refill the outbound queue, a paste ends after its quiet interval
+        long waitUs = transfer || !pendingInput.empty() ? 5000 : -1;
+        if (paste.active) {
+            auto quiet = chrono::duration_cast<chrono::microseconds>(paste.quietUntil - chrono::steady_clock::now()).count();
+            waitUs = waitUs < 0 ? max(quiet, 0L) : min(waitUs, max(quiet, 0L));
+        }
+        struct timeval tv = {waitUs / 1000000, waitUs % 1000000};
+        int ret = select(max(STDIN_FILENO, session->eventFd()) + 1, &readfds, nullptr, nullptr, waitUs >= 0 ? &tv : nullptr);
         if (ret > 0 && FD_ISSET(STDIN_FILENO, &readfds)) {
-            if (!std::getline(std::cin, input)) {
-                if (authenticated.load(std::memory_order_acquire)) {
-                    stop();
-                }
-                break;
-            }
-        } else {
+            // Every complete line of the read is taken now, none stays hidden in a buffer select() can't see
+            inputClosed = !readInput();
+            drainInput();
+        }
+        endPaste(false);
+    }
+}
+
+bool InputHandler::readInput() {
+    char buffer[65536];
+    ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (n < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    stdinBuffer.append(buffer, static_cast<size_t>(n));
+    size_t start = 0, end;
+    while ((end = stdinBuffer.find('\n', start)) != string::npos) {
+        size_t length = end - start;
+        if (length > 0 && stdinBuffer[end - 1] == '\r') {
+            length--;
+        }
+        pendingInput.emplace_back(stdinBuffer, start, length);
+        start = end + 1;
+    }
+    stdinBuffer.erase(0, start);
+    if (n == 0 && !stdinBuffer.empty()) {
+        // Last line without a line break
+        pendingInput.push_back(move(stdinBuffer));
+        stdinBuffer.clear();
+    }
+    return n > 0;
+}
+
+void InputHandler::drainInput() {
+    while (!pendingInput.empty() && session->isOpen() && session->queuedMessages() < INPUT_WINDOW) {
+        inputLine(pendingInput.front());
+        pendingInput.pop_front();
+    }
+}
+
+void InputHandler::inputLine(const string& line) {
+    // Commands keep their place between the chat lines around them, a line the protocol rejects gets its own error
+    if (arguments.pasteWindowMs < 0 || (!line.empty() && line[0] == '/') || !session->isAuthenticated()
+        || !all_of(line.begin(), line.end(), ContentField::validChar)) {
+        endPaste(true);
+        processLine(line);
+        return;
+    }
+    if (line.empty() && paste.content.empty()) {
+        return;
+    }
+    if (!paste.content.empty() && paste.content.size() + 1 + line.size() > CONTENT_MAX_LENGTH) {
+        sendPaste();
+    }
+    if (!paste.content.empty()) {
+        paste.content += '\n';
+    }
+    paste.content += line;
+    paste.lines++;
+    paste.active = true;
+    paste.quietUntil = chrono::steady_clock::now() + chrono::milliseconds(arguments.pasteWindowMs);
+}
+
+void InputHandler::sendPaste() {
+    // Blank lines at the end of a paste would only pad the message
+    while (!paste.content.empty() && paste.content.back() == '\n') {
+        paste.content.pop_back();
+    }
+    if (!paste.content.empty()) {
+        paste.frames++;
+        processLine(paste.content);
+    }
+    paste.content.clear();
+}
+
+void InputHandler::endPaste(bool force) {
+    if (!paste.active || (!force && chrono::steady_clock::now() < paste.quietUntil)) {
+        return;
+    }
+    sendPaste();
+    paste.active = false;
+    paste.bursts++;
+}
+
+void InputHandler::reportPaste(ostream& out) const {
+    out << "Paste coalescing: " << paste.lines << " lines in " << paste.bursts << " bursts sent as " << paste.frames
+        << " messages (" << double(paste.lines) / max<uint64_t>(paste.frames, 1) << " lines per message, "
+        << double(paste.frames) / max<uint64_t>(paste.bursts, 1) << " messages per burst)\n";
+}
+
+void InputHandler::reportQueue(ostream& out) const {
+    out << "Outbound queue: " << session->queuedMessages() << " messages waiting, oldest for "
+        << session->queueDelayNs() / 1e6 << " ms\n";
+}
+
+void InputHandler::serve() {
+    Multiplexer mux(arguments.daemonSocket);
+    ostringstream captured;
+    output = &captured;
+    // Subscribers may be anything but a terminal
+    sink.setColour(false);
+    subscribers = &mux;
+    // Output of inbound traffic goes to every subscriber, replies to a line only to its sender
+    auto deliver = [&](uint64_t subscriber) {
+        string text = captured.str();
+        if (!text.empty()) {
+            subscriber == 0 ? mux.broadcast(text) : mux.sendTo(subscriber, text);
+            captured.str({});
+        }
+        outputFlushed();
+    };
+    vector<pollfd> fds;
+    vector<pair<uint64_t, string>> lines;
+    // A half-closed subscriber stays until nothing it issued is waiting for a REPLY
+    auto pending = [&](uint64_t subscriber) {
+        return any_of(issued.begin(), issued.end(), [&](const auto& request) { return request.second.subscriber == subscriber; });
+    };
+    while (session->isOpen()) {
+        session->poll();
+        checkStatsRequest();
+        if (transfer) {
+            pumpTransfer();
+        }
+        deliver(0);
+        mux.closeFinished(pending);
+        if (interrupted.load(std::memory_order_acquire)) {
+            stop();
+            break;
+        }
+        if (!session->isOpen()) {
+            break;
+        }
+
+        fds.clear();
+        fds.push_back({session->eventFd(), POLLIN, 0});
+        mux.addPollFds(fds);
+        if (poll(fds.data(), fds.size(), transfer ? 5 : -1) <= 0) {
             continue;
         }
+        mux.process(fds, lines);
+        for (auto& [subscriber, line] : lines) {
+            lineOrigin = subscriber;
+            processLine(line);
+            lineOrigin = 0;
+            deliver(subscriber);
+        }
+        lines.clear();
+    }
+    deliver(0);
+    output = &cout;
+    subscribers = nullptr;
+}
 
-        if (running) {
-            if (input.empty()) {
-                printf_debug("Input: User input was empty, skipping");
-                continue;
-            }
+void InputHandler::processLine(const string& input) {
+    if (input.empty()) {
+        printf_debug("Input: User input was empty, skipping");
+        return;
+    }
 
-            if (input[0] == '/') {
-                handleCommand(input);
+    try {
+        if (input[0] == '/') {
+            handleCommand(input);
+        } else {
+            if (!session->isAuthenticated()) {
+                print("ERROR: Not authenticated.");
             } else {
-                if (!authenticated.load(std::memory_order_acquire)) {
-                    cout << "ERROR: Not authenticated.\n" << flush;
-                } else {
-                    printf_debug("Input: No / detected, processing as message");
-                    handleMessage(input);
-                }
+                printf_debug("Input: No / detected, processing as message");
+                handleMessage(input);
             }
         }
+    } catch (const invalid_argument& e) {
+        print(string("ERROR: ") + e.what());
+    }
+}
+
+// Splits off the next whitespace separated token, the views point into the input line
+static string_view nextToken(string_view& rest) {
+    size_t start = rest.find_first_not_of(" \t");
+    if (start == string_view::npos) {
+        rest = {};
+        return {};
     }
+    rest.remove_prefix(start);
+    string_view token = rest.substr(0, rest.find_first_of(" \t"));
+    rest.remove_prefix(token.size());
+    return token;
 }
 
 void InputHandler::handleCommand(const string& command) {
-    istringstream iss(command);
-    string cmd;
-    iss >> cmd;
+    string_view rest = command;
+    string_view cmd = nextToken(rest);
 
     if (cmd == "/help") {
         printf_debug("Input: /help command received");
         printHelp();
-    } else if (!authenticated.load(std::memory_order_acquire)) {
+    } else if (cmd == "/stats") {
+        ostringstream report;
+        reportQueue(report);
+        session->latencyProfile().print(report);
+        string text = report.str();
+        print(string_view(text).substr(0, text.size() - 1));
+    } else if (cmd == "/filter") {
+        filterCommand(rest);
+    } else if (!session->isAuthenticated()) {
         if (cmd == "/auth") {
-            string username, secret, displayName;
-            iss >> username >> secret >> displayName;
-            printf_debug("Input: /auth command received with parameters: u=%s s=%s d=%s", username.c_str(), secret.c_str(), displayName.c_str());
+            string_view username = nextToken(rest);
+            string_view secret = nextToken(rest);
+            string_view displayName = nextToken(rest);
+            printf_debug("Input: /auth command received with parameters: u=%.*s s=%.*s d=%.*s", (int)username.size(), username.data(),
+                         (int)secret.size(), secret.data(), (int)displayName.size(), displayName.data());
             if (username.empty() || secret.empty() || displayName.empty()) {
-                cout << "ERROR: Invalid /auth parameters.\n" << flush;
+                print("ERROR: Invalid /auth parameters.");
             } else {
-                this->displayName = displayName;
-                vector<string> params;
-                params.push_back(username);
-                params.push_back(this->displayName);
-                params.push_back(secret);
-                if (arguments.proto == ProtocolType::TCP) {
-                    tcpClient->sendMessage(MessageFactory::createMessage(MessageType::AUTH, params));
-                } else {
-                    udpClient->sendMessage(MessageFactory::createMessage(MessageType::AUTH, params));
-                }
+                issue(session->auth(username, secret, displayName), "AUTH " + string(username));
             }
         } else {
-            cout << "ERROR: You need to authenticate first...\n" << flush;
+            print("ERROR: You need to authenticate first...");
         }
     } else {
         if (cmd == "/join") {
-            string channel;
-            iss >> channel;
-            printf_debug("Input: /join command received with parameters: c=%s", channel.c_str());
+            string_view channel = nextToken(rest);
+            printf_debug("Input: /join command received with parameters: c=%.*s", (int)channel.size(), channel.data());
             if (channel.empty()) {
-                cout << "ERROR: Invalid /join parameters.\n" << flush;
+                print("ERROR: Invalid /join parameters.");
             } else {
-                vector<string> params;
-                params.push_back(channel);
-                params.push_back(this->displayName);
-                if (arguments.proto == ProtocolType::TCP) {
-                    tcpClient->sendMessage(MessageFactory::createMessage(MessageType::JOIN, params));
-                } else {
-                    udpClient->sendMessage(MessageFactory::createMessage(MessageType::JOIN, params));
-                }
+                issue(session->join(channel), "JOIN " + string(channel));
+            }
+        } else if (cmd == "/sendfile") {
+            // The path is the rest of the line, so it may contain spaces
+            size_t start = rest.find_first_not_of(" \t");
+            string_view path = start == string_view::npos ? string_view() : rest.substr(start);
+            printf_debug("Input: /sendfile command received with parameters: f=%.*s", (int)path.size(), path.data());
+            if (path.empty()) {
+                print("ERROR: Invalid /sendfile parameters.");
+            } else if (transfer) {
+                print("ERROR: A file is already being sent.");
+            } else {
+                startTransfer(string(path));
             }
         } else if (cmd == "/rename") {
-            string displayName;
-            iss >> displayName;
-            printf_debug("Input: /rename command received with parameters: d=%s", displayName.c_str());
+            string_view displayName = nextToken(rest);
+            printf_debug("Input: /rename command received with parameters: d=%.*s", (int)displayName.size(), displayName.data());
             if (displayName.empty()) {
-                cout << "ERROR: Invalid /rename parameters.\n" << flush;
+                print("ERROR: Invalid /rename parameters.");
             } else {
-                this->displayName = displayName;
+                session->rename(displayName);
             }
         } else {
             if (cmd == "/auth") {
-                cout << "ERROR: You are already authenticated...\n" << flush;
+                print("ERROR: You are already authenticated...");
             } else {
-                cout << "ERROR: Unknown command '" << cmd << "', use /help for available commands.\n" << flush;
+                print("ERROR: Unknown command '" + string(cmd) + "', use /help for available commands.");
             }
         }
     }
 }
 
 void InputHandler::handleMessage(const string& message) {
-    vector<string> params;
-    params.push_back(this->displayName);
-    params.push_back(message);
-    if (this->arguments.proto == ProtocolType::TCP) {
-        tcpClient->sendMessage(MessageFactory::createMessage(MessageType::MSG, params));
-    } else {
-        udpClient->sendMessage(MessageFactory::createMessage(MessageType::MSG, params));
+    if (!session->send(message)) {
+        print("ERROR: Outbound queue full, message dropped.");
     }
 }
 
-void InputHandler::processIncomingMessage() {
+void InputHandler::startTransfer(const string& path) {
     try {
-        unique_ptr<Message> msg = arguments.proto == ProtocolType::TCP ? tcpClient->receiveMessage() : udpClient->receiveMessage();
-
-        if (!msg) {
-            // No message (connection closed), stop processing
-            return;
-        }
+        auto pending = make_unique<FileTransfer>(path);
+        // Reject the file before anything is sent
+        pending->chunker.validate();
+        pending->started = pending->lastReport = chrono::steady_clock::now();
+        transfer = move(pending);
+    } catch (const runtime_error& e) {
+        print(e.what());
+        return;
+    }
+    pumpTransfer();
+}
 
-        switch (msg->getType()) {
-            case MessageType::REPLY: {
-                // Only set authenticated on a successful reply
-                if (!authenticated.load(std::memory_order_acquire)) {
-                    auto replyMsg = dynamic_cast<ReplyMessage*>(msg.get());
-                    if (replyMsg && replyMsg->isSuccess()) {
-                        authenticated.store(true, std::memory_order_release);
-                    }
+void InputHandler::pumpTransfer() {
+    string_view chunk;
+    while (session->queuedMessages() < FILE_WINDOW) {
+        if (!transfer->chunkWaiting) {
+            try {
+                if (!transfer->chunker.next(chunk)) {
+                    break;
                 }
-                break;
-            }
-            case MessageType::ERR:
-            case MessageType::BYE:
-                stop();
-                break;
-            default:
-                break;
-        }
-    } catch (const exception& e) {
-        if (running.load(std::memory_order_acquire)) {
-            printf_debug("InputHandler: Error processing message: %s", e.what());
-            cout << "ERROR: Invalid message.\n" << flush;
-
-            vector<string> params;
-            params.push_back(this->displayName);
-            params.push_back("Invalid message");
-            if (arguments.proto == ProtocolType::TCP) {
-                tcpClient->sendMessage(MessageFactory::createMessage(MessageType::ERR, params));
-            } else {
-                udpClient->sendMessage(MessageFactory::createMessage(MessageType::ERR, params));
+            } catch (const runtime_error& e) {
+                // The chunks already queued still go out, nothing more is read from the file
+                print(e.what());
+                transfer.reset();
+                return;
             }
-            stop();
+            transfer->nextChunk.assign(chunk);
+            transfer->chunkWaiting = true;
+        }
+        if (!session->send(transfer->nextChunk)) {
+            break;
         }
+        transfer->chunkWaiting = false;
+        transfer->messages++;
+    }
+
+    bool queued = !transfer->chunkWaiting && transfer->chunker.consumed() == transfer->chunker.size();
+    if (queued && session->queuedMessages() == 0) {
+        reportTransfer(true);
+        transfer.reset();
+    } else if (chrono::steady_clock::now() - transfer->lastReport >= chrono::seconds(1)) {
+        reportTransfer(false);
     }
 }
 
-void InputHandler::stop() {
-    printf_debug("InputHandler: Stopping...");
-    running.store(false, std::memory_order_release);
-    vector<string> params;
-    params.push_back(this->displayName);
-    if (this->arguments.proto == ProtocolType::TCP) {
-        if (authenticated.load(std::memory_order_acquire)) {
-            tcpClient->sendMessage(MessageFactory::createMessage(MessageType::BYE, params));
-        }
-        tcpClient->stop();
+void InputHandler::reportTransfer(bool finished) {
+    auto now = chrono::steady_clock::now();
+    double seconds = max(chrono::duration<double>(now - transfer->started).count(), 1e-6);
+    // Counts what the network thread took over, chunks still in the window are not included
+    size_t queuedBytes = session->queuedMessages() * CONTENT_MAX_LENGTH;
+    size_t done = transfer->chunker.consumed() - min(transfer->chunker.consumed(), queuedBytes);
+    ostringstream report;
+    if (finished) {
+        report << "File " << transfer->path << " sent: " << transfer->messages << " messages, " << transfer->chunker.size() << " bytes in "
+             << seconds << " s (" << transfer->chunker.size() / seconds / 1e6 << " MB/s)";
     } else {
-        if (authenticated.load(std::memory_order_acquire)) {
-            udpClient->sendMessage(MessageFactory::createMessage(MessageType::BYE, params));
+        report << "Sending " << transfer->path << ": " << done * 100 / transfer->chunker.size() << "% (" << done << " of "
+             << transfer->chunker.size() << " bytes, " << done / seconds / 1e6 << " MB/s)";
+    }
+    print(report.str());
+    transfer->lastReport = now;
+}
+
+void InputHandler::issue(uint32_t request, string description) {
+    if (request == 0) {
+        print("ERROR: Outbound queue full, message dropped.");
+        return;
+    }
+    issued[request] = {move(description), lineOrigin};
+}
+
+void InputHandler::onMessage(const Message& msg, const MessageInfo& info) {
+    uint64_t dispatchedNs = OutputSink::wallClockNs();
+    uint8_t actions = 0;
+    if (filter) {
+        string error;
+        if (!filter->reloadIfChanged(false, error)) {
+            print(error);
         }
-        udpClient->stop();
+        actions = filter->apply(msg);
+        if (actions & FILTER_FORWARD) {
+            filter->forward(msg);
+        }
+    }
+    auto request = issued.find(info.request);
+    if (!(actions & FILTER_SUPPRESS)) {
+        if (unflushed++ == 0) {
+            unflushedSinceNs = info.receivedNs;
+        }
+        bool alert = actions & FILTER_HIGHLIGHT;
+        if (request == issued.end()) {
+            sink.message(out(), msg, info.kernelNs, info.receivedNs, info.messageId, alert);
+        } else if (subscribers && request->second.subscriber != 0) {
+            ostringstream routed;
+            sink.message(routed, msg, info.kernelNs, info.receivedNs, info.messageId, alert, request->second.description);
+            subscribers->sendTo(request->second.subscriber, routed.str());
+        } else {
+            sink.message(out(), msg, info.kernelNs, info.receivedNs, info.messageId, alert, request->second.description);
+        }
+    }
+    if (request != issued.end()) {
+        issued.erase(request);
+    }
+    session->latencyProfile().record(LatencyStage::RENDER, OutputSink::wallClockNs() - dispatchedNs);
+}
+
+void InputHandler::outputFlushed() {
+    if (unflushed == 0) {
+        return;
+    }
+    if (TRACE_ENABLED(output_flushed)) {
+        TRACE_PROBE(output_flushed, unflushed, OutputSink::wallClockNs() - unflushedSinceNs);
+    }
+    unflushed = 0;
+}
+
+void InputHandler::onRequestTimeout(uint32_t request) {
+    auto it = issued.find(request);
+    string description = it != issued.end() ? it->second.description : "request";
+    uint64_t subscriber = it != issued.end() ? it->second.subscriber : 0;
+    issued.erase(request);
+    string error = "ERROR: No REPLY to " + description + " within " + to_string(REPLY_TIMEOUT_NS / 1000000000) + " s.";
+    if (subscribers && subscriber != 0) {
+        ostringstream routed;
+        sink.notice(routed, error);
+        subscribers->sendTo(subscriber, routed.str());
+    } else {
+        print(error);
+    }
+}
+
+void InputHandler::stop(bool afterQueued) {
+    printf_debug("InputHandler: Stopping...");
+    session->close(afterQueued);
+}
+
+void InputHandler::requestStats() {
+    statsRequested.store(true, std::memory_order_release);
+    session->wake();
+}
+
+void InputHandler::checkStatsRequest() {
+    if (statsRequested.exchange(false, std::memory_order_acq_rel)) {
+        reportQueue(cerr);
+        session->latencyProfile().print(cerr);
     }
 }
 
+void InputHandler::filterCommand(string_view rest) {
+    if (!filter) {
+        print("ERROR: No keyword filter, start the client with -f <rules>.");
+        return;
+    }
+    string_view action = nextToken(rest);
+    if (action == "reload") {
+        string error;
+        if (!filter->reloadIfChanged(true, error)) {
+            print(error);
+            return;
+        }
+    } else if (!action.empty()) {
+        print("ERROR: Usage: /filter [reload]");
+        return;
+    }
+    ostringstream report;
+    filter->report(report);
+    string text = report.str();
+    print(string_view(text).substr(0, text.size() - 1));
+}
+
+void InputHandler::interrupt() {
+    interrupted.store(true, std::memory_order_release);
+    session->wake();
+}
+
 void InputHandler::printHelp() {
-    cout << "Available commands:\n"
-        << "/auth <username> <secret> <displayName> - Authenticate user\n"
-        << "/join <channelID> - Join a channel\n"
-        << "/rename <displayName> - Change display name\n"
-        << "/help - Show this help message\n"
-        << flush;
+    print("Available commands:\n"
+        "/auth <username> <secret> <displayName> - Authenticate user\n"
+        "/join <channelID> - Join a channel\n"
+        "/rename <displayName> - Change display name\n"
+        "/sendfile <path> - Send a text file as a series of messages\n"
+        "/stats - Show the outbound queue delay and per-stage latency histograms\n"
+        "/filter [reload] - Show keyword filter hits, or reload its rules now\n"
+        "/help - Show this help message");
 }
@@ -0,0 +1,400 @@
+#include "../inc/KeywordFilter.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KEYWORD_SHUFFLE_SKIP
+#include <tmmintrin.h>
+#endif
+
+static uint8_t fold(uint8_t c) {
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+AhoCorasick::AhoCorasick(const vector<string>& patterns) {
+    for (const string& pattern : patterns) {
+        for (char c : pattern) {
+            uint8_t folded = fold(static_cast<uint8_t>(c));
+            if (byteClass[folded] == 0) {
+                byteClass[folded] = static_cast<uint8_t>(classCount++);
+            }
+        }
+    }
+    for (int c = 'A'; c <= 'Z'; ++c) {
+        byteClass[c] = byteClass[c + 32];
+    }
+
+    // Trie in insertion order, edges collected as (parent, class, child)
+    struct Edge {
+        uint32_t parent;
+        uint8_t cls;
+        uint32_t child;
+    };
+    vector<Edge> edges;
+    unordered_map<uint64_t, uint32_t> children;
+    vector<pair<uint32_t, uint32_t>> ends;      // (state, pattern)
+    uint32_t states = 1;
+    for (uint32_t index = 0; index < patterns.size(); ++index) {
+        uint32_t state = 0;
+        for (char c : patterns[index]) {
+            uint8_t cls = byteClass[static_cast<uint8_t>(c)];
+            auto [it, inserted] = children.try_emplace((uint64_t(state) << 8) | cls, states);
+            if (inserted) {
+                edges.push_back({state, cls, states++});
+            }
+            state = it->second;
+        }
+        ends.push_back({state, index});
+    }
+    children = {};
+
+    auto byParent = [](const Edge& a, const Edge& b) {
+        return a.parent != b.parent ? a.parent < b.parent : a.cls < b.cls;
+    };
+    auto buildEdges = [&] {
+        sort(edges.begin(), edges.end(), byParent);
+        edgeStart.assign(states + 1, 0);
+        edgeClass.clear();
+        edgeTarget.clear();
+        for (const Edge& edge : edges) {
+            edgeStart[edge.parent + 1]++;
+            edgeClass.push_back(edge.cls);
+            edgeTarget.push_back(edge.child);
+        }
+        for (uint32_t s = 0; s < states; ++s) {
+            edgeStart[s + 1] += edgeStart[s];
+        }
+    };
+
+    // Renumber breadth first: a state's fail is then a smaller id, and the shallow states are the dense prefix
+    buildEdges();
+    vector<uint32_t> renamed(states, 0);
+    uint32_t nextId = 1;
+    vector<uint32_t> queue(1, 0);
+    queue.reserve(states);
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t state = queue[head];
+        for (uint32_t e = edgeStart[state]; e < edgeStart[state + 1]; ++e) {
+            renamed[edgeTarget[e]] = nextId++;
+            queue.push_back(edgeTarget[e]);
+        }
+    }
+    queue = {};
+    for (Edge& edge : edges) {
+        edge.parent = renamed[edge.parent];
+        edge.child = renamed[edge.child];
+    }
+    for (auto& end : ends) {
+        end.first = renamed[end.first];
+    }
+    renamed = {};
+    buildEdges();
+    edges = {};
+
+    sort(ends.begin(), ends.end());
+    outputStart.assign(states + 1, 0);
+    for (auto [state, index] : ends) {
+        outputStart[state + 1]++;
+        outputs.push_back(index);
+    }
+    for (uint32_t s = 0; s < states; ++s) {
+        outputStart[s + 1] += outputStart[s];
+    }
+
+    // Failure links and rows in id order; everything a state's links depend on has a smaller id
+    denseCount = min<uint32_t>(states, max<uint32_t>(1, DENSE_ENTRIES / classCount));
+    dense.assign(size_t(denseCount) * classCount, 0);
+    fail.assign(states, 0);
+    dictLink.assign(states, 0);
+    auto endsPattern = [&](uint32_t s) { return outputStart[s] != outputStart[s + 1]; };
+    for (uint32_t state = 0; state < states; ++state) {
+        for (uint32_t e = edgeStart[state]; e < edgeStart[state + 1]; ++e) {
+            uint32_t child = edgeTarget[e];
+            uint32_t f = state == 0 ? 0 : step(fail[state], edgeClass[e]) & ~MATCH;
+            fail[child] = f;
+            dictLink[child] = endsPattern(f) ? f : dictLink[f];
+            if (endsPattern(child) || dictLink[child] != 0) {
+                edgeTarget[e] |= MATCH;
+            }
+        }
+        if (state < denseCount) {
+            uint32_t* row = dense.data() + size_t(state) * classCount;
+            if (state != 0) {
+                copy_n(dense.data() + size_t(fail[state]) * classCount, classCount, row);
+            }
+            for (uint32_t e = edgeStart[state]; e < edgeStart[state + 1]; ++e) {
+                row[edgeClass[e]] = edgeTarget[e];
+            }
+        }
+    }
+
+    for (int c = 0; c < 256; ++c) {
+        rootNext[c] = dense[byteClass[c]];
+        if (rootNext[c] != 0) {
+            startLow[c & 0x0F] |= static_cast<uint8_t>(1 << ((c >> 4) & 7));
+            anyStart = true;
+        }
+    }
+#ifdef KEYWORD_SHUFFLE_SKIP
+    shuffleSkip = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+uint32_t AhoCorasick::step(uint32_t state, uint8_t cls) const {
+    while (state >= denseCount) {
+        uint32_t first = edgeStart[state];
+        uint32_t last = edgeStart[state + 1];
+        // Deep states have one or two edges, only the wide ones are worth a binary search
+        if (last - first <= 8) {
+            for (uint32_t e = first; e < last; ++e) {
+                if (edgeClass[e] == cls) {
+                    return edgeTarget[e];
+                }
+            }
+        } else {
+            const uint8_t* begin = edgeClass.data() + first;
+            const uint8_t* it = lower_bound(begin, edgeClass.data() + last, cls);
+            if (it != edgeClass.data() + last && *it == cls) {
+                return edgeTarget[first + (it - begin)];
+            }
+        }
+        state = fail[state];
+    }
+    return dense[size_t(state) * classCount + cls];
+}
+
+#ifdef KEYWORD_SHUFFLE_SKIP
+/**
+ * Start bytes as a bitmap of 16 low nibbles x 8 high nibbles: a byte may start a pattern if its row of startLow
+ * has the bit of its high nibble. Two pshufb lookups test 16 bytes for any number of start bytes, bytes from 0x80
+ * share the bits of 0x00..0x7F and are confirmed by the caller. Returns the first candidate or the last partial
+ * block.
+ */
+__attribute__((target("ssse3")))
+static const uint8_t* shuffleSkip16(const uint8_t* p, const uint8_t* end, const uint8_t* startLow) {
+    const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(startLow));
+    const __m128i high = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i lowBits = _mm_shuffle_epi8(low, _mm_and_si128(block, nibble));
+        __m128i highBits = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+        __m128i none = _mm_cmpeq_epi8(_mm_and_si128(lowBits, highBits), _mm_setzero_si128());
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(none)) & 0xFFFF;
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return p;
+}
+#endif
+
+const uint8_t* AhoCorasick::skipToStart(const uint8_t* p, const uint8_t* end) const {
+    if (!anyStart) {
+        return end;
+    }
+#ifdef KEYWORD_SHUFFLE_SKIP
+    if (shuffleSkip) {
+        while (end - p >= 16) {
+            p = shuffleSkip16(p, end, startLow);
+            if (end - p < 16 || rootNext[*p] != 0) {
+                break;
+            }
+            ++p;
+        }
+    }
+#endif
+    while (p < end && rootNext[*p] == 0) {
+        ++p;
+    }
+    return p;
+}
+
+static const char* actionName(FilterAction action) {
+    switch (action) {
+        case FILTER_HIGHLIGHT: return "highlight";
+        case FILTER_COUNT: return "count";
+        case FILTER_FORWARD: return "forward";
+        case FILTER_SUPPRESS: return "suppress";
+    }
+    return "?";
+}
+
+static const char* fieldName(FilterField field) {
+    switch (field) {
+        case FilterField::SENDER: return "sender";
+        case FilterField::CONTENT: return "content";
+        case FilterField::ANY: return "any";
+    }
+    return "?";
+}
+
+KeywordFilter::KeywordFilter(const string& path, ostream& defaultTarget, string defaultTargetName) :
+    path(path), defaultTarget(&defaultTarget), defaultTargetName(move(defaultTargetName)) {
+    string error;
+    if (!reloadIfChanged(true, error)) {
+        throw invalid_argument(error);
+    }
+}
+
+void KeywordFilter::load() {
+    ifstream file(path);
+    if (!file) {
+        throw invalid_argument("ERROR: Unable to open rules file " + path);
+    }
+    vector<FilterRule> loaded;
+    string target;
+    string line;
+    for (size_t number = 1; getline(file, line); ++number) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        istringstream words(line);
+        string action, field;
+        if (!(words >> action) || action[0] == '#') {
+            continue;
+        }
+        auto fail = [&](const string& what) {
+            return invalid_argument("ERROR: " + path + ":" + to_string(number) + ": " + what);
+        };
+        if (action == "forward-to") {
+            if (!(words >> target)) {
+                throw fail("forward-to needs a path");
+            }
+            continue;
+        }
+        FilterRule rule;
+        if (action == "highlight") rule.action = FILTER_HIGHLIGHT;
+        else if (action == "count") rule.action = FILTER_COUNT;
+        else if (action == "forward") rule.action = FILTER_FORWARD;
+        else if (action == "suppress") rule.action = FILTER_SUPPRESS;
+        else throw fail("unknown action '" + action + "'");
+        words >> field;
+        if (field == "sender") rule.field = FilterField::SENDER;
+        else if (field == "content") rule.field = FilterField::CONTENT;
+        else if (field == "any") rule.field = FilterField::ANY;
+        else throw fail("unknown field '" + field + "', use sender, content or any");
+        getline(words >> ws, rule.pattern);
+        if (rule.pattern.empty()) {
+            throw fail("missing pattern");
+        }
+        loaded.push_back(move(rule));
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<string> patterns;
+    patterns.reserve(loaded.size());
+    for (const FilterRule& rule : loaded) {
+        patterns.push_back(rule.pattern);
+    }
+    auto compiled = make_unique<AhoCorasick>(patterns);
+    unique_ptr<ofstream> targetFile;
+    if (!target.empty()) {
+        targetFile = make_unique<ofstream>(target, ios::app);
+        if (!*targetFile) {
+            throw invalid_argument("ERROR: Unable to open forward target " + target);
+        }
+    }
+
+    // Everything is valid, switch over. Rule hits start again, the message totals keep counting.
+    rules = move(loaded);
+    automaton = move(compiled);
+    patternRule.resize(rules.size());
+    for (uint32_t i = 0; i < rules.size(); ++i) {
+        patternRule[i] = i;
+    }
+    lastHit.assign(rules.size(), 0);
+    forwardPath = target;
+    forwardFile = move(targetFile);
+    compileMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf_debug("KeywordFilter: %zu rules, %zu states, compiled in %.1f ms", rules.size(), automaton->stateCount(), compileMs);
+}
+
+bool KeywordFilter::reloadIfChanged(bool force, string& error) {
+    auto now = chrono::steady_clock::now();
+    if (!force && now < nextCheck) {
+        return true;
+    }
+    nextCheck = now + chrono::seconds(1);
+    struct stat info{};
+    if (stat(path.c_str(), &info) < 0) {
+        error = "ERROR: Unable to open rules file " + path;
+        return false;
+    }
+    if (!force && info.st_mtim.tv_sec == modified.tv_sec && info.st_mtim.tv_nsec == modified.tv_nsec) {
+        return true;
+    }
+    // Remember the time even if the file is broken, so it is reported once and not every second
+    modified = info.st_mtim;
+    try {
+        load();
+    } catch (const invalid_argument& e) {
+        error = e.what();
+        return false;
+    }
+    return true;
+}
+
+void KeywordFilter::match(string_view text, FilterField field, uint8_t& actions) {
+    automaton->scan(text, [&](uint32_t pattern) {
+        uint32_t index = patternRule[pattern];
+        FilterRule& rule = rules[index];
+        if ((static_cast<uint8_t>(rule.field) & static_cast<uint8_t>(field)) && lastHit[index] != serial) {
+            lastHit[index] = serial;
+            rule.hits++;
+            actions |= rule.action;
+        }
+    });
+}
+
+uint8_t KeywordFilter::apply(const Message& msg) {
+    string_view sender, content;
+    if (msg.getType() == MessageType::MSG) {
+        auto fields = static_cast<const MsgMessage&>(msg).fields();
+        sender = string_view(get<0>(fields));
+        content = get<1>(fields);
+    } else if (msg.getType() == MessageType::ERR) {
+        auto fields = static_cast<const ErrMessage&>(msg).fields();
+        sender = string_view(get<0>(fields));
+        content = get<1>(fields);
+    } else {
+        return 0;
+    }
+    serial++;
+    scanned++;
+    uint8_t actions = 0;
+    match(sender, FilterField::SENDER, actions);
+    match(content, FilterField::CONTENT, actions);
+    if (actions) {
+        matched++;
+    }
+    if (actions & FILTER_SUPPRESS) {
+        suppressed++;
+    }
+    return actions;
+}
+
+void KeywordFilter::forward(const Message& msg) {
+    ostream& out = forwardFile ? *forwardFile : *defaultTarget;
+    msg.print(out);
+    out.flush();
+}
+
+void KeywordFilter::report(ostream& out) const {
+    out << "Filter " << path << ": " << rules.size() << " rules, " << automaton->stateCount() << " states, compiled in "
+        << compileMs << " ms\n"
+        << "  scanned " << scanned << ", matched " << matched << ", suppressed " << suppressed
+        << ", forwarding to " << (forwardPath.empty() ? defaultTargetName : forwardPath) << "\n";
+    vector<const FilterRule*> hit;
+    for (const FilterRule& rule : rules) {
+        if (rule.hits > 0) {
+            hit.push_back(&rule);
+        }
+    }
+    sort(hit.begin(), hit.end(), [](const FilterRule* a, const FilterRule* b) { return a->hits > b->hits; });
+    for (size_t i = 0; i < hit.size() && i < 20; ++i) {
+        out << "  " << hit[i]->hits << " " << actionName(hit[i]->action) << " " << fieldName(hit[i]->field) << " "
+            << hit[i]->pattern << "\n";
+    }
+}
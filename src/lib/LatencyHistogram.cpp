@@ -0,0 +1,39 @@
+#include "../inc/LatencyHistogram.h"
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * n + 0.5);
+    rank = rank == 0 ? 1 : (rank > n ? n : rank);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i].load(memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t low = lowerBound(i);
+            uint64_t high = i + 1 < BUCKETS ? lowerBound(i + 1) : low + 1;
+            uint64_t mid = low + (high - low) / 2;
+            return mid < min() ? min() : (mid > max() ? max() : mid);
+        }
+    }
+    return max();
+}
+
+void LatencyHistogram::print(ostream& out, const char* name) const {
+    out << "  " << name << ": " << count() << " samples";
+    if (count() > 0) {
+        out << ", us min " << min() / 1000.0 << ", p50 " << percentile(50) / 1000.0 << ", p90 " << percentile(90) / 1000.0
+            << ", p99 " << percentile(99) / 1000.0 << ", p99.9 " << percentile(99.9) / 1000.0 << ", max " << max() / 1000.0;
+    }
+    out << "\n";
+}
+
+void LatencyProfile::print(ostream& out) const {
+    static const char* const NAMES[LATENCY_STAGE_COUNT] = {"kernel-to-user", "parse", "queue", "render", "confirm-rtt"};
+    out << "Latency by stage:\n";
+    for (size_t i = 0; i < LATENCY_STAGE_COUNT; ++i) {
+        stages[i].print(out, NAMES[i]);
+    }
+    out << flush;
+}
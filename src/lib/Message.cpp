@@ -1,223 +1,133 @@
 #include "../inc/Message.h"
+#include "../inc/Tracepoints.h"
+#include <charconv>
 
 using namespace std;
 
-void Message::validateLength(const string& value, size_t maxLength, const string& fieldName) {
-    if (value.size() > maxLength) {
-        cout << "ERROR: " << fieldName << " exceeds maximum length of " << to_string(maxLength)<<"\n"<<flush;
-    }
+string Message::serialize() const {
+    return Protocol::visit(*this, [](const auto& m) {
+        using Spec = typename decay_t<decltype(m)>::Spec;
+        return apply([](const auto&... values) { return Spec::encodeTCP(values...); }, m.fields());
+    });
 }
 
-void Message::validateRegex(const string& value, const string& pattern, const string& fieldName) {
-    if (!regex_match(value, regex(pattern))) {
-        cout << "ERROR: " << fieldName << " contains invalid characters.\n"<<flush;
-        throw invalid_argument(fieldName + " contains invalid characters.");
-    }
+vector<uint8_t> Message::serializeUDP(uint16_t msgId) const {
+    return Protocol::visit(*this, [msgId](const auto& m) {
+        using Spec = typename decay_t<decltype(m)>::Spec;
+        return apply([msgId](const auto&... values) { return Spec::encodeUDP(msgId, values...); }, m.fields());
+    });
 }
 
-AuthMessage::AuthMessage(const string& u, const string& d, const string& s)
-    : Message(MessageType::AUTH), username(u), displayName(d), secret(s)
-{
-    validateLength(username, 20, "Username");
-    validateRegex(username, "[a-zA-Z0-9_-]+", "Username");
-    validateLength(displayName, 20, "DisplayName");
-    validateRegex(displayName, "^[!-~]+$", "DisplayName");
-    validateLength(secret, 128, "Secret");
-    validateRegex(secret, "[a-zA-Z0-9_-]+", "Secret");
+void Message::serialize(string& out) const {
+    Protocol::visit(*this, [&out](const auto& m) {
+        using Spec = typename decay_t<decltype(m)>::Spec;
+        apply([&out](const auto&... values) { Spec::encodeTCP(out, values...); }, m.fields());
+    });
 }
 
-string AuthMessage::serialize() const {
-    // AUTH {Username} AS {DisplayName} USING {Secret}\r\n
-    return "AUTH " + username + " AS " + displayName + " USING " + secret + "\r\n";
+void Message::serializeUDP(vector<uint8_t>& out, uint16_t msgId) const {
+    Protocol::visit(*this, [&out, msgId](const auto& m) {
+        using Spec = typename decay_t<decltype(m)>::Spec;
+        apply([&out, msgId](const auto&... values) { Spec::encodeUDP(out, msgId, values...); }, m.fields());
+    });
 }
 
-vector<uint8_t> AuthMessage::serializeUDP(uint16_t msgId) const {
-    vector<uint8_t> buf;
-    buf.push_back(0x02);  // AUTH
-    buf.push_back((msgId >> 8) & 0xFF); // MessageID
-    buf.push_back(msgId & 0xFF);
-    buf.insert(buf.end(), username.begin(), username.end());
-    buf.push_back(0);
-    buf.insert(buf.end(), displayName.begin(), displayName.end());
-    buf.push_back(0);
-    buf.insert(buf.end(), secret.begin(), secret.end());
-    buf.push_back(0);
-    return buf;
+void Message::print(ostream& out) const {
+    Protocol::visit(*this, [&out](const auto& m) {
+        if constexpr (requires { m.render(out); }) {
+            m.render(out);
+        }
+    });
 }
 
-JoinMessage::JoinMessage(const string& c, const string& d)
-    : Message(MessageType::JOIN), channelID(c), displayName(d)
+// Validate the views first, so length errors name the field instead of coming from FixedString
+AuthMessage::AuthMessage(string_view u, string_view d, string_view s)
+    : Message(MessageType::AUTH)
 {
-    validateLength(channelID, 20, "ChannelID");
-    validateRegex(channelID, "[a-zA-Z0-9_-]+", "ChannelID");
-    validateLength(displayName, 20, "DisplayName");
-    validateRegex(displayName, "^[!-~]+$", "DisplayName");
-}
-
-string JoinMessage::serialize() const {
-    // JOIN {ChannelID} AS {DisplayName}\r\n
-    return "JOIN " + channelID + " AS " + displayName + "\r\n";
+    Spec::validate(u, d, s);
+    username = u;
+    displayName = d;
+    secret = s;
 }
 
-vector<uint8_t> JoinMessage::serializeUDP(uint16_t msgId) const {
-    vector<uint8_t> buf;
-    buf.push_back(3);  // JOIN
-    buf.push_back((msgId >> 8) & 0xFF);
-    buf.push_back(msgId & 0xFF);
-    buf.insert(buf.end(), channelID.begin(), channelID.end());
-    buf.push_back(0);
-    buf.insert(buf.end(), displayName.begin(), displayName.end());
-    buf.push_back(0);
-    return buf;
-}
-
-MsgMessage::MsgMessage(const string& d, const string& m)
-    : Message(MessageType::MSG), displayName(d), messageContent(m)
+JoinMessage::JoinMessage(string_view c, string_view d)
+    : Message(MessageType::JOIN)
 {
-    validateLength(displayName, 20, "DisplayName");
-    validateRegex(displayName, "^[!-~]+$", "DisplayName");
-    validateLength(messageContent, 60000, "MessageContent");
-    validateRegex(messageContent, "^[\\n -~]+$", "MessageContent");
+    Spec::validate(c, d);
+    channelID = c;
+    displayName = d;
 }
 
-string MsgMessage::serialize() const {
-    //MSG FROM {DisplayName} IS {MessageContent}\r\n
-    return "MSG FROM " + displayName + " IS " + messageContent + "\r\n";
+MsgMessage::MsgMessage(string_view d, string_view m)
+    : Message(MessageType::MSG)
+{
+    Spec::validate(d, m);
+    displayName = d;
+    messageContent = m;
 }
 
-vector<uint8_t> MsgMessage::serializeUDP(uint16_t msgId) const {
-    vector<uint8_t> buf;
-    buf.push_back(4);  // MSG
-    buf.push_back((msgId >> 8) & 0xFF);
-    buf.push_back(msgId & 0xFF);
-    buf.insert(buf.end(), displayName.begin(), displayName.end());
-    buf.push_back(0);
-    buf.insert(buf.end(), messageContent.begin(), messageContent.end());
-    buf.push_back(0);
-    return buf;
+void MsgMessage::render(ostream& out) const {
+    out << displayName << ": " << messageContent << "\n" << flush;
 }
 
-ReplyMessage::ReplyMessage(bool s, const string& m, uint16_t r)
-    : Message(MessageType::REPLY), success(s), messageContent(m), refMsgId(r)
-{}
-
-string ReplyMessage::serialize() const {
-    //REPLY {"OK"|"NOK"} IS {MessageContent}\r\n
-    string result = "REPLY ";
-    result += (success ? "OK" : "NOK");
-    result += " IS ";
-    result += messageContent;
-    result += "\r\n";
-    return result;
+ReplyMessage::ReplyMessage(bool s, uint16_t r, string_view m)
+    : Message(MessageType::REPLY), success(s), refMsgId(r)
+{
+    Spec::validate(s, r, m);
+    messageContent = m;
 }
 
-vector<uint8_t> ReplyMessage::serializeUDP(uint16_t msgId) const {
-    vector<uint8_t> buf;
-    buf.push_back(0x01);                   // REPLY
-    buf.push_back((msgId >> 8) & 0xFF);
-    buf.push_back(msgId        & 0xFF);    // this reply’s own MessageID
-    buf.push_back(success ? 1 : 0);        // Result
-    buf.push_back((refMsgId >> 8) & 0xFF);
-    buf.push_back(refMsgId        & 0xFF); // Ref_MessageID
-    buf.insert(buf.end(), messageContent.begin(), messageContent.end());
-    buf.push_back(0);                      // terminator
-    return buf;
+void ReplyMessage::render(ostream& out) const {
+    out << "Action " << (success ? "Success: " : "Failure: ") << messageContent << "\n" << flush;
 }
 
 // --- ErrMessage ---
-ErrMessage::ErrMessage(const string& d, const string& m)
-    : Message(MessageType::ERR), displayName(d), messageContent(m)
+ErrMessage::ErrMessage(string_view d, string_view m)
+    : Message(MessageType::ERR)
 {
-    validateLength(displayName, 20, "DisplayName");
-    validateRegex(displayName, "^[!-~]+$", "DisplayName");
-    validateLength(messageContent, 60000, "MessageContent");
-    validateRegex(messageContent, "^[\\n -~]+$", "MessageContent");
+    Spec::validate(d, m);
+    displayName = d;
+    messageContent = m;
 }
 
-string ErrMessage::serialize() const {
-    // ERR FROM {DisplayName} IS {MessageContent}\r\n
-    return "ERR FROM " + displayName + " IS " + messageContent + "\r\n";
-}
-
-vector<uint8_t> ErrMessage::serializeUDP(uint16_t msgId) const {
-    vector<uint8_t> buf;
-    buf.push_back(0xFE);  // ERR
-    buf.push_back((msgId >> 8) & 0xFF);
-    buf.push_back(msgId & 0xFF);
-    buf.insert(buf.end(), displayName.begin(), displayName.end());
-    buf.push_back(0);
-    buf.insert(buf.end(), messageContent.begin(), messageContent.end());
-    buf.push_back(0);
-    return buf;
+void ErrMessage::render(ostream& out) const {
+    out << "ERROR FROM " << displayName << ": " << messageContent << "\n" << flush;
 }
 
 // --- ByeMessage ---
-ByeMessage::ByeMessage(const string& d)
-    : Message(MessageType::BYE), displayName(d)
+ByeMessage::ByeMessage(string_view d)
+    : Message(MessageType::BYE)
 {
-    validateLength(displayName, 20, "DisplayName");
-    validateRegex(displayName, "^[!-~]+$", "DisplayName");
-}
-
-string ByeMessage::serialize() const {
-    //BYE FROM {DisplayName}\r\n
-    return "BYE FROM " + displayName + "\r\n";
-}
-
-vector<uint8_t> ByeMessage::serializeUDP(uint16_t msgId) const {
-    vector<uint8_t> buf;
-    buf.push_back(0xFF);  // BYE
-    buf.push_back((msgId >> 8) & 0xFF);
-    buf.push_back(msgId & 0xFF);
-    buf.insert(buf.end(), displayName.begin(), displayName.end());
-    buf.push_back(0);
-    return buf;
+    Spec::validate(d);
+    displayName = d;
 }
 
 // --- ConfirmMessage ---
 ConfirmMessage::ConfirmMessage()
     : Message(MessageType::CONFIRM) {}
 
-string ConfirmMessage::serialize() const {
-    return "CONFIRM\r\n";
-}
-
-vector<uint8_t> ConfirmMessage::serializeUDP(uint16_t msgId) const {
-    vector<uint8_t> buf;
-    buf.push_back(0);  // CONFIRM
-    buf.push_back((msgId >> 8) & 0xFF);
-    buf.push_back(msgId & 0xFF);
-    return buf;
-}
-
 // --- PingMessage ---
 PingMessage::PingMessage()
     : Message(MessageType::PING) {}
 
-string PingMessage::serialize() const {
-    return "PING\r\n";
-}
-
-vector<uint8_t> PingMessage::serializeUDP(uint16_t msgId) const {
-    vector<uint8_t> buf;
-    buf.push_back(253);  // PING
-    buf.push_back((msgId >> 8) & 0xFF);
-    buf.push_back(msgId & 0xFF);
-    return buf;
-}
-
 // --- MessageFactory ---
-unique_ptr<Message> MessageFactory::createMessage(MessageType type, const vector<string>& params) {
+unique_ptr<Message> MessageFactory::createMessage(MessageType type, span<const string_view> params) {
+    static constexpr size_t fieldCounts[] = {3, 2, 2, 3, 2, 1, 0, 0};   // By MessageType, REPLY with its Ref_MessageID
+    if (static_cast<size_t>(type) < size(fieldCounts) && params.size() < fieldCounts[static_cast<size_t>(type)]) {
+        throw invalid_argument("Too few fields for the message type");
+    }
     switch (type) {
         case MessageType::AUTH:    return make_unique<AuthMessage>(params[0], params[1], params[2]);
         case MessageType::JOIN:    return make_unique<JoinMessage>(params[0], params[1]);
         case MessageType::MSG:     return make_unique<MsgMessage>(params[0], params[1]);
 		case MessageType::REPLY: {
    		 	bool success = (params[0] == "true");
-    		const string& msg     = params[1];
-   		 	// parse the third parameter (a string) to an unsigned long, then cast down
-    		uint16_t refMsgId = static_cast<uint16_t>(stoul(params[2]));
-    		return make_unique<ReplyMessage>(success, msg, refMsgId);
+   		 	// parse the third parameter (a decimal string) to the 16-bit message ID
+    		uint16_t refMsgId = 0;
+    		if (from_chars(params[2].data(), params[2].data() + params[2].size(), refMsgId).ec != errc()) {
+    		    throw invalid_argument("Invalid Ref_MessageID");
+    		}
+    		return make_unique<ReplyMessage>(success, refMsgId, params[1]);
 		}
         case MessageType::ERR:     return make_unique<ErrMessage>(params[0], params[1]);
         case MessageType::BYE:     return make_unique<ByeMessage>(params[0]);
@@ -228,131 +138,22 @@ unique_ptr<Message> MessageFactory::createMessage(MessageType type, const vector
 }
 
 unique_ptr<Message> MessageFactory::parseMessage(const string& input) {
-    istringstream iss(input);
-    string type;
-    iss >> type;
-
-    if (type == "AUTH") {
-        string u, AS, d, USING, s;
-        iss >> u >> AS >> d >> USING >> s;
-        return createMessage(MessageType::AUTH, {u, s, d});
-    } else if (type == "JOIN") {
-        string c, AS, d;
-        iss >> c >> AS >> d;
-        return createMessage(MessageType::JOIN, {c, d});
-    } else if (type == "MSG") {
-        string F, d, IS;
-        iss >> F >> d >> IS;
-        string m;
-        getline(iss, m);
-        string content = m.substr(1);
-        if (!content.empty() && content.back() == '\r') content.pop_back();
-        cout << d << ": " << content << "\n" << flush;
-        return createMessage(MessageType::MSG, {d, content});
-    } else if (type == "REPLY") {
-        string ok, IS;
-        iss >> ok >> IS;
-        string m;
-        getline(iss, m);
-        string content = m.substr(1);
-        if (!content.empty() && content.back() == '\r') content.pop_back();
-        cout << "Action " << (ok == "OK" ? "Success: " : "Failure: ") << content << "\n" << flush;
-        return createMessage(MessageType::REPLY, {ok == "OK" ? "true" : "false", content, "0"});
-    } else if (type == "ERR") {
-        string F, d, IS;
-        iss >> F >> d >> IS;
-        string m;
-        getline(iss, m);
-        string content = m.substr(1);
-        if (!content.empty() && content.back() == '\r') content.pop_back();
-        cout << "ERROR FROM " << d << ": " << content << "\n" << flush;
-        return createMessage(MessageType::ERR, {d, content});
-    } else if (type == "BYE") {
-        string F, d;
-        iss >> F >> d;
-        return createMessage(MessageType::BYE, {d});
-    } else if (type == "PING") {
-        return createMessage(MessageType::PING, {});
-    } else if (type == "CONFIRM") {
-        return createMessage(MessageType::CONFIRM, {});
-    } else {
-        throw invalid_argument("Unknown message type: " + type);
-    }
+    return parseView(input).materialize();
 }
 
 unique_ptr<Message> MessageFactory::parseUDP(const uint8_t* data, size_t length) {
-    if (length < 3) {
-        throw invalid_argument("UDP frame too short");
-    }
-    uint8_t typeCode = data[0];
-    uint16_t msgId = (uint16_t(data[1]) << 8) | data[2];
-    const uint8_t* ptr = data + 3;
-    size_t remaining = length - 3;
-
-    // pomocná lambda na čtení nulou ukončeného stringu
-    auto readString = [&](string& out) {
-        size_t i = 0;
-        while (i < remaining && ptr[i] != 0) i++;
-        if (i >= remaining) throw invalid_argument("Malformed UDP string");
-        out.assign(reinterpret_cast<const char*>(ptr), i);
-        ptr += i + 1;
-        remaining -= i + 1;
-    };
-
-    switch (typeCode) {
-        case 0x01: { // REPLY
-            // Formát: [type][msgId][success][refMsgId(2B)][payload...]\0
-            if (remaining < 3) throw invalid_argument("Malformed REPLY");
-            bool success = (*ptr++ != 0);
-            remaining--;
-            // Read two-byte Ref_MessageID
-            if (remaining < 2) throw invalid_argument("Malformed REPLY: missing Ref_MessageID");
-            uint16_t refMsgId = (uint16_t(ptr[0]) << 8) | ptr[1];
-            ptr += 2;
-            remaining -= 2;
-            string msg;
-            readString(msg);
-            cout << "Action " << (success ? "Success: " : "Failure: ") << msg << endl << flush;
-            return make_unique<ReplyMessage>(success, msg, refMsgId);
-        }
-
-        case 0x00:  // CONFIRM
-            return make_unique<ConfirmMessage>();
-
-        case 0xFD: // PING
-            return make_unique<PingMessage>();
-
-        case 0xFE: { // ERR
-            string dn, msg;
-            readString(dn);
-            readString(msg);
-            cout << "ERROR FROM " << dn << ": " << msg << endl << flush;
-            return make_unique<ErrMessage>(dn, msg);
-        }
-
-        case 0xFF: { // BYE (server‑initiated)
-            string dn;
-            readString(dn);
-            // u BYE se neodpovídá CONFIRM, jen ukončíme
-            return make_unique<ByeMessage>(dn);
-        }
-
-        case 0x04: { // MSG
-            string dn, msg;
-            readString(dn);
-            readString(msg);
-            cout << dn << ": " << msg << endl << flush;
-            return make_unique<MsgMessage>(dn, msg);
-        }
+    return parseUDPView(data, length).materialize();
+}
 
-        case 0x03: { // JOIN
-            string cid, dn;
-            readString(cid);
-            readString(dn);
-            return make_unique<JoinMessage>(cid, dn);
-        }
+MessageView MessageFactory::parseView(string_view frame) {
+    MessageView view = Protocol::decodeTCPView(frame);
+    TRACE_PROBE(frame_parsed, static_cast<int>(view.getType()), -1, frame.size());
+    return view;
+}
 
-        default:
-            throw invalid_argument("Unknown UDP message type code: " + to_string(typeCode));
-    }
+MessageView MessageFactory::parseUDPView(const uint8_t* data, size_t length) {
+    // decodeUDPView() rejects frames without a complete header before the MessageID is read
+    MessageView view(Protocol::decodeUDPView(data, length), (int32_t(data[1]) << 8) | data[2]);
+    TRACE_PROBE(frame_parsed, static_cast<int>(view.getType()), view.getMessageId(), length);
+    return view;
 }
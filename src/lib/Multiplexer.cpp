@@ -0,0 +1,201 @@
+#include "../inc/Multiplexer.h"
+
+Multiplexer::Multiplexer(const string& path) : path(path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw runtime_error("ERROR: Socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        throw runtime_error("ERROR: Unable to create daemon socket");
+    }
+    try {
+        // A socket file left behind by a previous daemon would make bind() fail
+        removeStaleSocket(path, address);
+    } catch (const runtime_error&) {
+        close(listener);
+        throw;
+    }
+    // Subscribers act with the daemon's identity, so only its owner may connect (before listen() nobody can)
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || chmod(path.c_str(), 0600) < 0 ||
+        listen(listener, 16) < 0) {
+        close(listener);
+        throw runtime_error("ERROR: Unable to listen on " + path);
+    }
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0) {
+        socketDevice = info.st_dev;
+        socketInode = info.st_ino;
+    }
+    printf_debug("Multiplexer: Listening on %s", path.c_str());
+}
+
+Multiplexer::~Multiplexer() {
+    for (Subscriber& subscriber : subscribers) {
+        flush(subscriber);
+        close(subscriber.fd);
+    }
+    close(listener);
+    // Someone may have replaced the socket file meanwhile
+    struct stat info;
+    if (socketInode != 0 && lstat(path.c_str(), &info) == 0 && info.st_dev == socketDevice && info.st_ino == socketInode) {
+        unlink(path.c_str());
+    }
+}
+
+void Multiplexer::removeStaleSocket(const string& path, const sockaddr_un& address) {
+    struct stat info;
+    if (lstat(path.c_str(), &info) < 0) {
+        if (errno == ENOENT) {
+            return;
+        }
+        throw runtime_error("ERROR: Unable to inspect " + path + ": " + strerror(errno));
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        throw runtime_error("ERROR: " + path + " exists and is not a socket");
+    }
+    // Only a socket nobody listens on any more is stale
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        throw runtime_error("ERROR: Unable to create daemon socket");
+    }
+    bool refused = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 && errno == ECONNREFUSED;
+    close(probe);
+    if (!refused) {
+        throw runtime_error("ERROR: Another daemon is listening on " + path);
+    }
+    printf_debug("Multiplexer: Removing stale socket %s", path.c_str());
+    unlink(path.c_str());
+}
+
+void Multiplexer::addPollFds(vector<pollfd>& fds) const {
+    fds.push_back({listener, POLLIN, 0});
+    for (const Subscriber& subscriber : subscribers) {
+        short events = static_cast<short>((subscriber.readClosed ? 0 : POLLIN) | (subscriber.output.empty() ? 0 : POLLOUT));
+        fds.push_back({subscriber.fd, events, 0});
+    }
+}
+
+void Multiplexer::process(const vector<pollfd>& fds, vector<pair<uint64_t, string>>& lines) {
+    for (const pollfd& pfd : fds) {
+        if (pfd.revents == 0) {
+            continue;
+        }
+        if (pfd.fd == listener) {
+            accept();
+            continue;
+        }
+        auto it = find_if(subscribers.begin(), subscribers.end(), [&](const Subscriber& s) { return s.fd == pfd.fd; });
+        if (it == subscribers.end()) {
+            continue;
+        }
+        bool alive = true;
+        if (!it->readClosed && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+            alive = readFrom(*it, lines);
+        } else if (pfd.revents & (POLLHUP | POLLERR)) {
+            // Fully closed after its EOF, nobody left to answer
+            alive = false;
+        }
+        if (alive && (pfd.revents & POLLOUT)) {
+            alive = flush(*it);
+        }
+        if (!alive) {
+            printf_debug("Multiplexer: Subscriber %lu disconnected", (unsigned long)it->id);
+            close(it->fd);
+            subscribers.erase(it);
+        }
+    }
+}
+
+void Multiplexer::closeFinished(const function<bool(uint64_t)>& pending) {
+    auto finished = [&](const Subscriber& subscriber) {
+        if (!subscriber.readClosed || !subscriber.output.empty() || subscriber.droppedBytes > 0 || pending(subscriber.id)) {
+            return false;
+        }
+        printf_debug("Multiplexer: Subscriber %lu finished", (unsigned long)subscriber.id);
+        close(subscriber.fd);
+        return true;
+    };
+    subscribers.erase(remove_if(subscribers.begin(), subscribers.end(), finished), subscribers.end());
+}
+
+void Multiplexer::accept() {
+    int fd;
+    while ((fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        printf_debug("Multiplexer: Subscriber %lu connected on fd %d", (unsigned long)nextId, fd);
+        subscribers.push_back({nextId++, fd, {}, {}, 0, false});
+    }
+}
+
+bool Multiplexer::readFrom(Subscriber& subscriber, vector<pair<uint64_t, string>>& lines) {
+    char buffer[16384];
+    ssize_t n;
+    while ((n = recv(subscriber.fd, buffer, sizeof(buffer), 0)) > 0) {
+        subscriber.input.append(buffer, static_cast<size_t>(n));
+        size_t start = 0, end;
+        while ((end = subscriber.input.find('\n', start)) != string::npos) {
+            size_t length = end - start;
+            if (length > 0 && subscriber.input[end - 1] == '\r') {
+                length--;
+            }
+            lines.emplace_back(subscriber.id, subscriber.input.substr(start, length));
+            start = end + 1;
+        }
+        subscriber.input.erase(0, start);
+        if (subscriber.input.size() > INPUT_LIMIT) {
+            return false;
+        }
+    }
+    if (n == 0) {
+        // EOF only ends the subscriber's input, an unterminated last line still counts
+        if (!subscriber.input.empty()) {
+            lines.emplace_back(subscriber.id, move(subscriber.input));
+            subscriber.input.clear();
+        }
+        subscriber.readClosed = true;
+        return true;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+bool Multiplexer::flush(Subscriber& subscriber) {
+    while (!subscriber.output.empty()) {
+        ssize_t n = send(subscriber.fd, subscriber.output.data(), subscriber.output.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        subscriber.output.erase(0, static_cast<size_t>(n));
+    }
+    if (subscriber.droppedBytes > 0) {
+        subscriber.output = "ERROR: Subscriber fell behind, " + to_string(subscriber.droppedBytes) + " bytes of output dropped.\n";
+        subscriber.droppedBytes = 0;
+        return flush(subscriber);
+    }
+    return true;
+}
+
+void Multiplexer::enqueue(Subscriber& subscriber, string_view text) {
+    if (subscriber.output.size() + text.size() > OUTPUT_LIMIT) {
+        subscriber.droppedBytes += text.size();
+        return;
+    }
+    subscriber.output.append(text);
+    flush(subscriber);
+}
+
+void Multiplexer::sendTo(uint64_t id, string_view text) {
+    for (Subscriber& subscriber : subscribers) {
+        if (subscriber.id == id) {
+            enqueue(subscriber, text);
+        }
+    }
+}
+
+void Multiplexer::broadcast(string_view text) {
+    for (Subscriber& subscriber : subscribers) {
+        enqueue(subscriber, text);
+    }
+}
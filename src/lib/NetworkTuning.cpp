@@ -0,0 +1,180 @@
+#include "../inc/NetworkTuning.h"
+
+void WakeupStats::add(int64_t ns) {
+    samples++;
+    totalNs += ns;
+    minNs = min(minNs, ns);
+    maxNs = max(maxNs, ns);
+}
+
+void WakeupStats::print(ostream& out) const {
+    out << "Network thread wakeups: " << spinWakeups << " while spinning, " << sleepWakeups << " after sleeping\n";
+    if (samples == 0) {
+        out << "Wake-up latency: unavailable (no kernel receive timestamps)\n" << flush;
+        return;
+    }
+    out << "Wake-up latency [us]: min " << minNs / 1000.0 << ", avg " << totalNs / 1000.0 / samples << ", max " << maxNs / 1000.0
+        << " (" << samples << " samples)\n" << flush;
+}
+
+void LatencyStats::add(uint64_t ns) {
+    samples++;
+    totalNs += ns;
+    maxNs = max(maxNs, ns);
+}
+
+void LatencyStats::print(ostream& out, const char* name) const {
+    out << "  " << name << ": " << samples << " sent";
+    if (samples > 0) {
+        out << ", latency [ms] avg " << totalNs / 1e6 / samples << ", max " << maxNs / 1e6;
+    }
+    out << "\n" << flush;
+}
+
+void ReceiveBufferStats::print(ostream& out) const {
+    out << "UDP receive buffer: " << drops << " datagrams dropped by the kernel, " << bytes / 1024 << " KiB";
+    if (resizes > 0) {
+        out << " (grown " << resizes << "x from " << initialBytes / 1024 << " KiB, ceiling " << ceilingBytes / 1024 << " KiB)";
+    }
+    if (limited) {
+        out << ", limited by net.core.rmem_max";
+    }
+    out << "\n" << flush;
+}
+
+bool NetworkTuning::pinCurrentThread(int core, string& error) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        error = "could not pin network thread to CPU " + to_string(core) + ": " + strerror(err);
+        return false;
+    }
+    printf_debug("NetworkTuning: Network thread pinned to CPU %d", core);
+    return true;
+}
+
+bool NetworkTuning::enableBusyPoll(int fd, uint32_t budgetUs, string& error) {
+#ifdef SO_BUSY_POLL
+    int value = static_cast<int>(budgetUs);
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) < 0) {
+        error = string("could not set SO_BUSY_POLL: ") + strerror(errno);
+        return false;
+    }
+    printf_debug("NetworkTuning: SO_BUSY_POLL set to %u us", budgetUs);
+    return true;
+#else
+    (void)fd;
+    (void)budgetUs;
+    error = "SO_BUSY_POLL is not supported";
+    return false;
+#endif
+}
+
+int NetworkTuning::spinThenPoll(pollfd* fds, nfds_t count, int timeoutMs, uint32_t budgetUs, bool& spun) {
+    spun = false;
+    if (budgetUs > 0) {
+        auto deadline = chrono::steady_clock::now() + chrono::microseconds(budgetUs);
+        do {
+            int ready = poll(fds, count, 0);
+            if (ready != 0) {
+                spun = ready > 0;
+                return ready;
+            }
+        } while (chrono::steady_clock::now() < deadline);
+    }
+    return poll(fds, count, timeoutMs);
+}
+
+bool NetworkTuning::enableRxTimestamps(int fd) {
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+        return true;
+    }
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0) {
+        return true;
+    }
+    printf_debug("NetworkTuning: Kernel receive timestamps unavailable");
+    return false;
+}
+
+bool NetworkTuning::enableDropCounter(int fd) {
+#ifdef SO_RXQ_OVFL
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == 0) {
+        return true;
+    }
+#endif
+    (void)fd;
+    printf_debug("NetworkTuning: Receive queue drop counter unavailable");
+    return false;
+}
+
+int NetworkTuning::receiveBufferSize(int fd) {
+    int bytes = 0;
+    socklen_t length = sizeof(bytes);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bytes, &length);
+    return bytes;
+}
+
+int NetworkTuning::setReceiveBufferSize(int fd, int bytes) {
+    // The kernel doubles the value for its bookkeeping
+    int request = bytes / 2;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &request, sizeof(request));
+#ifdef SO_RCVBUFFORCE
+    if (receiveBufferSize(fd) < bytes) {
+        // Capped by net.core.rmem_max, needs CAP_NET_ADMIN to go past it
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &request, sizeof(request));
+    }
+#endif
+    return receiveBufferSize(fd);
+}
+
+ssize_t NetworkTuning::receiveTimestamped(int fd, void* buffer, size_t length, int flags, sockaddr* from, socklen_t* fromLength,
+                                          uint64_t& kernelNs, uint32_t* dropCounter) {
+    iovec iov{buffer, length};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+    msghdr msg{};
+    msg.msg_name = from;
+    msg.msg_namelen = fromLength ? *fromLength : 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    kernelNs = 0;
+    ssize_t n = recvmsg(fd, &msg, flags);
+    if (n < 0) {
+        return n;
+    }
+    if (fromLength) {
+        *fromLength = msg.msg_namelen;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        timespec stamp{};
+#ifdef SO_RXQ_OVFL
+        if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            // Total for the socket so far, only attached once it is non-zero
+            if (dropCounter) {
+                memcpy(dropCounter, CMSG_DATA(cmsg), sizeof(*dropCounter));
+            }
+            continue;
+        }
+#endif
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            // ts[0] is the software timestamp
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+        } else if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+        } else {
+            continue;
+        }
+        kernelNs = uint64_t(stamp.tv_sec) * 1000000000ULL + uint64_t(stamp.tv_nsec);
+    }
+    return n;
+}
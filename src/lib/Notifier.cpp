@@ -0,0 +1,25 @@
+#include "../inc/Notifier.h"
+
+Notifier::Notifier() {
+    efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+        throw runtime_error("ERROR: Unable to create eventfd");
+    }
+}
+
+Notifier::~Notifier() {
+    close(efd);
+}
+
+void Notifier::notify() {
+    uint64_t one = 1;
+    // EAGAIN only means the counter is saturated, the reader is woken up either way
+    ssize_t ignored = write(efd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void Notifier::clear() {
+    uint64_t count;
+    ssize_t ignored = read(efd, &count, sizeof(count));
+    (void)ignored;
+}
@@ -0,0 +1,170 @@
+#include "../inc/OutputSink.h"
+
+uint64_t OutputSink::wallClockNs() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count());
+}
+
+void OutputSink::message(ostream& out, const Message& msg, uint64_t kernelNs, uint64_t receivedNs, int32_t messageId, bool alert,
+                         string_view request) {
+    if (format == OutputFormat::TEXT) {
+        if (alert && colour) {
+            out << "\033[1;33m";
+            msg.print(out);
+            out << "\033[0m" << flush;
+        } else if (alert) {
+            out << ALERT_MARKER;
+            msg.print(out);
+        } else {
+            msg.print(out);
+        }
+        return;
+    }
+    Record record;
+    record.alert = alert;
+    record.request = request;
+    record.kernelNs = kernelNs;
+    record.receivedNs = receivedNs;
+    record.messageId = messageId;
+    // The field descriptors say which field is the sender, the content, ...
+    Protocol::visit(msg, [&](const auto& m) {
+        using Spec = typename decay_t<decltype(m)>::Spec;
+        record.code = Spec::code;
+        record.type = Spec::keyword;
+        auto values = m.fields();
+        [&]<size_t... I>(index_sequence<I...>) {
+            ([&] {
+                using F = tuple_element_t<I, typename Spec::FieldTypes>;
+                const auto& value = get<I>(values);
+                if constexpr (F::fieldClass == FieldClass::DISPLAY_NAME) {
+                    record.sender = string_view(value);
+                } else if constexpr (F::fieldClass == FieldClass::CONTENT) {
+                    record.content = string_view(value);
+                } else if constexpr (F::fieldClass == FieldClass::RESULT) {
+                    record.hasResult = true;
+                    record.success = value;
+                } else if constexpr (F::fieldClass == FieldClass::REF_ID) {
+                    // Not transmitted over TCP
+                    record.hasRefId = messageId >= 0;
+                    record.refMsgId = value;
+                }
+            }(), ...);
+        }(make_index_sequence<Spec::fieldCount>{});
+    });
+    write(out, record);
+}
+
+void OutputSink::notice(ostream& out, string_view text) {
+    if (format == OutputFormat::TEXT) {
+        out << text << "\n" << flush;
+        return;
+    }
+    Record record;
+    record.content = text;
+    write(out, record);
+    out.flush();
+}
+
+void OutputSink::write(ostream& out, const Record& record) {
+    buffer.clear();
+    if (format == OutputFormat::JSON) {
+        appendJson(record);
+    } else {
+        appendBinary(record);
+    }
+    // Flushed by the caller once per batch
+    out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+}
+
+void OutputSink::appendJson(const Record& record) {
+    buffer += "{\"type\":\"";
+    buffer += record.type;
+    buffer += "\"";
+    if (record.kernelNs) {
+        buffer += ",\"kernelNs\":";
+        appendNumber(record.kernelNs);
+    }
+    if (record.receivedNs) {
+        buffer += ",\"rxNs\":";
+        appendNumber(record.receivedNs);
+    }
+    buffer += ",\"outNs\":";
+    appendNumber(wallClockNs());
+    if (record.messageId >= 0) {
+        buffer += ",\"messageId\":";
+        appendNumber(record.messageId);
+    }
+    if (record.hasResult) {
+        buffer += record.success ? ",\"success\":true" : ",\"success\":false";
+    }
+    if (record.hasRefId) {
+        buffer += ",\"refMsgId\":";
+        appendNumber(record.refMsgId);
+    }
+    if (record.alert) {
+        buffer += ",\"alert\":true";
+    }
+    if (!record.request.empty()) {
+        buffer += ",\"request\":\"";
+        appendEscaped(record.request);
+        buffer += "\"";
+    }
+    if (!record.sender.empty()) {
+        buffer += ",\"sender\":\"";
+        appendEscaped(record.sender);
+        buffer += "\"";
+    }
+    buffer += record.code == LOCAL_RECORD ? ",\"text\":\"" : ",\"content\":\"";
+    appendEscaped(record.content);
+    buffer += "\"}\n";
+}
+
+void OutputSink::appendEscaped(string_view text) {
+    static constexpr char HEX[] = "0123456789abcdef";
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        buffer.append(text.data() + start, i - start);
+        start = i + 1;
+        if (c == '"' || c == '\\') {
+            buffer += '\\';
+            buffer += static_cast<char>(c);
+        } else if (c == '\n') {
+            buffer += "\\n";
+        } else {
+            buffer += "\\u00";
+            buffer += HEX[c >> 4];
+            buffer += HEX[c & 0xF];
+        }
+    }
+    buffer.append(text.data() + start, text.size() - start);
+}
+
+void OutputSink::appendLE(uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        buffer += static_cast<char>(value >> (8 * i));
+    }
+}
+
+void OutputSink::appendBinary(const Record& record) {
+    appendLE(0, 4);     // Length, patched below
+    appendLE(record.code, 1);
+    appendLE(record.kernelNs, 8);
+    appendLE(record.receivedNs, 8);
+    appendLE(wallClockNs(), 8);
+    appendLE(static_cast<uint32_t>(record.messageId), 4);
+    appendLE((record.success ? 1 : 0) | (record.hasRefId ? 2 : 0) | (record.alert ? 4 : 0), 1);
+    appendLE(record.refMsgId, 2);
+    appendLE(record.sender.size(), 1);
+    buffer += record.sender;
+    appendLE(record.content.size(), 4);
+    buffer += record.content;
+    appendLE(record.request.size(), 1);
+    buffer += record.request;
+    uint32_t length = static_cast<uint32_t>(buffer.size() - 4);
+    for (size_t i = 0; i < 4; ++i) {
+        buffer[i] = static_cast<char>(length >> (8 * i));
+    }
+}
@@ -8,3 +8,22 @@ ProtocolClient::~ProtocolClient() {
         close(ip_socket);
     }
 }
+
+unique_ptr<Message> ProtocolClient::receiveMessage() {
+    MessageView view;
+    if (!receiveView(view)) {
+        return nullptr;
+    }
+    return view.materialize();
+}
+
+void ProtocolClient::stampReceive(uint64_t kernelNs, uint64_t userNs) {
+    if (userNs == 0) {
+        userNs = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count());
+    }
+    receiveTimes.kernelNs = kernelNs;
+    receiveTimes.userNs = userNs;
+    if (profile && kernelNs != 0 && receiveTimes.userNs > kernelNs) {
+        profile->record(LatencyStage::KERNEL_TO_USER, receiveTimes.userNs - kernelNs);
+    }
+}
@@ -0,0 +1,33 @@
+#include "../inc/RequestTracker.h"
+
+#include <algorithm>
+
+void RequestTracker::sent(uint32_t tag, MessageType type, uint16_t messageId, TimerWheel::Handle deadline, uint64_t sentNs) {
+    pending.push_back({tag, type, messageId, deadline, sentNs});
+    printf_debug("RequestTracker: Request %u (MessageID %u) in flight, %zu pending", tag, messageId, pending.size());
+}
+
+bool RequestTracker::matchReply(uint16_t refMsgId, PendingRequest& request) {
+    auto it = pending.begin();
+    if (byMessageId) {
+        // Only a handful of requests are ever in flight, a scan beats maintaining an index
+        it = find_if(pending.begin(), pending.end(), [&](const PendingRequest& p) { return p.messageId == refMsgId; });
+    }
+    if (it == pending.end()) {
+        printf_debug("RequestTracker: REPLY to %u matches no request", refMsgId);
+        return false;
+    }
+    request = *it;
+    pending.erase(it);
+    return true;
+}
+
+bool RequestTracker::expire(uint32_t tag, PendingRequest& request) {
+    auto it = find_if(pending.begin(), pending.end(), [&](const PendingRequest& p) { return p.tag == tag; });
+    if (it == pending.end()) {
+        return false;
+    }
+    request = *it;
+    pending.erase(it);
+    return true;
+}
@@ -0,0 +1,76 @@
+#include "../inc/SendPacer.h"
+
+void PacerStats::print(ostream& out, double currentRate) const {
+    out << "Send pacing: " << sent << " sent, " << throttled << " throttled, " << rateDecreases << " rate decreases, current rate "
+        << currentRate << " msg/s\n";
+    if (sent > 0) {
+        out << "Outbound queue delay [ms]: avg " << totalQueueDelayNs / 1e6 / sent << ", max " << maxQueueDelayNs / 1e6 << "\n";
+    }
+    out << flush;
+}
+
+SendPacer::SendPacer(double rate, uint32_t burst, bool adaptive) :
+    configuredRate(rate), rate(rate), burst(max<uint32_t>(burst, 1)), adaptive(adaptive), tokens(this->burst) {}
+
+uint64_t SendPacer::now() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void SendPacer::refill(uint64_t nowNs) {
+    if (lastRefillNs != 0 && nowNs > lastRefillNs) {
+        tokens = min(burst, tokens + (nowNs - lastRefillNs) * rate / 1e9);
+    }
+    lastRefillNs = nowNs;
+}
+
+bool SendPacer::tryAcquire(uint64_t nowNs) {
+    if (!enabled()) {
+        return true;
+    }
+    refill(nowNs);
+    if (tokens < 1.0) {
+        if (!headThrottled) {
+            counters.throttled++;
+            headThrottled = true;
+        }
+        return false;
+    }
+    tokens -= 1.0;
+    headThrottled = false;
+    return true;
+}
+
+uint64_t SendPacer::waitNs(uint64_t nowNs) {
+    if (!enabled()) {
+        return 0;
+    }
+    refill(nowNs);
+    return tokens >= 1.0 ? 0 : static_cast<uint64_t>((1.0 - tokens) * 1e9 / rate) + 1;
+}
+
+uint64_t SendPacer::queueDelayNs(uint64_t nowNs) const {
+    uint64_t enqueuedNs = headEnqueuedNs.load(memory_order_relaxed);
+    return enqueuedNs == 0 || nowNs < enqueuedNs ? 0 : nowNs - enqueuedNs;
+}
+
+void SendPacer::sent(uint64_t queueDelayNs, uint64_t retransmits) {
+    counters.sent++;
+    counters.totalQueueDelayNs += queueDelayNs;
+    counters.maxQueueDelayNs = max(counters.maxQueueDelayNs, queueDelayNs);
+
+    if (!adaptive || !enabled()) {
+        lastRetransmits = retransmits;
+        return;
+    }
+    if (retransmits > lastRetransmits) {
+        rate = max(MIN_RATE, rate / 2);
+        cleanSends = 0;
+        counters.rateDecreases++;
+        printf_debug("SendPacer: %lu retransmissions, rate lowered to %.1f msg/s", retransmits - lastRetransmits, rate);
+    } else if (rate < configuredRate && ++cleanSends >= INCREASE_INTERVAL) {
+        rate = min(configuredRate, rate + configuredRate / 10);
+        cleanSends = 0;
+        printf_debug("SendPacer: Rate raised to %.1f msg/s", rate);
+    }
+    lastRetransmits = retransmits;
+}
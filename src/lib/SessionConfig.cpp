@@ -0,0 +1,28 @@
+#include "../inc/SessionConfig.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+
+// https://stackoverflow.com/questions/4780021/c-retrieve-the-ip-from-a-name-from-the-dns-linux/4780047
+string resolveHost(const string& host) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* address_list = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &address_list) != 0) {
+        throw runtime_error("ERROR: Couldn't resolve address: " + host);
+    }
+
+    char ip_str[INET_ADDRSTRLEN];
+    for (addrinfo* addr = address_list; addr != nullptr; addr = addr->ai_next) {
+        sockaddr_in* ipv4 = reinterpret_cast<sockaddr_in*>(addr->ai_addr);
+        if (inet_ntop(AF_INET, &(ipv4->sin_addr), ip_str, sizeof(ip_str))) {
+            freeaddrinfo(address_list);
+            return string(ip_str);
+        }
+    }
+
+    freeaddrinfo(address_list);
+    throw runtime_error("ERROR: No valid IPv4 address found for: " + host);
+}
@@ -0,0 +1,226 @@
+#include "../inc/SimulatedNetwork.h"
+
+SimulatedNetwork::SimulatedNetwork(const NetworkConditions& conditions, uint64_t seed) : conditions(conditions), rng(seed) {}
+
+sockaddr_in SimulatedNetwork::address(uint16_t port, const char* ip) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &addr.sin_addr);
+    return addr;
+}
+
+bool SimulatedNetwork::chance(double probability) {
+    return probability > 0 && uniform_real_distribution<double>(0.0, 1.0)(rng) < probability;
+}
+
+void SimulatedNetwork::bind(uint16_t port, Handler handler) {
+    endpoints[port] = move(handler);
+}
+
+void SimulatedNetwork::unbind(uint16_t port) {
+    endpoints.erase(port);
+}
+
+void SimulatedNetwork::schedule(uint64_t atNs, function<void()> action) {
+    events.push({max(atNs, clockNs), nextSequence++, move(action)});
+}
+
+void SimulatedNetwork::send(uint16_t fromPort, const sockaddr_in& to, const uint8_t* data, size_t length) {
+    send(address(fromPort), to, data, length);
+}
+
+void SimulatedNetwork::send(const sockaddr_in& from, const sockaddr_in& to, const uint8_t* data, size_t length) {
+    networkStats.sent++;
+    if (chance(conditions.loss)) {
+        networkStats.dropped++;
+        return;
+    }
+    int copies = 1;
+    if (chance(conditions.duplicate)) {
+        networkStats.duplicated++;
+        copies = 2;
+    }
+    for (int copy = 0; copy < copies; ++copy) {
+        uint64_t delay = conditions.delayNs;
+        if (conditions.jitterNs > 0) {
+            delay += uniform_int_distribution<uint64_t>(0, conditions.jitterNs)(rng);
+        }
+        if (chance(conditions.reorder)) {
+            networkStats.reordered++;
+            delay += conditions.reorderDelayNs;
+        }
+        deliver(from, ntohs(to.sin_port), vector<uint8_t>(data, data + length), delay);
+    }
+}
+
+void SimulatedNetwork::deliver(const sockaddr_in& from, uint16_t toPort, vector<uint8_t> data, uint64_t delayNs) {
+    schedule(clockNs + delayNs, [this, from, toPort, data = move(data)] {
+        auto it = endpoints.find(toPort);
+        if (it == endpoints.end()) {
+            networkStats.unreachable++;
+            return;
+        }
+        networkStats.delivered++;
+        // Copy, the handler may rebind ports while it runs
+        Handler handler = it->second;
+        handler(from, data);
+    });
+}
+
+bool SimulatedNetwork::runUntil(uint64_t deadlineNs, const function<bool()>& done) {
+    while (!done()) {
+        if (events.empty() || events.top().atNs > deadlineNs) {
+            clockNs = max(clockNs, deadlineNs);
+            return false;
+        }
+        function<void()> action = events.top().action;
+        clockNs = max(clockNs, events.top().atNs);
+        events.pop();
+        action();
+    }
+    return true;
+}
+
+SimulatedTransport::SimulatedTransport(SimulatedNetwork& network, uint16_t port) : network(network), port(port) {
+    network.bind(port, [this](const sockaddr_in& from, const vector<uint8_t>& data) {
+        // Same filter the kernel applies to a connected socket
+        if (connected && (from.sin_addr.s_addr != connectedPeer.sin_addr.s_addr || from.sin_port != connectedPeer.sin_port)) {
+            filteredCount++;
+            return;
+        }
+        inbox.push_back({from, data, this->network.now()});
+    });
+}
+
+SimulatedTransport::~SimulatedTransport() {
+    close();
+}
+
+void SimulatedTransport::close() {
+    if (bound) {
+        network.unbind(port);
+        bound = false;
+        inbox.clear();
+    }
+}
+
+ssize_t SimulatedTransport::sendTo(const uint8_t* data, size_t length, const sockaddr_in& to) {
+    network.send(port, connected ? connectedPeer : to, data, length);
+    return static_cast<ssize_t>(length);
+}
+
+bool SimulatedTransport::connect(const sockaddr_in& peer) {
+    connected = true;
+    connectedPeer = peer;
+    return true;
+}
+
+bool SimulatedTransport::wait(int timeoutMs) {
+    return network.runUntil(network.now() + uint64_t(max(timeoutMs, 0)) * 1000000, [this] { return !inbox.empty(); });
+}
+
+ssize_t SimulatedTransport::receiveFrom(uint8_t* buffer, size_t length, sockaddr_in& from, uint64_t& kernelNs) {
+    if (inbox.empty()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    Arrival& arrival = inbox.front();
+    // Like recvfrom(), an oversized datagram is truncated
+    size_t n = min(length, arrival.data.size());
+    memcpy(buffer, arrival.data.data(), n);
+    from = arrival.from;
+    kernelNs = arrival.atNs;
+    inbox.pop_front();
+    return static_cast<ssize_t>(n);
+}
+
+SimulatedServer::SimulatedServer(SimulatedNetwork& network, uint16_t port, uint16_t timeoutMs, uint8_t retries)
+  : network(network), timeoutMs(timeoutMs), retries(retries) {
+    listen(port);
+}
+
+void SimulatedServer::listen(uint16_t port) {
+    network.bind(port, [this](const sockaddr_in& from, const vector<uint8_t>& data) { receive(from, data); });
+}
+
+void SimulatedServer::movePort() {
+    if (sendPort != 0) {
+        serverStats.portChanges++;
+    }
+    sendPort = nextPort++;
+    listen(sendPort);
+}
+
+void SimulatedServer::receive(const sockaddr_in& from, const vector<uint8_t>& data) {
+    if (data.size() < 3) {
+        return;
+    }
+    uint8_t type = data[0];
+    uint16_t msgId = (uint16_t(data[1]) << 8) | data[2];
+    if (type == ConfirmSpec::code) {
+        if (unconfirmed.erase(msgId) > 0) {
+            serverStats.pushConfirmed++;
+        }
+        return;
+    }
+
+    // The first contact moves the session to a dynamic port, everything is confirmed from there
+    client = from;
+    if (sendPort == 0) {
+        movePort();
+    }
+    auto confirm = ConfirmSpec::encodeUDP(msgId);
+    network.send(sendPort, client, confirm.data(), confirm.size());
+
+    serverStats.received++;
+    if (!seenIds.insert(msgId).second) {
+        serverStats.duplicates++;
+        return;
+    }
+    if (type == AuthSpec::code || type == JoinSpec::code) {
+        sendReliable(ReplySpec::encodeUDP(0, true, msgId, "OK"));
+    } else if (type == MsgSpec::code) {
+        // displayName \0 content \0
+        auto nameEnd = find(data.begin() + 3, data.end(), 0);
+        if (nameEnd == data.end()) {
+            return;
+        }
+        auto contentEnd = find(nameEnd + 1, data.end(), 0);
+        received.emplace_back(nameEnd + 1, contentEnd);
+        serverStats.messages++;
+        serverStats.contentBytes += received.back().size();
+    }
+}
+
+void SimulatedServer::push(string_view displayName, string_view content) {
+    sendReliable(MsgSpec::encodeUDP(0, displayName, content));
+}
+
+void SimulatedServer::sendReliable(vector<uint8_t> datagram) {
+    uint16_t msgId = nextMsgId++;
+    datagram[1] = static_cast<uint8_t>(msgId >> 8);
+    datagram[2] = static_cast<uint8_t>(msgId);
+    if (network.chance(network.getConditions().portChange)) {
+        movePort();
+    }
+    serverStats.pushed++;
+    network.send(sendPort, client, datagram.data(), datagram.size());
+    unconfirmed[msgId] = move(datagram);
+    network.schedule(network.now() + uint64_t(timeoutMs) * 1000000, [this, msgId] { retransmit(msgId, 1); });
+}
+
+void SimulatedServer::retransmit(uint16_t msgId, uint8_t attempt) {
+    auto it = unconfirmed.find(msgId);
+    if (it == unconfirmed.end()) {
+        return;
+    }
+    if (attempt > retries) {
+        serverStats.pushFailed++;
+        unconfirmed.erase(it);
+        return;
+    }
+    serverStats.retransmits++;
+    network.send(sendPort, client, it->second.data(), it->second.size());
+    network.schedule(network.now() + uint64_t(timeoutMs) * 1000000, [this, msgId, attempt] { retransmit(msgId, attempt + 1); });
+}
@@ -1,6 +1,7 @@
 #include "../inc/TCPClient.h"
+#include "../inc/Tracepoints.h"
 
-TCPClient::TCPClient(const ParsedArgs& args) :
+TCPClient::TCPClient(const SessionConfig& args) :
     ProtocolClient(args.host, args.port) {
     printf_debug("TCPClient: Constructing...");
 
@@ -26,6 +27,11 @@ TCPClient::TCPClient(const ParsedArgs& args) :
         throw runtime_error("ERROR: Connection failed");
     }
     printf_debug("TCPClient: Connected to %s:%d...", this->host.c_str(), this->port);
+    NetworkTuning::enableRxTimestamps(this->ip_socket);
+
+    if (!args.captureFile.empty()) {
+        capture = make_unique<TrafficCapture>(args.captureFile, ProtocolType::TCP);
+    }
 }
 
 TCPClient::~TCPClient() {
@@ -42,37 +48,119 @@ void TCPClient::stop() {
 }
 
 void TCPClient::sendMessage(unique_ptr<Message> message) {
-    string data = message->serialize();
-    printf_debug("Message: Sending message: m=%s", data.c_str());
-    if (send(this->ip_socket, data.c_str(), data.size(), 0) < 0) {
+    sendBuffer.clear();
+    message->serialize(sendBuffer);
+    printf_debug("Message: Sending message: m=%s", sendBuffer.c_str());
+    if (send(this->ip_socket, sendBuffer.data(), sendBuffer.size(), 0) < 0) {
         throw runtime_error("ERROR: Failed to send message");
     }
+    TRACE_PROBE(message_sent, static_cast<int>(message->getType()), -1, sendBuffer.size());
+}
+
+char* TCPFramer::prepare(size_t& space) {
+    // Everything pending lacks a CRLF, so its frame would be longer than this
+    if (end - start >= maxFrame) {
+        size_t length = end - start;
+        start = end = scanned = 0;
+        throw invalid_argument("TCP frame longer than " + to_string(maxFrame) + " bytes (" + to_string(length) + " without CRLF)");
+    }
+    if (start == end) {
+        start = end = scanned = 0;
+    } else if (start > 0 && buffer.size() - end < buffer.size() / 4) {
+        // Move the partial frame to the front, frames handed out before are dead by now
+        memmove(buffer.data(), buffer.data() + start, end - start);
+        end -= start;
+        scanned -= start;
+        start = 0;
+    }
+    if (end == buffer.size()) {
+        buffer.resize(min(buffer.size() * 2, start + maxFrame));
+    }
+    space = buffer.size() - end;
+    return buffer.data() + end;
+}
+
+void TCPFramer::append(const char* data, size_t length) {
+    while (length > 0) {
+        size_t space;
+        char* dest = prepare(space);
+        size_t chunk = min(space, length);
+        memcpy(dest, data, chunk);
+        commit(chunk);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+size_t TCPFramer::findFrameEnd() const {
+    size_t pos = max(start, scanned);
+    while (pos + 1 < end) {
+        const char* cr = static_cast<const char*>(memchr(buffer.data() + pos, '\r', end - pos - 1));
+        if (!cr) {
+            break;
+        }
+        pos = cr - buffer.data();
+        if (buffer[pos + 1] == '\n') {
+            return pos + 2;
+        }
+        pos++;
+    }
+    // A trailing '\r' may still get its '\n', rescan it next time
+    scanned = max(start, end > 0 ? end - 1 : 0);
+    return string_view::npos;
 }
 
-unique_ptr<Message> TCPClient::receiveMessage() {
-    printf_debug("TCPClient: Waiting for messages...");
-    string msgStr;
-    char buffer[70000];
-    while (true) {
-        ssize_t bytesRead = recv(this->ip_socket, buffer, sizeof(buffer) - 1, 0);
+bool TCPFramer::next(string_view& frame) {
+    size_t frameEnd = findFrameEnd();
+    if (frameEnd == string_view::npos) {
+        return false;
+    }
+    frame = string_view(buffer.data() + start, frameEnd - start);
+    start = scanned = frameEnd;
+    return true;
+}
+
+bool TCPClient::receiveView(MessageView& view) {
+    string_view frame;
+    // One recv() may carry several frames or only part of one, the remainder stays in the framer.
+    // Buffered frames were completed by the latest recv(), so its timestamps apply to them.
+    // Never blocks: with only part of a frame buffered the caller polls the socket again
+    while (!framer.next(frame)) {
+        size_t space;
+        char* dest = framer.prepare(space);
+        uint64_t kernelNs;
+        ssize_t bytesRead = NetworkTuning::receiveTimestamped(this->ip_socket, dest, space, MSG_DONTWAIT, nullptr, nullptr, kernelNs);
         if (bytesRead < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
             if (errno == EINTR || errno == EBADF) {
                 // Interrupted or socket closed: treat as shutdown
-                return nullptr;
+                return false;
             }
             throw runtime_error("ERROR: Failed to receive message");
         }
         if (bytesRead == 0) {
             // Server closed connection gracefully
-            return nullptr;
+            stop();
+            return false;
         }
-        msgStr.append(buffer, static_cast<size_t>(bytesRead));
-        printf_debug("TCPClient: Received chunk: %.*s", static_cast<int>(bytesRead), buffer);
-        // Continue until message ends with CRLF
-        if (msgStr.size() >= 2 && msgStr.compare(msgStr.size() - 2, 2, "\r\n") == 0) {
-            break;
+        stampReceive(kernelNs);
+        TRACE_PROBE(frame_received, 0, bytesRead, kernelNs);
+        if (capture) {
+            capture->recordInbound(dest, static_cast<size_t>(bytesRead));
         }
+        framer.commit(static_cast<size_t>(bytesRead));
+        printf_debug("TCPClient: Received chunk: %.*s", static_cast<int>(bytesRead), dest);
+    }
+    printf_debug("TCPClient: Complete message: %.*s", static_cast<int>(frame.size()), frame.data());
+    uint32_t frameIndex = framesParsed++;
+    try {
+        view = MessageFactory::parseView(frame);
+    } catch (const exception&) {
+        if (capture) capture->recordOutcome(frameIndex, TrafficCapture::OUTCOME_ERROR);
+        throw;
     }
-    printf_debug("TCPClient: Complete message: %s", msgStr.c_str());
-    return MessageFactory::parseMessage(msgStr);
+    if (capture) capture->recordOutcome(frameIndex, TrafficCapture::outcomeCode(view.getType()));
+    return true;
 }
@@ -0,0 +1,178 @@
+#include "../inc/TimerWheel.h"
+
+#include <algorithm>
+#include <climits>
+#include <ctime>
+
+TimerWheel::TimerWheel(uint64_t nowNs, size_t capacity) : currentTick(nowNs / TICK_NS) {
+    for (uint32_t& head : heads) {
+        head = NONE;
+    }
+    nodes.reserve(capacity);
+}
+
+uint64_t TimerWheel::now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+TimerWheel::Handle TimerWheel::schedule(uint64_t deadlineNs, uint64_t cookie) {
+    uint32_t index = freeHead;
+    if (index != NONE) {
+        freeHead = nodes[index].next;
+    } else {
+        // The pool only grows (by doubling), released nodes are reused
+        index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    Node& node = nodes[index];
+    node.tick = deadlineNs / TICK_NS + (deadlineNs % TICK_NS != 0);
+    node.cookie = cookie;
+    count++;
+    file(index);
+    return (uint64_t(node.generation) << 32) | (index + 1);
+}
+
+bool TimerWheel::cancel(Handle handle) {
+    uint32_t index = static_cast<uint32_t>(handle) - 1;
+    if (handle == 0 || index >= nodes.size()) {
+        return false;
+    }
+    Node& node = nodes[index];
+    if (node.list == FREE || node.generation != static_cast<uint32_t>(handle >> 32)) {
+        return false;
+    }
+    unlink(index);
+    release(index);
+    return true;
+}
+
+int TimerWheel::timeoutMs(uint64_t nowNs) const {
+    if (count == 0) {
+        return -1;
+    }
+    if (heads[DUE_LIST] != NONE) {
+        return 0;
+    }
+    uint64_t eventNs = nextEventTick() * TICK_NS;
+    if (eventNs <= nowNs) {
+        return 0;
+    }
+    uint64_t ms = (eventNs - nowNs + 999999) / 1000000;
+    return ms > INT_MAX ? INT_MAX : static_cast<int>(ms);
+}
+
+void TimerWheel::file(uint32_t index) {
+    Node& node = nodes[index];
+    if (node.tick < currentTick) {
+        link(index, DUE_LIST);
+        return;
+    }
+    // The highest 8-bit group in which the deadline differs from now picks the level
+    uint64_t differs = node.tick ^ currentTick;
+    if (differs >> (LEVELS * SLOT_BITS)) {
+        link(index, OVERFLOW_LIST);
+        return;
+    }
+    uint32_t level = differs == 0 ? 0 : (63 - __builtin_clzll(differs)) / SLOT_BITS;
+    uint32_t slot = (node.tick >> (level * SLOT_BITS)) & (SLOTS - 1);
+    link(index, level * SLOTS + slot);
+}
+
+void TimerWheel::link(uint32_t index, uint32_t list) {
+    Node& node = nodes[index];
+    node.list = list;
+    node.prev = NONE;
+    node.next = heads[list];
+    if (node.next != NONE) {
+        nodes[node.next].prev = index;
+    }
+    heads[list] = index;
+    if (list < OVERFLOW_LIST) {
+        occupied[list / SLOTS][(list % SLOTS) / 64] |= 1ULL << (list % 64);
+    }
+}
+
+void TimerWheel::unlink(uint32_t index) {
+    Node& node = nodes[index];
+    if (node.prev != NONE) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[node.list] = node.next;
+        if (node.next == NONE && node.list < OVERFLOW_LIST) {
+            occupied[node.list / SLOTS][(node.list % SLOTS) / 64] &= ~(1ULL << (node.list % 64));
+        }
+    }
+    if (node.next != NONE) {
+        nodes[node.next].prev = node.prev;
+    }
+}
+
+void TimerWheel::release(uint32_t index) {
+    Node& node = nodes[index];
+    node.list = FREE;
+    node.generation++;
+    node.next = freeHead;
+    freeHead = index;
+    count--;
+}
+
+void TimerWheel::moveList(uint32_t from) {
+    uint32_t index = heads[from];
+    heads[from] = NONE;
+    if (from < OVERFLOW_LIST) {
+        occupied[from / SLOTS][(from % SLOTS) / 64] &= ~(1ULL << (from % 64));
+    }
+    while (index != NONE) {
+        uint32_t next = nodes[index].next;
+        file(index);
+        index = next;
+    }
+}
+
+void TimerWheel::collect() {
+    if ((currentTick & ((1ULL << (LEVELS * SLOT_BITS)) - 1)) == 0) {
+        moveList(OVERFLOW_LIST);
+    }
+    // Top down, so a timer cascading several levels at once ends in the slot of its own level
+    for (uint32_t level = LEVELS - 1; level > 0; --level) {
+        uint32_t shift = level * SLOT_BITS;
+        if ((currentTick & ((1ULL << shift) - 1)) == 0) {
+            moveList(level * SLOTS + ((currentTick >> shift) & (SLOTS - 1)));
+        }
+    }
+    // Everything left in the current level-0 slot is due exactly now
+    uint32_t slot = currentTick & (SLOTS - 1);
+    while (heads[slot] != NONE) {
+        uint32_t index = heads[slot];
+        unlink(index);
+        link(index, FIRING_LIST);
+    }
+}
+
+uint64_t TimerWheel::nextEventTick() const {
+    // Late timers (DUE_LIST) are not on the wheel
+    uint64_t next = UINT64_MAX;
+    if (heads[OVERFLOW_LIST] != NONE) {
+        uint64_t span = 1ULL << (LEVELS * SLOT_BITS);
+        next = (currentTick & (span - 1)) == 0 ? currentTick : (currentTick / span + 1) * span;
+    }
+    // A level's timers all lie ahead in its current rotation, so its next slot is found without wrapping
+    for (uint32_t level = 0; level < LEVELS; ++level) {
+        uint32_t shift = level * SLOT_BITS;
+        uint32_t from = (currentTick >> shift) & (SLOTS - 1);
+        uint32_t word = from / 64;
+        uint64_t bits = occupied[level][word] & (~0ULL << (from % 64));
+        while (bits == 0 && ++word < SLOTS / 64) {
+            bits = occupied[level][word];
+        }
+        if (bits == 0) {
+            continue;
+        }
+        uint64_t slot = word * 64 + __builtin_ctzll(bits);
+        uint64_t rotation = currentTick >> (shift + SLOT_BITS) << (shift + SLOT_BITS);
+        next = min(next, rotation | (slot << shift));
+    }
+    return next;
+}
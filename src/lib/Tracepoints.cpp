@@ -0,0 +1,15 @@
+#include "../inc/Tracepoints.h"
+
+#ifdef _SDT_HAS_SEMAPHORES
+// Zero until a tracer attaches, perf and bpftrace find them through the .probes section
+extern "C" {
+__attribute__((section(".probes"))) TRACE_SEMAPHORE(frame_received) = 0;
+__attribute__((section(".probes"))) TRACE_SEMAPHORE(frame_parsed) = 0;
+__attribute__((section(".probes"))) TRACE_SEMAPHORE(message_sent) = 0;
+__attribute__((section(".probes"))) TRACE_SEMAPHORE(confirm_matched) = 0;
+__attribute__((section(".probes"))) TRACE_SEMAPHORE(retransmit) = 0;
+__attribute__((section(".probes"))) TRACE_SEMAPHORE(duplicate_dropped) = 0;
+__attribute__((section(".probes"))) TRACE_SEMAPHORE(reply_correlated) = 0;
+__attribute__((section(".probes"))) TRACE_SEMAPHORE(output_flushed) = 0;
+}
+#endif
@@ -0,0 +1,106 @@
+#include "../inc/TrafficCapture.h"
+
+static const char CAPTURE_MAGIC[6] = {'I', 'P', 'K', 'C', 'A', 'P'};
+
+static void putLE(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static uint64_t getLE(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= uint64_t(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+TrafficCapture::TrafficCapture(const string& path, ProtocolType proto) : proto(proto) {
+    printf_debug("TrafficCapture: Opening %s", path.c_str());
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw runtime_error("ERROR: Unable to open capture file " + path);
+    }
+    uint8_t header[8];
+    memcpy(header, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header[6] = VERSION;
+    header[7] = proto == ProtocolType::TCP ? 0 : 1;
+    fwrite(header, 1, sizeof(header), file);
+}
+
+TrafficCapture::~TrafficCapture() {
+    printf_debug("TrafficCapture: Closing after %u inbound records", inboundCount);
+    if (file) {
+        fclose(file);
+    }
+}
+
+uint64_t TrafficCapture::now() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint32_t TrafficCapture::recordInbound(const void* data, size_t length) {
+    lock_guard<mutex> guard(lock);
+    writeRecord(proto == ProtocolType::TCP ? CaptureRecordKind::TCP_CHUNK : CaptureRecordKind::UDP_DATAGRAM, data, length);
+    return inboundCount++;
+}
+
+void TrafficCapture::recordOutcome(uint32_t frameIndex, uint8_t outcome) {
+    uint8_t payload[5];
+    putLE(payload, frameIndex, 4);
+    payload[4] = outcome;
+    lock_guard<mutex> guard(lock);
+    writeRecord(CaptureRecordKind::OUTCOME, payload, sizeof(payload));
+}
+
+void TrafficCapture::writeRecord(CaptureRecordKind kind, const void* data, size_t length) {
+    uint8_t header[13];
+    header[0] = static_cast<uint8_t>(kind);
+    putLE(header + 1, now(), 8);
+    putLE(header + 9, length, 4);
+    fwrite(header, 1, sizeof(header), file);
+    fwrite(data, 1, length, file);
+    fflush(file);
+}
+
+CaptureReader::CaptureReader(const string& path) {
+    file = fopen(path.c_str(), "rb");
+    if (!file) {
+        throw runtime_error("ERROR: Unable to open capture file " + path);
+    }
+    uint8_t header[8];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+        fclose(file);
+        throw runtime_error("ERROR: Not an ipk25chat capture file: " + path);
+    }
+    if (header[6] != TrafficCapture::VERSION) {
+        fclose(file);
+        throw runtime_error("ERROR: Unsupported capture version " + to_string(header[6]));
+    }
+    proto = header[7] == 0 ? ProtocolType::TCP : ProtocolType::UDP;
+}
+
+CaptureReader::~CaptureReader() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool CaptureReader::next(CaptureRecord& record) {
+    uint8_t header[13];
+    size_t got = fread(header, 1, sizeof(header), file);
+    if (got == 0) {
+        return false;
+    }
+    if (got != sizeof(header)) {
+        throw runtime_error("ERROR: Truncated capture record header");
+    }
+    record.kind = static_cast<CaptureRecordKind>(header[0]);
+    record.timestampNs = getLE(header + 1, 8);
+    record.payload.resize(getLE(header + 9, 4));
+    if (fread(record.payload.data(), 1, record.payload.size(), file) != record.payload.size()) {
+        throw runtime_error("ERROR: Truncated capture record payload");
+    }
+    return true;
+}
@@ -1,31 +1,30 @@
 #include "../inc/UDPClient.h"
+#include "../inc/Tracepoints.h"
 
-UDPClient::UDPClient(const ParsedArgs& args)
+UDPClient::UDPClient(const SessionConfig& args, unique_ptr<DatagramTransport> transport)
   : ProtocolClient(args.host, args.port),
+    transport(move(transport)),
     timeout(args.timeout),
     retries(args.retries),
     nextMsgId(1)
 {
     printf_debug("UDPClient: Constructing...");
-    ip_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (ip_socket < 0)
-        throw runtime_error("ERROR: Unable to create UDP socket");
-
     // Initialize serverAddr from the command‑line host/port
     memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_port   = htons(this->port);
     if (inet_pton(AF_INET, this->host.c_str(), &serverAddr.sin_addr) <= 0) {
-        close(ip_socket);
         throw runtime_error("ERROR: Invalid UDP address");
     }
 
-    // Apply receive timeout
-    struct timeval tv{};
-    tv.tv_sec  = timeout / 1000;
-    tv.tv_usec = (timeout % 1000) * 1000;
-    if (setsockopt(ip_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
-        perror("Warning: could not set UDP receive timeout");
+    if (!this->transport) {
+        this->transport = make_unique<SocketTransport>(args.receiveBufferMax);
+    }
+    ip_socket = this->transport->fd();
+
+    if (!args.captureFile.empty()) {
+        capture = make_unique<TrafficCapture>(args.captureFile, ProtocolType::UDP);
+    }
 }
 
 UDPClient::~UDPClient() {
@@ -35,46 +34,102 @@ UDPClient::~UDPClient() {
 
 void UDPClient::stop() {
     printf_debug("UDPClient: Stopping...");
+    // The transport owns the descriptor
     if (ip_socket) {
-        close(ip_socket);
+        transport->close();
         ip_socket = 0;
     }
 }
 
 void UDPClient::sendMessage(unique_ptr<Message> message) {
-    waitingForConfirm.store(true, std::memory_order_release);
     uint16_t msgId = nextMsgId++;
-    auto buf = message->serializeUDP(msgId);
+    lastSentId = msgId;
+    vector<uint8_t>& buf = sendBuffer;
+    buf.clear();
+    message->serializeUDP(buf, msgId);
+    if (!transport->isConnected() && (message->getType() == MessageType::AUTH || message->getType() == MessageType::JOIN)) {
+        requestIds[nextRequestSlot++ % requestIds.size()] = msgId;
+    }
+    TRACE_PROBE(message_sent, static_cast<int>(message->getType()), msgId, buf.size());
+    transmit(msgId, 0, preempt && message->getType() == MessageType::MSG);
+}
 
-    for (int attempt = 0; attempt <= retries; ++attempt) {
+void UDPClient::resumeParked() {
+    if (!parked.active) {
+        return;
+    }
+    parked.active = false;
+    if (parked.confirmed) {
+        printf_debug("UDPClient: Parked %u was confirmed meanwhile", parked.msgId);
+        return;
+    }
+    swap(sendBuffer, parkedBuffer);
+    transmit(parked.msgId, parked.nextAttempt, true);
+}
+
+void UDPClient::transmit(uint16_t msgId, int firstAttempt, bool preemptible) {
+    const vector<uint8_t>& buf = sendBuffer;
+    for (int attempt = firstAttempt; attempt <= retries; ++attempt) {
+        if (attempt > 0) {
+            if (preemptible && preempt()) {
+                printf_debug("UDPClient: Parking %u before retry %d, control traffic first", msgId, attempt);
+                parked = {true, false, msgId, attempt};
+                swap(sendBuffer, parkedBuffer);
+                return;
+            }
+            retransmitCount++;
+            TRACE_PROBE(retransmit, msgId, attempt, buf.size());
+        }
         // Send to whatever serverAddr currently holds
-        ssize_t sent = sendto(ip_socket, buf.data(), buf.size(), 0,
-                              reinterpret_cast<sockaddr*>(&serverAddr),
-                              sizeof(serverAddr));
+        uint64_t sentAt = transport->wallClockNs();
+        ssize_t sent = transport->sendTo(buf.data(), buf.size(), serverAddr);
         if (sent < 0)
             throw runtime_error("ERROR: UDP send failed");
 
-        // Await CONFIRM from server (possibly on new port)
-        uint8_t respBuf[65536];
-        sockaddr_in peer{};
-        socklen_t addrLen = sizeof(peer);
-        ssize_t n = recvfrom(ip_socket, respBuf, sizeof(respBuf), 0,
-                             reinterpret_cast<sockaddr*>(&peer), &addrLen);
-        if (n < 0) {
-            printf_debug("UDPClient: No CONFIRM, retry %d", attempt+1);
-            continue;
-        }
-
-        // Server may now be on a different port; update it
-        serverAddr = peer;
-
-        // Check for our CONFIRM
-        if (respBuf[0] == 0) {
-            uint16_t rid = (uint16_t(respBuf[1])<<8) | respBuf[2];
-            if (rid == msgId) {
-                printf_debug("UDPClient: Got CONFIRM for %u", msgId);
-                waitingForConfirm.store(false, std::memory_order_release);
-                return;
+        // Await CONFIRM from server (possibly on new port) for the whole timeout,
+        // server messages arriving meanwhile are confirmed immediately and kept for receiveView()
+        uint64_t deadline = transport->monotonicNs() + uint64_t(timeout) * 1000000;
+        while (true) {
+            uint64_t now = transport->monotonicNs();
+            // Round up, so a sub-millisecond remainder doesn't turn into a busy loop
+            int remaining = now < deadline ? static_cast<int>((deadline - now + 999999) / 1000000) : 0;
+            if (remaining <= 0 || !transport->wait(remaining)) {
+                printf_debug("UDPClient: No CONFIRM, retry %d", attempt+1);
+                break;
+            }
+            sockaddr_in peer{};
+            uint64_t kernelNs;
+            ssize_t n = transport->receiveFrom(recvBuffer.data(), recvBuffer.size(), peer, kernelNs);
+            if (n < 0) {
+                continue;
+            }
+            if (!fromServer(peer)) {
+                continue;
+            }
+            stampReceive(kernelNs, transport->wallClockNs());
+            TRACE_PROBE(frame_received, 1, n, kernelNs);
+            const uint8_t* respBuf = recvBuffer.data();
+            size_t length = static_cast<size_t>(n);
+            uint32_t frameIndex = capture ? capture->recordInbound(respBuf, length) : 0;
+
+            // Check for our CONFIRM
+            if (length >= 3 && respBuf[0] == ConfirmSpec::code) {
+                uint16_t rid = (uint16_t(respBuf[1])<<8) | respBuf[2];
+                if (rid == msgId) {
+                    printf_debug("UDPClient: Got CONFIRM for %u", msgId);
+                    if (profile) {
+                        profile->record(LatencyStage::CONFIRM_RTT, receiveTimes.userNs - sentAt);
+                    }
+                    TRACE_PROBE(confirm_matched, msgId, receiveTimes.userNs - sentAt, attempt);
+                    return;
+                }
+                if (parked.active && rid == parked.msgId) {
+                    parked.confirmed = true;
+                }
+                continue;
+            }
+            if (acknowledge(respBuf, length, peer)) {
+                pendingDatagrams.push_back({vector<uint8_t>(respBuf, respBuf + length), frameIndex, receiveTimes});
             }
         }
     }
@@ -82,44 +137,109 @@ void UDPClient::sendMessage(unique_ptr<Message> message) {
     throw runtime_error("ERROR: No CONFIRM after retries");
 }
 
-unique_ptr<Message> UDPClient::receiveMessage() {
-    if (waitingForConfirm.load(std::memory_order_acquire)) {
-        return nullptr;
-    }
-    uint8_t buf[70000] = {0};
-    sockaddr_in peer{};
-    socklen_t addrLen = sizeof(peer);
-    ssize_t n = recvfrom(ip_socket, buf, sizeof(buf), 0,
-                         reinterpret_cast<sockaddr*>(&peer), &addrLen);
-    if (n < 0) {
-        return nullptr;
-        // throw runtime_error("ERROR: UDP receive failed or timed out");
+bool UDPClient::fromServer(const sockaddr_in& peer) {
+    if (transport->isConnected() || peer.sin_addr.s_addr == serverAddr.sin_addr.s_addr) {
+        return true;
     }
+    strayCount++;
+    printf_debug("UDPClient: Dropping datagram from foreign host %s", inet_ntoa(peer.sin_addr));
+    return false;
+}
 
-    printf_debug("UDPClient: Received %zd bytes", n);
-    serverAddr = peer;   // adopt any new server port
-
+bool UDPClient::acknowledge(const uint8_t* buf, size_t length, const sockaddr_in& peer) {
+    // Too short for a header: leave the error to the parser
+    if (length < 3) {
+        return true;
+    }
     uint8_t type = buf[0];
     uint16_t mid = (uint16_t(buf[1])<<8) | buf[2];
 
-    // ACK every non‑CONFIRM packet
-    if (type != 0) {
-        ConfirmMessage ack;
-        auto ackBuf = ack.serializeUDP(mid);
-        sendto(ip_socket, ackBuf.data(), ackBuf.size(), 0,
-               reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr));
-        printf_debug("UDPClient: Sent CONFIRM for incoming %u", mid);
+    // Don’t expose CONFIRM frames up
+    if (type == ConfirmSpec::code) {
+        return false;
     }
 
+    // ACK every non‑CONFIRM packet, duplicates included, the server may have lost our first CONFIRM
+    confirmBuffer.clear();
+    ConfirmSpec::encodeUDP(confirmBuffer, mid);
+    transport->sendTo(confirmBuffer.data(), confirmBuffer.size(), peer);
+    if (receiveTimes.kernelNs != 0) {
+        uint64_t nowNs = transport->wallClockNs();
+        confirmStats.add(nowNs > receiveTimes.kernelNs ? nowNs - receiveTimes.kernelNs : 0);
+    }
+    printf_debug("UDPClient: Sent CONFIRM for incoming %u", mid);
+
     // Drop duplicate messages
-    if (type != 0 && !receivedMsgIds.insert(mid).second) {
+    if (receivedMsgIds.test(mid)) {
         printf_debug("UDPClient: Duplicate %u, dropping", mid);
-        return nullptr;
+        TRACE_PROBE(duplicate_dropped, mid, type);
+        return false;
     }
+    receivedMsgIds.set(mid);
+
+    // REPLY | MessageID | Result | Ref_MessageID: only a reply to a request we actually sent fixes the server port
+    if (!transport->isConnected() && type == ReplySpec::code && length >= 6) {
+        uint16_t refId = (uint16_t(buf[4])<<8) | buf[5];
+        if (refId >= 1 && find(requestIds.begin(), requestIds.end(), refId) != requestIds.end()) {
+            serverAddr = peer;
+            if (transport->connect(serverAddr)) {
+                printf_debug("UDPClient: Server port %u learned, socket connected", ntohs(peer.sin_port));
+                requestIds.fill(0);
+            } else {
+                printf_debug("UDPClient: Server port %u learned, staying unconnected", ntohs(peer.sin_port));
+            }
+        }
+    }
+    return true;
+}
 
-    // Don’t expose CONFIRM frames up
-    if (type == 0) return nullptr;
+bool UDPClient::deliver(MessageView& view, size_t length, uint32_t frameIndex) {
+    try {
+        view = MessageFactory::parseUDPView(recvBuffer.data(), length);
+    } catch (const exception&) {
+        if (capture) capture->recordOutcome(frameIndex, TrafficCapture::OUTCOME_ERROR);
+        throw;
+    }
+    if (capture) capture->recordOutcome(frameIndex, TrafficCapture::outcomeCode(view.getType()));
+    return true;
+}
+
+bool UDPClient::receiveView(MessageView& view) {
+    // Datagrams land in the member buffer, the returned view points into it
+    if (!pendingDatagrams.empty()) {
+        PendingDatagram& pending = pendingDatagrams.front();
+        size_t length = pending.data.size();
+        uint32_t frameIndex = pending.frameIndex;
+        receiveTimes = pending.times;
+        memcpy(recvBuffer.data(), pending.data.data(), length);
+        pendingDatagrams.pop_front();
+        return deliver(view, length, frameIndex);
+    }
+
+    if (!transport->wait(timeout)) {
+        return false;
+    }
+    sockaddr_in peer{};
+    uint64_t kernelNs;
+    ssize_t n = transport->receiveFrom(recvBuffer.data(), recvBuffer.size(), peer, kernelNs);
+    if (n < 0) {
+        return false;
+        // throw runtime_error("ERROR: UDP receive failed or timed out");
+    }
+    if (!fromServer(peer)) {
+        return false;
+    }
+    stampReceive(kernelNs, transport->wallClockNs());
+    TRACE_PROBE(frame_received, 1, n, kernelNs);
+
+    printf_debug("UDPClient: Received %zd bytes", n);
+    size_t length = static_cast<size_t>(n);
+    uint32_t frameIndex = capture ? capture->recordInbound(recvBuffer.data(), length) : 0;
+
+    if (!acknowledge(recvBuffer.data(), length, peer)) {
+        return false;
+    }
 
     // Parse and return all others
-    return MessageFactory::parseUDP(buf, static_cast<size_t>(n));
+    return deliver(view, length, frameIndex);
 }
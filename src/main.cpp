@@ -3,24 +3,42 @@
 
 #include <iostream>
 #include <csignal>
+#include <memory>
 
 using namespace std;
 
 static InputHandler* globalHandler = nullptr;
 
 void signal_handler(int signal) {
-    if (signal == SIGINT && globalHandler) {
-        globalHandler->stop();
-        cout << "\nProgram interrupted. Closing..." << endl << flush;
-        exit(EXIT_SUCCESS);
+    if (signal == SIGUSR1 && globalHandler) {
+        globalHandler->requestStats();
+        return;
+    }
+    if ((signal == SIGINT || signal == SIGTERM) && globalHandler) {
+        // Only flag it here, run() sends BYE and prints the notice outside of signal context
+        globalHandler->interrupt();
     }
 }
 
 int main(int argc, char* argv[]) {
-    InputHandler handler(ArgHandler::parse(argc, argv));
+    // A broken filter file or a failed connection ends the program before any input is read
+    unique_ptr<InputHandler> startup;
+    try {
+        startup = make_unique<InputHandler>(ArgHandler::parse(argc, argv));
+    } catch (const exception& e) {
+        cout << e.what() << "\n" << flush;
+        return EXIT_FAILURE;
+    }
+    InputHandler& handler = *startup;
     globalHandler = &handler;
     signal(SIGINT, signal_handler);
-    handler.run();
+    signal(SIGUSR1, signal_handler);
+    if (handler.daemonMode()) {
+        signal(SIGTERM, signal_handler);
+        handler.serve();
+    } else {
+        handler.run();
+    }
 
     return 0;
 }
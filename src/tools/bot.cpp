@@ -0,0 +1,98 @@
+#include "../inc/ChatSession.h"
+
+#include <csignal>
+#include <iostream>
+
+using namespace std;
+
+// Example of embedding libipk25chat: joins a channel and answers "!ping" with "pong", "!echo <text>" with the text
+
+// Echoes are skipped while the outbound queue is further behind, a flood of "!echo" must not delay the answers for minutes
+static constexpr uint64_t MAX_QUEUE_DELAY_NS = 2000000000;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void printUsage() {
+    cout << "Usage: ./ipk25chat-bot -t <tcp|udp> -s <host> -u <username> -k <secret> [-n name] [-c channel] [-p port]\n"
+        << "Options:\n"
+        << "  -n <name>       Display name (default: bot)\n"
+        << "  -c <channel>    Channel to join after authenticating\n"
+        << "  -p <port>       Server port (default: 4567)\n"
+        << flush;
+}
+
+int main(int argc, char* argv[]) {
+    SessionConfig config;
+    config.proto = ProtocolType::TCP;
+    string username, secret, name = "bot", channel;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "-t") {
+            config.proto = value == "udp" ? ProtocolType::UDP : ProtocolType::TCP;
+        } else if (option == "-s") {
+            config.host = value;
+        } else if (option == "-p") {
+            config.port = static_cast<uint16_t>(stoi(value));
+        } else if (option == "-u") {
+            username = value;
+        } else if (option == "-k") {
+            secret = value;
+        } else if (option == "-n") {
+            name = value;
+        } else if (option == "-c") {
+            channel = value;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (config.host.empty() || username.empty() || secret.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    ChatSession* active = nullptr;
+    uint32_t authRequest = 0;
+    SessionCallbacks callbacks;
+    callbacks.onMessage = [&](const Message& msg, const MessageInfo& info) {
+        if (msg.getType() == MessageType::REPLY) {
+            bool success = static_cast<const ReplyMessage&>(msg).isSuccess();
+            cerr << (success ? "Request " : "Request refused ") << info.request << "\n";
+            if (info.request == authRequest && success && !channel.empty()) {
+                active->join(channel);
+            }
+            return;
+        }
+        if (msg.getType() != MessageType::MSG) {
+            return;
+        }
+        string_view content = get<1>(static_cast<const MsgMessage&>(msg).fields());
+        if (content == "!ping") {
+            active->send("pong");
+        } else if (content.starts_with("!echo ")) {
+            if (active->queueDelayNs() > MAX_QUEUE_DELAY_NS) {
+                cerr << "Outbound queue " << active->queueDelayNs() / 1000000 << " ms behind, echo skipped\n";
+                return;
+            }
+            active->send(content.substr(6));
+        }
+    };
+    callbacks.onRequestTimeout = [](uint32_t request) { cerr << "Request " << request << " got no REPLY\n"; };
+    callbacks.onError = [](const string& error) { cerr << error << "\n"; };
+
+    try {
+        ChatSession session(config, move(callbacks));
+        active = &session;
+        signal(SIGINT, [](int) { interrupted = 1; });
+        authRequest = session.auth(username, secret, name);
+        // The session's eventFd() could join an existing event loop instead
+        while (!interrupted && session.runOnce(100)) {
+        }
+        session.close();
+    } catch (const exception& e) {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Builds every configuration and compares binary size and workload time against release.
+# Usage: ./src/tools/build_report.sh [runs]   (run from the project root, best of [runs] timings, default 3)
+set -e
+
+RUNS=${1:-3}
+CONFIGS="debug release lto profile pgo"
+JOBS=$(nproc 2>/dev/null || echo 4)
+
+for config in $CONFIGS; do
+    if [ "$config" = pgo ]; then
+        make --no-print-directory -j"$JOBS" pgo > /dev/null
+    else
+        make --no-print-directory -j"$JOBS" CONFIG="$config" "build/$config/ipk25chat-client" "build/$config/ipk25chat-workload" > /dev/null
+    fi
+done
+# Leave the release binaries in the project root
+make --no-print-directory CONFIG=release all workload > /dev/null
+
+best_total() {
+    best=""
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        total=$("$1" | awk '$1 == "total" { print $2 }')
+        if [ -z "$best" ] || awk -v a="$total" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+            best=$total
+        fi
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+base_size=$(stat -c %s build/release/ipk25chat-client)
+base_text=$(size build/release/ipk25chat-client | awk 'NR == 2 { print $1 }')
+base_time=$(best_total build/release/ipk25chat-workload)
+
+printf "%-8s %12s %8s %12s %8s %14s %8s\n" config "size [B]" delta "text [B]" delta "workload [ms]" delta
+for config in $CONFIGS; do
+    binary=build/$config/ipk25chat-client
+    file_size=$(stat -c %s "$binary")
+    text=$(size "$binary" | awk 'NR == 2 { print $1 }')
+    if [ "$config" = release ]; then
+        time=$base_time
+    else
+        time=$(best_total "build/$config/ipk25chat-workload")
+    fi
+    awk -v c="$config" -v s="$file_size" -v bs="$base_size" -v t="$text" -v bt="$base_text" -v w="$time" -v bw="$base_time" \
+        'BEGIN { printf "%-8s %12d %+7.1f%% %12d %+7.1f%% %14.1f %+7.1f%%\n", c, s, (s - bs) * 100 / bs, t, (t - bt) * 100 / bt, w, (w - bw) * 100 / bw }'
+done
@@ -0,0 +1,225 @@
+#include "../inc/SimulatedNetwork.h"
+#include "../inc/UDPClient.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+struct SweepResult {
+    uint64_t delivered = 0;     // Distinct MSGs the server got
+    uint64_t failed = 0;        // sendMessage() gave up after the retries
+    uint64_t retransmits = 0;
+    uint64_t duplicates = 0;    // Copies the server had to drop
+    uint64_t strays = 0;        // Injected datagrams from a foreign port the client never saw
+    double virtualSeconds = 0;
+    double wallSeconds = 0;
+};
+
+static void printUsage() {
+    cout << "Usage: ./ipk25chat-netsim [-n messages] [-b bytes] [-l loss,...] [-u dup] [-o reorder] [-j jitter] [-c change]\n"
+        << "                          [-x stray] [-d timeout] [-r retries] [-s seed] [-k count]\n"
+        << "Options:\n"
+        << "  -n <count>      Messages per loss rate (default: 2000)\n"
+        << "  -b <bytes>      Content length of each message (default: 100)\n"
+        << "  -l <rates>      Comma separated loss probabilities (default: 0,0.01,0.05,0.1,0.2,0.3,0.4,0.5)\n"
+        << "  -u <prob>       Duplication probability (default: 0)\n"
+        << "  -o <prob>       Reordering probability (default: 0)\n"
+        << "  -j <ms>         Jitter on top of the 1 ms one-way delay (default: 0)\n"
+        << "  -c <prob>       Probability the server changes its port before a message (default: 0)\n"
+        << "  -x <prob>       Probability of a stray datagram from a foreign port after each message (default: 0)\n"
+        << "  -d <ms>         Client and server CONFIRM timeout (default: 250)\n"
+        << "  -r <count>      Client and server retransmissions (default: 3)\n"
+        << "  -s <seed>       Random seed (default: 1)\n"
+        << "  -k <count>      Instead, time <count> loopback round trips on real sockets, unconnected vs connected\n"
+        << flush;
+}
+
+// One datagram each way per round, so both the send and the receive side are measured
+static double socketRoundTrip(int count, bool connected) {
+    int a = socket(AF_INET, SOCK_DGRAM, 0);
+    int b = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addrA = SimulatedNetwork::address(0);
+    sockaddr_in addrB = SimulatedNetwork::address(0);
+    socklen_t length = sizeof(sockaddr_in);
+    bind(a, reinterpret_cast<sockaddr*>(&addrA), sizeof(addrA));
+    bind(b, reinterpret_cast<sockaddr*>(&addrB), sizeof(addrB));
+    getsockname(a, reinterpret_cast<sockaddr*>(&addrA), &length);
+    getsockname(b, reinterpret_cast<sockaddr*>(&addrB), &length);
+    if (connected) {
+        connect(a, reinterpret_cast<sockaddr*>(&addrB), sizeof(addrB));
+        connect(b, reinterpret_cast<sockaddr*>(&addrA), sizeof(addrA));
+    }
+
+    auto datagram = MsgSpec::encodeUDP(1, "bench", string(100, 'x'));
+    uint8_t buffer[2048];
+    sockaddr_in from{};
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        if (connected) {
+            send(a, datagram.data(), datagram.size(), 0);
+            recv(b, buffer, sizeof(buffer), 0);
+            send(b, datagram.data(), datagram.size(), 0);
+            recv(a, buffer, sizeof(buffer), 0);
+        } else {
+            sendto(a, datagram.data(), datagram.size(), 0, reinterpret_cast<sockaddr*>(&addrB), sizeof(addrB));
+            length = sizeof(from);
+            recvfrom(b, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &length);
+            sendto(b, datagram.data(), datagram.size(), 0, reinterpret_cast<sockaddr*>(&addrA), sizeof(addrA));
+            length = sizeof(from);
+            recvfrom(a, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &length);
+        }
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    close(a);
+    close(b);
+    return ns / count;
+}
+
+static void socketBenchmark(int count) {
+    cout << count << " loopback round trips, 2 datagrams each\n" << fixed << setprecision(0);
+    // Warm up, then alternate so frequency scaling hits both alike
+    socketRoundTrip(count / 10 + 1, false);
+    double unconnected = 0, connected = 0;
+    for (int pass = 0; pass < 3; ++pass) {
+        unconnected += socketRoundTrip(count, false) / 3;
+        connected += socketRoundTrip(count, true) / 3;
+    }
+    cout << "  sendto/recvfrom:     " << unconnected << " ns per round trip\n"
+        << "  connected send/recv: " << connected << " ns per round trip (" << setprecision(1)
+        << (unconnected - connected) / unconnected * 100 << " % less)\n" << flush;
+}
+
+static SweepResult run(const NetworkConditions& conditions, double strayRate, uint64_t seed, const SessionConfig& args, int count,
+                       size_t bytes) {
+    SimulatedNetwork network(conditions, seed);
+    SimulatedServer server(network, args.port, args.timeout, args.retries);
+    auto transport = make_unique<SimulatedTransport>(network, 40000);
+    SimulatedTransport* simulated = transport.get();
+    UDPClient client(args, move(transport));
+    auto stray = MsgSpec::encodeUDP(0, "intruder", "stray");
+    string content(bytes, 'x');
+    SweepResult result;
+
+    auto wallStart = chrono::steady_clock::now();
+    // Authentication is part of the session, but not of the measured goodput
+    try {
+        client.sendMessage(make_unique<AuthMessage>("user", "bench", "secret"));
+    } catch (const runtime_error&) {
+    }
+    uint64_t start = network.now();
+    for (int i = 0; i < count; ++i) {
+        try {
+            client.sendMessage(make_unique<MsgMessage>("bench", content));
+        } catch (const runtime_error&) {
+            result.failed++;
+        }
+        // Keep confirming whatever the server sent (REPLY) while we were busy
+        MessageView view;
+        while (client.hasBufferedMessage()) {
+            client.receiveView(view);
+        }
+        if (network.chance(strayRate)) {
+            network.send(SimulatedNetwork::address(9), SimulatedNetwork::address(40000), stray.data(), stray.size());
+        }
+    }
+    result.virtualSeconds = (network.now() - start) / 1e9;
+    result.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+    result.delivered = server.stats().messages;
+    result.retransmits = client.retransmits();
+    result.duplicates = server.stats().duplicates;
+    result.strays = simulated->filtered();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    NetworkConditions conditions;
+    vector<double> lossRates = {0, 0.01, 0.05, 0.1, 0.2, 0.3, 0.4, 0.5};
+    int count = 2000;
+    size_t bytes = 100;
+    uint64_t seed = 1;
+    double strayRate = 0;
+    int socketRounds = 0;
+    SessionConfig args;
+    args.proto = ProtocolType::UDP;
+    args.host = "127.0.0.1";
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string option = argv[i];
+            if (i + 1 >= argc) {
+                throw invalid_argument(option);
+            }
+            string value = argv[++i];
+            if (option == "-n") {
+                count = stoi(value);
+            } else if (option == "-b") {
+                bytes = stoul(value);
+            } else if (option == "-l") {
+                lossRates.clear();
+                for (size_t pos = 0; pos < value.size();) {
+                    size_t comma = value.find(',', pos);
+                    lossRates.push_back(stod(value.substr(pos, comma - pos)));
+                    pos = comma == string::npos ? value.size() : comma + 1;
+                }
+            } else if (option == "-u") {
+                conditions.duplicate = stod(value);
+            } else if (option == "-o") {
+                conditions.reorder = stod(value);
+            } else if (option == "-j") {
+                conditions.jitterNs = static_cast<uint64_t>(stod(value) * 1e6);
+            } else if (option == "-c") {
+                conditions.portChange = stod(value);
+            } else if (option == "-x") {
+                strayRate = stod(value);
+            } else if (option == "-k") {
+                socketRounds = stoi(value);
+            } else if (option == "-d") {
+                args.timeout = static_cast<uint16_t>(stoi(value));
+            } else if (option == "-r") {
+                args.retries = static_cast<uint8_t>(stoi(value));
+            } else if (option == "-s") {
+                seed = stoull(value);
+            } else {
+                throw invalid_argument(option);
+            }
+        }
+    } catch (const exception& e) {
+        cout << "ERROR: Invalid argument " << e.what() << "\n" << flush;
+        printUsage();
+        return 1;
+    }
+
+    if (socketRounds > 0) {
+        socketBenchmark(socketRounds);
+        return 0;
+    }
+
+    // Debug builds trace every datagram
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDERR_FILENO);
+
+    cout << count << " x " << bytes << " B messages, timeout " << args.timeout << " ms, " << int(args.retries) << " retries, seed "
+        << seed << "\n"
+        << "  loss  delivered  failed  retx/msg  dup drops  filtered  goodput [msg/s]  goodput [KB/s]  simulated [s]  wall [ms]\n"
+        << fixed;
+    for (double loss : lossRates) {
+        conditions.loss = loss;
+        SweepResult result = run(conditions, strayRate, seed, args, count, bytes);
+        double goodput = result.virtualSeconds > 0 ? result.delivered / result.virtualSeconds : 0;
+        cout << setw(5) << setprecision(0) << loss * 100 << "%"
+            << setw(11) << result.delivered
+            << setw(8) << result.failed
+            << setw(10) << setprecision(3) << double(result.retransmits) / count
+            << setw(11) << result.duplicates
+            << setw(10) << result.strays
+            << setw(17) << setprecision(1) << goodput
+            << setw(16) << setprecision(1) << goodput * bytes / 1000
+            << setw(15) << setprecision(1) << result.virtualSeconds
+            << setw(11) << setprecision(1) << result.wallSeconds * 1000 << "\n";
+    }
+    cout << flush;
+    return 0;
+}
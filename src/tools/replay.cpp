@@ -0,0 +1,142 @@
+#include "../inc/TrafficCapture.h"
+#include "../inc/TCPClient.h"
+#include "../inc/Message.h"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <thread>
+
+using namespace std;
+
+struct ReplayStats {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t parseErrors = 0;
+    vector<string> divergences;
+};
+
+static void printUsage() {
+    cout << "Usage: ./ipk25chat-replay <capture> [-p] [-m] [-n iterations]\n"
+        << "Options:\n"
+        << "  -p              Replay with the original pacing instead of at full speed\n"
+        << "  -m              Materialize an owned Message per frame (the pre-view cost)\n"
+        << "  -n <count>      Number of passes over the capture (default: 1)\n"
+        << flush;
+}
+
+static uint8_t parseFrame(ProtocolType proto, string_view frame, bool materialize, ReplayStats& stats) {
+    try {
+        MessageView view = proto == ProtocolType::TCP
+            ? MessageFactory::parseView(frame)
+            : MessageFactory::parseUDPView(reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+        if (materialize) {
+            return TrafficCapture::outcomeCode(view.materialize()->getType());
+        }
+        return TrafficCapture::outcomeCode(view.getType());
+    } catch (const exception&) {
+        stats.parseErrors++;
+        return TrafficCapture::OUTCOME_ERROR;
+    }
+}
+
+static void checkOutcome(const map<uint32_t, uint8_t>& expected, uint32_t frameIndex, uint8_t actual, ReplayStats& stats) {
+    auto it = expected.find(frameIndex);
+    if (it != expected.end() && it->second != actual) {
+        stats.divergences.push_back("frame " + to_string(frameIndex) + ": live outcome " + to_string(it->second) + ", replay outcome " +
+                                    to_string(actual));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    bool paced = false;
+    bool materialize = false;
+    int iterations = 1;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "-p")) {
+            paced = true;
+        } else if (!strcmp(argv[i], "-m")) {
+            materialize = true;
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = stoi(argv[++i]);
+        } else {
+            cout << "ERROR: Unknown argument " << argv[i] << "\n" << flush;
+            printUsage();
+            return 1;
+        }
+    }
+
+    // Load everything up front, so file I/O does not pollute the measurement
+    vector<CaptureRecord> inbound;
+    map<uint32_t, uint8_t> expected;
+    ProtocolType proto;
+    try {
+        CaptureReader reader(argv[1]);
+        proto = reader.protocol();
+        CaptureRecord record;
+        while (reader.next(record)) {
+            if (record.kind == CaptureRecordKind::OUTCOME && record.payload.size() == 5) {
+                uint32_t frameIndex = record.payload[0] | (record.payload[1] << 8) | (record.payload[2] << 16) | (uint32_t(record.payload[3]) << 24);
+                expected[frameIndex] = record.payload[4];
+            } else if (record.kind != CaptureRecordKind::OUTCOME) {
+                inbound.push_back(record);
+            }
+        }
+    } catch (const exception& e) {
+        cout << e.what() << "\n" << flush;
+        return 1;
+    }
+    if (inbound.empty()) {
+        cout << "ERROR: Capture contains no inbound traffic\n" << flush;
+        return 1;
+    }
+
+    ReplayStats stats;
+    auto start = chrono::steady_clock::now();
+    for (int pass = 0; pass < iterations; ++pass) {
+        auto passStart = chrono::steady_clock::now();
+        TCPFramer framer;
+        string_view frame;
+        uint32_t frameIndex = 0;
+        for (const CaptureRecord& record : inbound) {
+            if (paced) {
+                this_thread::sleep_until(passStart + chrono::nanoseconds(record.timestampNs - inbound.front().timestampNs));
+            }
+            stats.bytes += record.payload.size();
+            if (proto == ProtocolType::TCP) {
+                framer.append(reinterpret_cast<const char*>(record.payload.data()), record.payload.size());
+                while (framer.next(frame)) {
+                    uint8_t outcome = parseFrame(proto, frame, materialize, stats);
+                    if (pass == 0) checkOutcome(expected, frameIndex, outcome, stats);
+                    frameIndex++;
+                    stats.frames++;
+                }
+            } else {
+                frame = string_view(reinterpret_cast<const char*>(record.payload.data()), record.payload.size());
+                uint8_t outcome = parseFrame(proto, frame, materialize, stats);
+                if (pass == 0) checkOutcome(expected, frameIndex, outcome, stats);
+                frameIndex++;
+                stats.frames++;
+            }
+        }
+        if (pass == 0 && framer.pending() > 0) {
+            stats.divergences.push_back("trailing " + to_string(framer.pending()) + " bytes without CRLF");
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Replayed " << inbound.size() << " records (" << (proto == ProtocolType::TCP ? "tcp" : "udp") << ") x" << iterations
+        << (paced ? " with original pacing" : " at full speed") << (materialize ? ", materializing" : ", borrowed views") << "\n"
+        << "Frames: " << stats.frames << ", parse errors: " << stats.parseErrors << "\n"
+        << "Throughput: " << static_cast<uint64_t>(stats.frames / seconds) << " msg/s, " << (stats.bytes / seconds / 1e6) << " MB/s\n"
+        << "Divergences: " << stats.divergences.size() << "\n";
+    for (size_t i = 0; i < stats.divergences.size() && i < 10; ++i) {
+        cout << "  " << stats.divergences[i] << "\n";
+    }
+    cout << flush;
+    return stats.divergences.empty() ? 0 : 1;
+}
@@ -0,0 +1,320 @@
+#include "../inc/ChatSession.h"
+#include "../inc/KeywordFilter.h"
+#include "../inc/OutputSink.h"
+#include "../inc/RequestTracker.h"
+#include "../inc/SimulatedNetwork.h"
+#include "../inc/TCPClient.h"
+#include "../inc/TimerWheel.h"
+#include "../inc/UDPClient.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+/*
+ * Offline workload shaped like a chat session: mostly MSG, some control traffic, every message framed, parsed,
+ * partly materialized and rendered, plus a lossy UDP session on the simulated network and a paced one over loopback.
+ * It is the PGO training run and the benchmark the build report compares configurations with.
+ */
+
+struct PhaseResult {
+    const char* name;
+    uint64_t operations;
+    double seconds;
+};
+
+static void printUsage() {
+    cout << "Usage: ./ipk25chat-workload [-n scale]\n"
+        << "Options:\n"
+        << "  -n <scale>      Work multiplier (default: 1, about a second unoptimized)\n"
+        << flush;
+}
+
+// Deterministic mix of the message types a server sends, content lengths vary like chat lines
+static vector<unique_ptr<Message>> makeMessages(size_t count) {
+    mt19937 rng(42);
+    uniform_int_distribution<int> kind(0, 99);
+    uniform_int_distribution<size_t> length(1, 400);
+    vector<unique_ptr<Message>> messages;
+    for (size_t i = 0; i < count; ++i) {
+        int k = kind(rng);
+        string content(length(rng), static_cast<char>('a' + i % 26));
+        if (k < 85) {
+            messages.push_back(make_unique<MsgMessage>("user" + to_string(i % 50), content));
+        } else if (k < 92) {
+            messages.push_back(make_unique<ReplyMessage>(k % 2 == 0, static_cast<uint16_t>(i), content.substr(0, 40)));
+        } else if (k < 96) {
+            messages.push_back(make_unique<ErrMessage>("server", content.substr(0, 60)));
+        } else if (k < 98) {
+            messages.push_back(make_unique<JoinMessage>("channel" + to_string(i % 5), "user" + to_string(i % 50)));
+        } else {
+            messages.push_back(make_unique<ByeMessage>("user" + to_string(i % 50)));
+        }
+    }
+    return messages;
+}
+
+template <typename Work>
+static PhaseResult phase(const char* name, uint64_t operations, Work&& work) {
+    auto start = chrono::steady_clock::now();
+    work();
+    return {name, operations, chrono::duration<double>(chrono::steady_clock::now() - start).count()};
+}
+
+int main(int argc, char* argv[]) {
+    int scale = 1;
+    if (argc == 3 && !strcmp(argv[1], "-n")) {
+        scale = max(1, atoi(argv[2]));
+    } else if (argc != 1) {
+        printUsage();
+        return 1;
+    }
+    // Debug builds trace every datagram
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDERR_FILENO);
+
+    const size_t count = 20000;
+    const int passes = 10 * scale;
+    auto messages = makeMessages(count);
+    string stream;
+    vector<vector<uint8_t>> datagrams;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        stream += messages[i]->serialize();
+        datagrams.push_back(messages[i]->serializeUDP(static_cast<uint16_t>(i)));
+    }
+    uint64_t checksum = 0;
+    vector<PhaseResult> results;
+
+    results.push_back(phase("encode", count * passes * 2, [&] {
+        for (int pass = 0; pass < passes; ++pass) {
+            for (const auto& msg : messages) {
+                checksum += msg->serialize().size() + msg->serializeUDP(1).size();
+            }
+        }
+    }));
+
+    // Arbitrary recv() sizes, so frames straddle chunks like they do on a real connection
+    results.push_back(phase("tcp frame+parse", count * passes, [&] {
+        mt19937 rng(7);
+        uniform_int_distribution<size_t> chunk(1, 1500);
+        for (int pass = 0; pass < passes; ++pass) {
+            TCPFramer framer;
+            string_view frame;
+            for (size_t offset = 0; offset < stream.size();) {
+                size_t n = min(chunk(rng), stream.size() - offset);
+                framer.append(stream.data() + offset, n);
+                offset += n;
+                while (framer.next(frame)) {
+                    MessageView view = MessageFactory::parseView(frame);
+                    checksum += static_cast<uint64_t>(view.getType());
+                }
+            }
+        }
+    }));
+
+    results.push_back(phase("udp parse+materialize", count * passes, [&] {
+        for (int pass = 0; pass < passes; ++pass) {
+            for (const auto& datagram : datagrams) {
+                MessageView view = MessageFactory::parseUDPView(datagram.data(), datagram.size());
+                checksum += view.materialize()->getType() == MessageType::MSG;
+            }
+        }
+    }));
+
+    results.push_back(phase("render text/json/binary", count * passes, [&] {
+        OutputSink sinks[] = {OutputSink(OutputFormat::TEXT), OutputSink(OutputFormat::JSON), OutputSink(OutputFormat::BINARY)};
+        ostringstream out;
+        for (int pass = 0; pass < passes; ++pass) {
+            OutputSink& sink = sinks[pass % 3];
+            for (size_t i = 0; i < messages.size(); ++i) {
+                sink.message(out, *messages[i], 1, 2, static_cast<int32_t>(i));
+            }
+            checksum += out.tellp();
+            out.str("");
+        }
+    }));
+
+    // Moderation-sized rule set: 100k random words, chat lines of real text that rarely contain one
+    const size_t patternCount = 100000;
+    vector<string> patterns;
+    vector<string> lines;
+    {
+        mt19937 rng(11);
+        uniform_int_distribution<int> letter('a', 'z');
+        uniform_int_distribution<size_t> wordLength(4, 12);
+        for (size_t i = 0; i < patternCount; ++i) {
+            string word(wordLength(rng), ' ');
+            for (char& c : word) {
+                c = static_cast<char>(letter(rng));
+            }
+            patterns.push_back(move(word));
+        }
+        for (const auto& msg : messages) {
+            if (msg->getType() == MessageType::MSG) {
+                string line = get<1>(static_cast<const MsgMessage&>(*msg).fields());
+                for (size_t i = 0; i < line.size(); i += wordLength(rng)) {
+                    line[i] = i % 3 ? ' ' : static_cast<char>(letter(rng) - 32);
+                }
+                lines.push_back(move(line));
+            }
+        }
+    }
+    unique_ptr<AhoCorasick> automaton;
+    results.push_back(phase("filter compile 100k", patternCount, [&] {
+        automaton = make_unique<AhoCorasick>(patterns);
+    }));
+    uint64_t scannedBytes = 0;
+    size_t scanPhase = results.size();
+    results.push_back(phase("filter scan", lines.size() * passes, [&] {
+        for (int pass = 0; pass < passes; ++pass) {
+            for (const string& line : lines) {
+                automaton->scan(line, [&](uint32_t pattern) { checksum += pattern; });
+                scannedBytes += line.size();
+            }
+        }
+    }));
+    // Same lines against tags and tickers: 100k patterns behind 32 distinct start bytes that chat text rarely has,
+    // the prefilter skips the lines 16 bytes at a time
+    const string tagStarts = "#@$%&*+=~^?|<>[]{}0123456789/\\_`";
+    vector<string> tags;
+    {
+        mt19937 rng(13);
+        uniform_int_distribution<int> letter('a', 'z');
+        uniform_int_distribution<size_t> start(0, tagStarts.size() - 1), wordLength(4, 12);
+        for (size_t i = 0; i < patternCount; ++i) {
+            string word(wordLength(rng), ' ');
+            word[0] = tagStarts[start(rng)];
+            for (size_t c = 1; c < word.size(); ++c) {
+                word[c] = static_cast<char>(letter(rng));
+            }
+            tags.push_back(move(word));
+        }
+    }
+    AhoCorasick tagAutomaton(tags);
+    size_t tagPhase = results.size();
+    results.push_back(phase("filter scan 32 starts", lines.size() * passes, [&] {
+        for (int pass = 0; pass < passes; ++pass) {
+            for (const string& line : lines) {
+                tagAutomaton.scan(line, [&](uint32_t pattern) { checksum += pattern; });
+            }
+        }
+    }));
+
+    // Reply deadlines of many sessions: most are answered (cancelled), the rest fire; 1 ms of virtual time per step
+    const size_t timerCount = 200000 * scale;
+    results.push_back(phase("timer wheel 200k", timerCount * 2, [&] {
+        mt19937 rng(5);
+        uniform_int_distribution<uint64_t> answerMs(1, 6000);
+        TimerWheel wheel(0, timerCount);
+        vector<pair<uint64_t, TimerWheel::Handle>> answers;     // When the REPLY comes, which deadline it cancels
+        uint64_t nowNs = 0;
+        for (size_t i = 0; i < timerCount; ++i) {
+            if (i % 100 == 0) {
+                nowNs += TimerWheel::TICK_NS;
+                checksum += wheel.advance(nowNs, [&](uint64_t cookie) { checksum += cookie; });
+            }
+            answers.push_back({nowNs + answerMs(rng) * TimerWheel::TICK_NS, wheel.schedule(nowNs + REPLY_TIMEOUT_NS, i)});
+        }
+        sort(answers.begin(), answers.end());
+        for (const auto& [answerNs, deadline] : answers) {
+            checksum += wheel.advance(answerNs, [&](uint64_t cookie) { checksum += cookie; });
+            checksum += wheel.cancel(deadline);
+        }
+    }));
+
+    const int sessionMessages = 2000 * scale;
+    results.push_back(phase("udp session, 5 % loss", sessionMessages * 2, [&] {
+        NetworkConditions conditions;
+        conditions.loss = 0.05;
+        conditions.duplicate = 0.01;
+        conditions.reorder = 0.02;
+        SimulatedNetwork network(conditions, 1);
+        SimulatedServer server(network, 4567, 250, 10);
+        SessionConfig args;
+        args.proto = ProtocolType::UDP;
+        args.host = "127.0.0.1";
+        args.retries = 10;
+        UDPClient client(args, make_unique<SimulatedTransport>(network, 40000));
+        client.sendMessage(make_unique<AuthMessage>("user", "bench", "secret"));
+        MessageView view;
+        for (int i = 0; i < sessionMessages; ++i) {
+            server.push("server", "line " + to_string(i));
+            client.sendMessage(make_unique<MsgMessage>("bench", "reply " + to_string(i)));
+            while (client.hasBufferedMessage()) {
+                client.receiveView(view);
+            }
+        }
+        while (!server.idle()) {
+            client.receiveView(view);
+        }
+        checksum += server.stats().messages + client.retransmits();
+    }));
+
+    // The producer keeps the outbound queue full, the current queue delay is sampled while the pacer drains it
+    const double pacedRate = 20000;
+    uint64_t maxQueueDelayNs = 0;
+    results.push_back(phase("paced tcp session 20k/s", sessionMessages, [&] {
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        listen(listener, 1);
+        getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+        SessionConfig config;
+        config.proto = ProtocolType::TCP;
+        config.host = "127.0.0.1";
+        config.port = ntohs(address.sin_port);
+        config.sendRate = pacedRate;
+        // The network thread sleeps in whole milliseconds, a burst above rate/1000 keeps it from capping the rate
+        config.sendBurst = 32;
+        ChatSession session(config);
+        session.rename("bench");
+        int server = accept(listener, nullptr, nullptr);
+        char buffer[65536];
+        auto wait = [&] {
+            maxQueueDelayNs = max(maxQueueDelayNs, session.queueDelayNs());
+            while (recv(server, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+            }
+            this_thread::sleep_for(chrono::microseconds(100));
+        };
+        for (int sent = 0; sent < sessionMessages;) {
+            if (session.send("paced line")) {
+                sent++;
+            } else {
+                wait();
+            }
+        }
+        while (session.queuedMessages() > 0) {
+            wait();
+        }
+        checksum += session.sendPacer().stats().throttled;
+        session.close();
+        close(server);
+        close(listener);
+    }));
+
+    double total = 0;
+    cout << left << setw(26) << "phase" << right << setw(12) << "ops" << setw(12) << "ns/op" << setw(12) << "ms\n" << fixed;
+    for (const PhaseResult& result : results) {
+        total += result.seconds;
+        cout << left << setw(26) << result.name << right << setw(12) << result.operations << setw(12) << setprecision(1)
+            << result.seconds * 1e9 / result.operations << setw(11) << result.seconds * 1000 << "\n";
+    }
+    const PhaseResult& scan = results[scanPhase];
+    const PhaseResult& tagScan = results[tagPhase];
+    cout << left << setw(50) << "total" << right << setw(11) << total * 1000 << "\n"
+        << "filter: " << automaton->stateCount() << " states, " << setprecision(0) << scannedBytes / scan.seconds / 1e6
+        << " MB/s, " << scannedBytes / tagScan.seconds / 1e6 << " MB/s with 32 rare start bytes\n"
+        << "pacer: queue delay up to " << setprecision(1) << maxQueueDelayNs / 1e6 << " ms at " << setprecision(0)
+        << pacedRate << " msg/s\n"
+        << "checksum " << checksum << "\n" << flush;
+    return 0;
+}
@@ -0,0 +1,407 @@
+// Heap allocations of the steady-state message paths: parse, serialize, hand-off to the caller, the TCP and UDP
+// transports sending and receiving on loopback, and a whole ChatSession round trip. malloc is interposed and counts on
+// the measuring thread only, or on every thread for the session, whose network thread does half the work. Every path
+// has a budget of allocations per message, so a change that makes one of them allocate (again) fails here.
+// Usage: test_allocations [-b]   (-b: benchmark, 50000 messages per path instead of 2000, for the ns/msg column)
+
+#include "../src/inc/ChatSession.h"
+#include "../src/inc/TCPClient.h"
+#include "../src/inc/UDPClient.h"
+
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <netinet/tcp.h>
+#include <poll.h>
+
+using namespace std;
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+// operator new allocates through malloc, so counting malloc covers both
+static thread_local bool counting = false;
+static std::atomic<bool> countingAllThreads{false};
+static std::atomic<uint64_t> allocations{0};
+static std::atomic<uint64_t> allocatedBytes{0};
+
+static void count(size_t bytes) {
+    if (counting || countingAllThreads.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+extern "C" void* malloc(size_t size) {
+    count(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    ::count(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+    count(size);
+    return __libc_realloc(pointer, size);
+}
+
+static int failures = 0;
+
+#define CHECK(condition) \
+do { \
+if (!(condition)) { \
+cout << "  FAILED line " << __LINE__ << ": " #condition "\n"; \
+failures++; \
+} \
+} while (0)
+
+// Allocations per message each path may make
+enum class Path {
+    PARSE_TCP, PARSE_UDP, SERIALIZE_TCP, SERIALIZE_UDP, MATERIALIZE, SEND_TCP, RECEIVE_TCP, SEND_UDP, RECEIVE_UDP, SESSION_TCP
+};
+struct Budget {
+    const char* name;
+    double allocations;
+    bool allThreads = false;    // Also count the threads the path hands work to
+};
+static constexpr Budget BUDGETS[] = {
+    {"parse tcp", 0},           // Views borrow the frame
+    {"parse udp", 0},
+    {"serialize tcp", 0},       // Into the transport's reused buffer
+    {"serialize udp", 0},
+    {"materialize", 2},         // The owned message that crosses to the caller's thread, and content beyond SSO
+    {"send tcp", 0},            // The Message itself is the caller's
+    {"receive tcp", 0},
+    {"send udp", 0},            // Including the wait for its CONFIRM
+    {"receive udp", 0},         // Including the CONFIRM and the duplicate check
+    // send() -> scheduler -> network thread sends, receives, publishes -> poll() dispatches: the outgoing MsgMessage
+    // and the materialized incoming one, each with content beyond SSO
+    {"session tcp", 4, true},
+};
+
+static constexpr size_t BATCH = 64;
+static size_t messagesPerPath = 2000;
+
+static const char* typeName(MessageType type) {
+    static constexpr const char* names[] = {"AUTH", "JOIN", "MSG", "REPLY", "ERR", "BYE", "CONFIRM", "PING"};
+    return names[static_cast<size_t>(type)];
+}
+
+/**
+ * @brief Counts the allocations of body(i) per message, after one warm-up call let the reused buffers grow.
+ * @param refill Called outside the counted region with the first index and size of every batch of body() calls
+ * (to queue frames, drain the peer).
+ */
+template <typename Refill, typename Body>
+static void measure(Path path, MessageType type, Refill&& refill, Body&& body) {
+    const Budget& budget = BUDGETS[static_cast<size_t>(path)];
+    refill(0, 1);
+    body(0);
+    uint64_t countedAllocations = 0, countedBytes = 0;
+    chrono::nanoseconds elapsed{0};
+    for (size_t done = 1; done <= messagesPerPath; done += BATCH) {
+        size_t batch = min(BATCH, messagesPerPath + 1 - done);
+        refill(done, batch);
+        allocations = allocatedBytes = 0;
+        auto start = chrono::steady_clock::now();
+        counting = true;
+        countingAllThreads = budget.allThreads;
+        for (size_t i = done; i < done + batch; ++i) {
+            body(i);
+        }
+        countingAllThreads = false;
+        counting = false;
+        elapsed += chrono::steady_clock::now() - start;
+        countedAllocations += allocations;
+        countedBytes += allocatedBytes;
+    }
+    double perMessage = double(countedAllocations) / messagesPerPath;
+    cout << "  " << left << setw(15) << budget.name << setw(8) << typeName(type) << right << fixed << setprecision(2)
+         << setw(7) << perMessage << setw(9) << setprecision(1) << double(countedBytes) / messagesPerPath
+         << setw(8) << setprecision(0) << budget.allocations
+         << setw(10) << setprecision(1) << double(elapsed.count()) / messagesPerPath << "\n";
+    CHECK(perMessage <= budget.allocations);
+}
+
+static const auto NO_REFILL = [](size_t, size_t) {};
+
+// One message of every type the client sends or receives, built outside any counted region
+static vector<unique_ptr<Message>> sampleMessages() {
+    vector<unique_ptr<Message>> messages;
+    messages.push_back(make_unique<AuthMessage>("user", "Display", "secret-0123456789"));
+    messages.push_back(make_unique<JoinMessage>("general", "Display"));
+    messages.push_back(make_unique<MsgMessage>("Display", "A chat message of typical length, about sixty characters."));
+    messages.push_back(make_unique<ReplyMessage>(true, 1, "Join success."));
+    messages.push_back(make_unique<ErrMessage>("Server", "Something went wrong."));
+    messages.push_back(make_unique<ByeMessage>("Display"));
+    return messages;
+}
+
+static bool fromServer(MessageType type) {
+    return type == MessageType::MSG || type == MessageType::REPLY || type == MessageType::ERR || type == MessageType::BYE;
+}
+
+static bool fromClient(MessageType type) {
+    return type != MessageType::REPLY;
+}
+
+static void testCodec() {
+    cout << "codec\n";
+    size_t parsed = 0;
+    for (const auto& message : sampleMessages()) {
+        MessageType type = message->getType();
+        string frame = message->serialize();
+        vector<uint8_t> datagram = message->serializeUDP(7);
+        if (fromServer(type)) {
+            measure(Path::PARSE_TCP, type, NO_REFILL, [&](size_t) { parsed += MessageFactory::parseView(frame).getType() == type; });
+            measure(Path::PARSE_UDP, type, NO_REFILL, [&](size_t) {
+                parsed += MessageFactory::parseUDPView(datagram.data(), datagram.size()).getType() == type;
+            });
+        }
+        if (fromClient(type)) {
+            string tcpBuffer;
+            vector<uint8_t> udpBuffer;
+            measure(Path::SERIALIZE_TCP, type, NO_REFILL, [&](size_t) {
+                tcpBuffer.clear();
+                message->serialize(tcpBuffer);
+            });
+            CHECK(tcpBuffer == frame);
+            measure(Path::SERIALIZE_UDP, type, NO_REFILL, [&](size_t) {
+                udpBuffer.clear();
+                message->serializeUDP(udpBuffer, 7);
+            });
+            CHECK(udpBuffer == datagram);
+        }
+        if (fromServer(type)) {
+            MessageView view = MessageFactory::parseView(frame);
+            unique_ptr<Message> owned;
+            // The previous message is freed inside the counted region, frees are not counted
+            measure(Path::MATERIALIZE, type, NO_REFILL, [&](size_t) { owned = view.materialize(); });
+        }
+    }
+    vector<uint8_t> ping = PingSpec::encodeUDP(9);
+    measure(Path::PARSE_UDP, MessageType::PING, NO_REFILL, [&](size_t) {
+        parsed += MessageFactory::parseUDPView(ping.data(), ping.size()).getType() == MessageType::PING;
+    });
+    CHECK(parsed > 0);
+}
+
+static sockaddr_in loopback(uint16_t port = 0) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    return address;
+}
+
+static uint16_t boundPort(int fd) {
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    return ntohs(address.sin_port);
+}
+
+static void drain(int fd) {
+    char buffer[65536];
+    while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+    }
+}
+
+// TCP receives never block, a batch still on its way through loopback is waited for
+static bool receiveWaiting(ProtocolClient& client, MessageView& view) {
+    while (!client.receiveView(view)) {
+        pollfd pfd{client.socketFd(), POLLIN, 0};
+        if (!client.isOpen() || poll(&pfd, 1, 1000) <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static SessionConfig loopbackArgs(ProtocolType proto, uint16_t port) {
+    SessionConfig args;
+    args.proto = proto;
+    args.host = "127.0.0.1";
+    args.port = port;
+    args.timeout = 1000;
+    args.retries = 0;
+    return args;
+}
+
+static void testTCP() {
+    cout << "tcp transport (loopback)\n";
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = loopback();
+    CHECK(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 && listen(listener, 1) == 0);
+    // connect() completes against the backlog, the server end is accepted afterwards
+    TCPClient client(loopbackArgs(ProtocolType::TCP, boundPort(listener)));
+    int server = accept(listener, nullptr, nullptr);
+    CHECK(server >= 0);
+    // Without it every batch after the first waits for the client's delayed ACK
+    int noDelay = 1;
+    setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    for (const auto& message : sampleMessages()) {
+        MessageType type = message->getType();
+        string frame = message->serialize();
+        if (fromClient(type)) {
+            vector<unique_ptr<Message>> outgoing(BATCH);
+            measure(Path::SEND_TCP, type, [&](size_t first, size_t count) {
+                drain(server);
+                for (size_t i = first; i < first + count; ++i) {
+                    outgoing[i % BATCH] = MessageFactory::parseView(frame).materialize();
+                }
+            }, [&](size_t i) { client.sendMessage(move(outgoing[i % BATCH])); });
+            drain(server);
+        }
+        if (fromServer(type)) {
+            string frames;
+            for (size_t i = 0; i < BATCH; ++i) {
+                frames += frame;
+            }
+            size_t received = 0;
+            MessageView view;
+            // A batch goes out in one write, the first receive reads all of it
+            measure(Path::RECEIVE_TCP, type, [&](size_t, size_t count) {
+                send(server, frames.data(), count * frame.size(), 0);
+            }, [&](size_t) { received += receiveWaiting(client, view) && view.getType() == type; });
+            CHECK(received == messagesPerPath + 1);
+        }
+    }
+    close(server);
+    close(listener);
+}
+
+// Server socket and a client bound to loopback, a fresh pair per message type keeps the MessageIDs unique
+struct UDPLoopback {
+    int server;
+    sockaddr_in clientAddress = loopback();
+    unique_ptr<UDPClient> client;
+
+    UDPLoopback() : server(socket(AF_INET, SOCK_DGRAM, 0)) {
+        sockaddr_in address = loopback();
+        CHECK(bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        auto transport = make_unique<SocketTransport>();
+        CHECK(bind(transport->fd(), reinterpret_cast<sockaddr*>(&clientAddress), sizeof(clientAddress)) == 0);
+        clientAddress.sin_port = htons(boundPort(transport->fd()));
+        client = make_unique<UDPClient>(loopbackArgs(ProtocolType::UDP, boundPort(server)), move(transport));
+    }
+    ~UDPLoopback() { close(server); }
+
+    void toClient(const vector<uint8_t>& datagram) {
+        sendto(server, datagram.data(), datagram.size(), 0, reinterpret_cast<sockaddr*>(&clientAddress), sizeof(clientAddress));
+    }
+};
+
+static void testUDP() {
+    cout << "udp transport (loopback)\n";
+    for (const auto& message : sampleMessages()) {
+        MessageType type = message->getType();
+        string frame = message->serialize();
+        if (fromClient(type)) {
+            UDPLoopback loop;
+            vector<unique_ptr<Message>> outgoing(BATCH);
+            measure(Path::SEND_UDP, type, [&](size_t first, size_t count) {
+                drain(loop.server);
+                // Every send reads the next CONFIRM, so queueing them up front keeps this single-threaded
+                for (size_t i = 0; i < count; ++i) {
+                    outgoing[(first + i) % BATCH] = MessageFactory::parseView(frame).materialize();
+                    loop.toClient(ConfirmSpec::encodeUDP(static_cast<uint16_t>(loop.client->lastMessageId() + 1 + i)));
+                }
+            }, [&](size_t i) { loop.client->sendMessage(move(outgoing[i % BATCH])); });
+            CHECK(loop.client->retransmits() == 0);
+        }
+        if (fromServer(type)) {
+            UDPLoopback loop;
+            uint16_t serverMsgId = 0;
+            size_t received = 0;
+            MessageView view;
+            measure(Path::RECEIVE_UDP, type, [&](size_t, size_t count) {
+                drain(loop.server);
+                for (size_t i = 0; i < count; ++i) {
+                    loop.toClient(message->serializeUDP(++serverMsgId));
+                }
+            }, [&](size_t) { received += loop.client->receiveView(view) && view.getType() == type; });
+            CHECK(received == messagesPerPath + 1);
+        }
+    }
+}
+
+// Reads one frame of a known size, the session's network thread sends them whole
+static bool receiveFrame(int fd, size_t size) {
+    char buffer[512];
+    size_t received = 0;
+    while (received < size) {
+        ssize_t n = recv(fd, buffer, min(sizeof(buffer), size - received), 0);
+        if (n <= 0) {
+            return false;
+        }
+        received += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void testSession() {
+    cout << "chat session (loopback)\n";
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = loopback();
+    CHECK(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 && listen(listener, 1) == 0);
+    size_t received = 0;
+    SessionCallbacks callbacks;
+    callbacks.onMessage = [&](const Message& message, const MessageInfo&) { received += message.getType() == MessageType::MSG; };
+    ChatSession session(loopbackArgs(ProtocolType::TCP, boundPort(listener)), callbacks);
+    int server = accept(listener, nullptr, nullptr);
+    CHECK(server >= 0);
+    int noDelay = 1;
+    setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    CHECK(session.auth("user", "secret-0123456789", "Display") != 0);
+    CHECK(receiveFrame(server, AuthMessage("user", "Display", "secret-0123456789").serialize().size()));
+    string reply = ReplyMessage(true, 1, "Auth success.").serialize();
+    send(server, reply.data(), reply.size(), 0);
+    while (!session.isAuthenticated() && session.runOnce(1000)) {
+    }
+    CHECK(session.isAuthenticated());
+
+    // Every message makes the whole round trip before the next one: sent by the network thread, answered by the
+    // server with a MSG of the same size, received and published by the network thread, dispatched by poll()
+    const string content = "A chat message of typical length, about sixty characters.";
+    const string echo = MsgMessage("Server", content).serialize();
+    const size_t sent = MsgMessage("Display", content).serialize().size();
+    measure(Path::SESSION_TCP, MessageType::MSG, NO_REFILL, [&](size_t i) {
+        if (!session.send(content) || !receiveFrame(server, sent)) {
+            return;
+        }
+        send(server, echo.data(), echo.size(), 0);
+        while (received <= i && session.runOnce(1000)) {
+        }
+    });
+    CHECK(received == messagesPerPath + 1);
+    session.close();
+    close(server);
+    close(listener);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "-b") {
+        messagesPerPath = 50000;
+    }
+    // Debug builds trace every datagram
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDERR_FILENO);
+
+    cout << "allocations per message, " << messagesPerPath << " messages per path\n"
+         << "  path           type     allocs    bytes  budget    ns/msg\n";
+    testCodec();
+    testTCP();
+    testUDP();
+    testSession();
+
+    cout << (failures == 0 ? "All allocation budgets met\n" : to_string(failures) + " check(s) failed\n") << flush;
+    return failures == 0 ? 0 : 1;
+}
@@ -18,6 +18,8 @@ test_cases = [
     ("Valid UDP minimal", 0, ['-t', 'udp', '-s', '127.0.0.1']),
     ("All options set", 0, ['-t', 'udp', '-s', 'localhost', '-p', '1234', '-d', '500', '-r', '5']),
     ("Unknown option", 1, ['-x', '-t', 'tcp', '-s', 'vitapavlik.cz']),
+    ("Receive buffer ceiling overflowing int", 1, ['-t', 'udp', '-s', '127.0.0.1', '-M', '4194304']),
+    ("Negative receive buffer ceiling", 1, ['-t', 'udp', '-s', '127.0.0.1', '-M', '-1']),
 ]
 
 passed = 0
@@ -0,0 +1,181 @@
+// The keyword filter's Aho-Corasick automaton against a naive substring scan: overlapping matches, patterns that are
+// suffixes of others, duplicates, randomized rule sets with few and with many start bytes (both sides of the 16 byte
+// prefilter, bytes from 0x80 that share its bitmap bits), and the rules file reloaded under a running filter.
+// Every randomized round is seeded, a failure reproduces exactly on every run.
+
+#include "../src/inc/KeywordFilter.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+do { \
+if (!(condition)) { \
+cout << "  FAILED line " << __LINE__ << ": " #condition "\n"; \
+failures++; \
+} \
+} while (0)
+
+static uint8_t fold(uint8_t c) {
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+// Occurrences of every pattern, ASCII case-insensitively
+static vector<size_t> naiveCounts(const vector<string>& patterns, string_view text) {
+    vector<size_t> counts(patterns.size(), 0);
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        const string& pattern = patterns[i];
+        for (size_t at = 0; at + pattern.size() <= text.size(); ++at) {
+            size_t k = 0;
+            while (k < pattern.size() && fold(pattern[k]) == fold(text[at + k])) {
+                ++k;
+            }
+            counts[i] += k == pattern.size();
+        }
+    }
+    return counts;
+}
+
+static vector<size_t> automatonCounts(const AhoCorasick& automaton, size_t patternCount, string_view text) {
+    vector<size_t> counts(patternCount, 0);
+    automaton.scan(text, [&](uint32_t pattern) { counts.at(pattern)++; });
+    return counts;
+}
+
+static void testKnownTexts() {
+    cout << "Known texts\n";
+    // "he" is a suffix of "she", "hers" continues "he"
+    vector<string> patterns{"he", "she", "his", "hers"};
+    AhoCorasick automaton(patterns);
+    CHECK(automatonCounts(automaton, patterns.size(), "ushers") == (vector<size_t>{1, 1, 0, 1}));
+    CHECK(automatonCounts(automaton, patterns.size(), "USHERS hiS") == (vector<size_t>{1, 1, 1, 1}));
+
+    // Overlapping occurrences of one pattern
+    vector<string> runs{"aa", "aaa"};
+    AhoCorasick overlapping(runs);
+    CHECK(automatonCounts(overlapping, runs.size(), "aAaA") == (vector<size_t>{3, 2}));
+
+    // Duplicate patterns are reported under both indices
+    vector<string> twins{"ab", "AB"};
+    AhoCorasick duplicates(twins);
+    CHECK(automatonCounts(duplicates, twins.size(), "xabx ab") == (vector<size_t>{2, 2}));
+
+    AhoCorasick empty({});
+    CHECK(automatonCounts(empty, 0, "anything at all, longer than one block").empty());
+}
+
+static string randomString(mt19937& rng, const string& alphabet, size_t length) {
+    uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    string out(length, ' ');
+    for (char& c : out) {
+        c = alphabet[pick(rng)];
+    }
+    return out;
+}
+
+static void testRandomized() {
+    cout << "Randomized rule sets against a naive scan\n";
+    // Few start bytes and many overlaps, then many start bytes (more than 16) in longer texts
+    const string narrow = "abAB";
+    const string wide = "abcdefghijklmnopqrstuvwxyz0123456789#@$%\xC3\xE1";
+    // Text filler the prefilter has to skip: no pattern byte, or bytes from 0x80 aliasing 'a' and 'A' in the bitmap
+    const string filler = " .,z\xE1\xC1\x81";
+    mt19937 rng(42);
+    int mismatches = 0;
+    size_t matches = 0;
+    for (int round = 0; round < 400; ++round) {
+        const string& alphabet = round % 2 ? wide : narrow;
+        uniform_int_distribution<size_t> patternCount(1, round % 2 ? 200 : 12), patternLength(1, 6);
+        vector<string> patterns;
+        for (size_t i = patternCount(rng); i > 0; --i) {
+            patterns.push_back(randomString(rng, alphabet, patternLength(rng)));
+        }
+        AhoCorasick automaton(patterns);
+        // Sparse texts exercise the prefilter, dense ones the automaton's deep states
+        bernoulli_distribution sparse(round % 4 < 2 ? 0.9 : 0.2);
+        uniform_int_distribution<size_t> textLength(0, 300);
+        for (int t = 0; t < 20; ++t) {
+            string text = randomString(rng, alphabet, textLength(rng));
+            for (char& c : text) {
+                if (sparse(rng)) {
+                    c = filler[rng() % filler.size()];
+                }
+            }
+            vector<size_t> expected = naiveCounts(patterns, text);
+            if (automatonCounts(automaton, patterns.size(), text) != expected) {
+                mismatches++;
+            }
+            for (size_t count : expected) {
+                matches += count;
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+    CHECK(matches > 100000);
+    cout << "  8000 texts, " << matches << " matches, " << mismatches << " mismatched\n";
+}
+
+static void writeRules(const string& path, const string& rules) {
+    FILE* file = fopen(path.c_str(), "w");
+    fputs(rules.c_str(), file);
+    fclose(file);
+}
+
+static void testReload() {
+    cout << "Rules reloaded under a running filter\n";
+    char path[] = "/tmp/test_keyword_filter_XXXXXX";
+    close(mkstemp(path));
+    ostringstream forwarded;
+    writeRules(path, "highlight content foo\ncount sender bob\n");
+    KeywordFilter filter(path, forwarded, "test");
+    MsgMessage foo("alice", "a FOO b"), bar("bob", "bar"), quiet("alice", "nothing here");
+    CHECK(filter.apply(foo) == FILTER_HIGHLIGHT);
+    CHECK(filter.apply(bar) == FILTER_COUNT);
+
+    // The new rules replace the old ones completely
+    writeRules(path, "suppress any bar\n# comment\nforward content here\n");
+    string error;
+    CHECK(filter.reloadIfChanged(true, error));
+    CHECK(filter.apply(foo) == 0);
+    CHECK(filter.apply(bar) == FILTER_SUPPRESS);
+    CHECK(filter.apply(quiet) == FILTER_FORWARD);
+
+    // A broken file is reported with its line and the previous rules stay active
+    writeRules(path, "suppress any bar\nshout content foo\n");
+    CHECK(!filter.reloadIfChanged(true, error));
+    CHECK(error.find(":2:") != string::npos);
+    CHECK(filter.apply(bar) == FILTER_SUPPRESS);
+    CHECK(filter.apply(foo) == 0);
+
+    // Unchanged rules within the check interval are not read again, even if the file is broken meanwhile
+    writeRules(path, "highlight any foo\n");
+    CHECK(filter.reloadIfChanged(true, error));
+    writeRules(path, "shout\n");
+    CHECK(filter.reloadIfChanged(false, error));
+    CHECK(filter.apply(foo) == FILTER_HIGHLIGHT);
+
+    unlink(path);
+    CHECK(!filter.reloadIfChanged(true, error));
+    CHECK(filter.apply(foo) == FILTER_HIGHLIGHT);
+}
+
+int main() {
+    // Debug builds trace every compile
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDERR_FILENO);
+
+    testKnownTexts();
+    testRandomized();
+    testReload();
+
+    cout << (failures == 0 ? "All keyword filter tests passed\n" : to_string(failures) + " check(s) failed\n") << flush;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+// TimerWheel, the reply deadlines of the session: random schedule/cancel/advance against a sorted reference, across
+// every level and the overflow list, then half a million timers armed at once. malloc is interposed as in
+// test_allocations; once the node pool has grown to hold them, arming, cancelling and firing them all allocates nothing.
+
+#include "../src/inc/TimerWheel.h"
+
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+// operator new allocates through malloc, so counting malloc covers both
+static thread_local bool counting = false;
+static std::atomic<uint64_t> allocations{0};
+
+static void count() {
+    if (counting) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+extern "C" void* malloc(size_t size) {
+    count();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    ::count();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+    count();
+    return __libc_realloc(pointer, size);
+}
+
+static int failures = 0;
+
+#define CHECK(condition) \
+do { \
+if (!(condition)) { \
+cout << "  FAILED line " << __LINE__ << ": " #condition "\n"; \
+failures++; \
+} \
+} while (0)
+
+static void testTimerWheel() {
+    cout << "timer wheel against a sorted reference\n";
+    mt19937_64 rng(12);
+    // Start just below the top level's rotation, so the overflow list is crossed too
+    uint64_t now = ((1ULL << 32) - 3000) * TimerWheel::TICK_NS;
+    TimerWheel wheel(now);
+    map<uint64_t, pair<uint64_t, TimerWheel::Handle>> live;     // cookie -> deadline, handle
+    const uint64_t ranges[] = {1000000ULL, 300000000ULL, 70000000000ULL, 20000000000000ULL, 6000000000000000ULL};
+    const uint64_t steps[] = {2000000ULL, 500000000ULL, 100000000000ULL, 50000000000000ULL};
+    uint64_t cookie = 0;
+    size_t fired = 0;
+    bool early = false, late = false, unknown = false;
+    for (int op = 0; op < 200000; ++op) {
+        uint64_t choice = rng() % 10;
+        if (choice < 5) {
+            // Some deadlines are already in the past
+            uint64_t deadline = now + rng() % ranges[rng() % 5] - 500000;
+            cookie++;
+            live[cookie] = {deadline, wheel.schedule(deadline, cookie)};
+        } else if (choice < 7 && !live.empty()) {
+            auto it = live.lower_bound(rng() % (cookie + 1));
+            if (it == live.end()) {
+                it = live.begin();
+            }
+            CHECK(wheel.cancel(it->second.second));
+            CHECK(!wheel.cancel(it->second.second));
+            live.erase(it);
+        } else {
+            now += rng() % steps[rng() % 4];
+            fired += wheel.advance(now, [&](uint64_t c) {
+                auto it = live.find(c);
+                if (it == live.end()) {
+                    unknown = true;
+                    return;
+                }
+                early |= it->second.first > now;
+                live.erase(it);
+            });
+            // Everything due a tick ago has fired
+            for (auto& [c, timer] : live) {
+                late |= timer.first + TimerWheel::TICK_NS <= now;
+            }
+        }
+        CHECK(wheel.size() == live.size());
+        if (wheel.size() != live.size()) {
+            break;
+        }
+    }
+    CHECK(!early && !late && !unknown);
+    CHECK(fired > 50000);
+    cout << "  " << fired << " fired, " << live.size() << " pending\n";
+}
+
+/**
+ * @brief Arms one timer per handle with deadlines up to ten minutes out, cancels every other one and fires the rest.
+ * @return Timers fired, every one is checked against its deadline.
+ */
+static size_t armAndFire(TimerWheel& wheel, uint64_t& now, vector<TimerWheel::Handle>& handles, mt19937_64& rng) {
+    const uint64_t horizonNs = 600000000000ULL;
+    for (size_t i = 0; i < handles.size(); ++i) {
+        // The cookie is the deadline, so a firing can be checked without a reference
+        uint64_t deadline = now + rng() % horizonNs;
+        handles[i] = wheel.schedule(deadline, deadline);
+    }
+    CHECK(wheel.size() == handles.size());
+    size_t cancelled = 0;
+    for (size_t i = 0; i < handles.size(); i += 2) {
+        cancelled += wheel.cancel(handles[i]);
+    }
+    CHECK(cancelled == (handles.size() + 1) / 2);
+    CHECK(wheel.size() == handles.size() - cancelled);
+    size_t fired = 0;
+    bool early = false;
+    // 100 ms steps, as a loaded event loop would advance
+    for (uint64_t end = now + horizonNs + TimerWheel::TICK_NS; now < end;) {
+        now += 100000000ULL;
+        fired += wheel.advance(now, [&](uint64_t deadline) { early |= deadline > now; });
+    }
+    CHECK(!early);
+    CHECK(wheel.size() == 0);
+    return fired;
+}
+
+static void testManyTimers() {
+    cout << "500k timers armed at once\n";
+    const size_t timerCount = 500000;
+    mt19937_64 rng(7);
+    uint64_t now = TimerWheel::now();
+    TimerWheel wheel(now);
+    vector<TimerWheel::Handle> handles(timerCount);
+    // The first round grows the node pool from its default capacity
+    CHECK(armAndFire(wheel, now, handles, rng) == timerCount / 2);
+
+    allocations = 0;
+    counting = true;
+    auto start = chrono::steady_clock::now();
+    size_t fired = armAndFire(wheel, now, handles, rng);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    counting = false;
+    CHECK(fired == timerCount / 2);
+    CHECK(allocations == 0);
+    cout << "  " << fired << " fired, " << allocations << " allocations, " << seconds * 1e9 / timerCount
+        << " ns per timer\n";
+}
+
+int main() {
+    // Debug builds trace the wheel
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDERR_FILENO);
+
+    testTimerWheel();
+    testManyTimers();
+
+    cout << (failures == 0 ? "All timer wheel tests passed\n" : to_string(failures) + " check(s) failed\n") << flush;
+    return failures == 0 ? 0 : 1;
+}
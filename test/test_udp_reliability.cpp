@@ -0,0 +1,428 @@
+// UDPClient reliability (retransmits, dedupe, dynamic port), REPLY correlation over the simulated network and, on
+// loopback, the socket's receive buffer autotuning. The timer wheel behind the reply deadlines has test_timer_wheel.
+// Every simulated scenario is seeded, a failure reproduces exactly on every run.
+
+#include "../src/inc/RequestTracker.h"
+#include "../src/inc/SimulatedNetwork.h"
+#include "../src/inc/UDPClient.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+do { \
+if (!(condition)) { \
+cout << "  FAILED line " << __LINE__ << ": " #condition "\n"; \
+failures++; \
+} \
+} while (0)
+
+static constexpr uint16_t SERVER_PORT = 4567;
+static constexpr uint16_t CLIENT_PORT = 40000;
+
+static SessionConfig simulatedArgs(uint16_t timeout, uint8_t retries) {
+    SessionConfig args;
+    args.proto = ProtocolType::UDP;
+    args.host = "127.0.0.1";
+    args.port = SERVER_PORT;
+    args.timeout = timeout;
+    args.retries = retries;
+    return args;
+}
+
+// Client and server on one simulated network
+struct Session {
+    SimulatedNetwork network;
+    SimulatedServer server;
+    SimulatedTransport* transport;
+    UDPClient client;
+    vector<string> delivered;   // MSG content the client received
+    uint64_t replies = 0;
+
+    Session(const NetworkConditions& conditions, uint64_t seed, uint8_t retries = 3, uint16_t timeout = 250)
+      : network(conditions, seed),
+        server(network, SERVER_PORT, timeout, retries),
+        transport(new SimulatedTransport(network, CLIENT_PORT)),
+        client(simulatedArgs(timeout, retries), unique_ptr<DatagramTransport>(transport)) {}
+
+    // Receives for the given virtual time
+    void drain(uint64_t ms) {
+        uint64_t deadline = network.now() + ms * 1000000;
+        MessageView view;
+        while (network.now() < deadline || client.hasBufferedMessage()) {
+            if (!client.receiveView(view)) {
+                continue;
+            }
+            if (view.getType() == MessageType::REPLY) {
+                replies++;
+            } else if (const MsgView* msg = view.get<MsgView>()) {
+                delivered.emplace_back(msg->messageContent);
+            }
+        }
+    }
+
+    void authenticate() {
+        client.sendMessage(make_unique<AuthMessage>("user", "tester", "secret"));
+        drain(1000);
+    }
+
+    vector<string> sendAll(int count) {
+        vector<string> sent;
+        for (int i = 0; i < count; ++i) {
+            sent.push_back("message " + to_string(i));
+            client.sendMessage(make_unique<MsgMessage>("tester", sent.back()));
+        }
+        drain(3000);
+        return sent;
+    }
+};
+
+static void testCleanNetwork() {
+    cout << "clean network\n";
+    Session session({}, 1);
+    session.authenticate();
+    CHECK(session.replies == 1);
+    auto sent = session.sendAll(200);
+    CHECK(session.server.messages() == sent);
+    CHECK(session.server.stats().duplicates == 0);
+    CHECK(session.client.retransmits() == 0);
+    CHECK(session.network.stats().unreachable == 0);
+}
+
+static void testLoss() {
+    cout << "20 % loss\n";
+    NetworkConditions conditions;
+    conditions.loss = 0.2;
+    Session session(conditions, 2, 10);
+    session.authenticate();
+    CHECK(session.replies == 1);
+    auto sent = session.sendAll(200);
+    // Stop-and-wait keeps the order, lost CONFIRMs only cause duplicates the server drops
+    CHECK(session.server.messages() == sent);
+    CHECK(session.client.retransmits() > 0);
+    CHECK(session.server.stats().duplicates > 0);
+}
+
+static void testDuplication() {
+    cout << "50 % duplication both ways\n";
+    NetworkConditions conditions;
+    conditions.duplicate = 0.5;
+    Session session(conditions, 3);
+    session.authenticate();
+    CHECK(session.replies == 1);
+    auto sent = session.sendAll(100);
+    CHECK(session.server.messages() == sent);
+    CHECK(session.server.stats().duplicates > 0);
+
+    vector<string> pushed;
+    for (int i = 0; i < 100; ++i) {
+        pushed.push_back("pushed " + to_string(i));
+        session.server.push("server", pushed.back());
+    }
+    session.drain(3000);
+    CHECK(session.delivered == pushed);
+    CHECK(session.server.idle());
+}
+
+static void testReorder() {
+    cout << "30 % reordering with jitter\n";
+    NetworkConditions conditions;
+    conditions.reorder = 0.3;
+    conditions.jitterNs = 2000000;
+    Session session(conditions, 4);
+    session.authenticate();
+    vector<string> pushed;
+    for (int i = 0; i < 100; ++i) {
+        pushed.push_back("pushed " + to_string(i));
+        session.server.push("server", pushed.back());
+    }
+    session.drain(3000);
+    // Every message exactly once, in whatever order the network produced
+    CHECK(session.delivered.size() == pushed.size());
+    CHECK(set<string>(session.delivered.begin(), session.delivered.end()) == set<string>(pushed.begin(), pushed.end()));
+    CHECK(session.delivered != pushed);
+    CHECK(session.server.messages() == session.sendAll(50));
+}
+
+static void testDynamicPort() {
+    cout << "dynamic port learned from the first REPLY\n";
+    NetworkConditions conditions;
+    conditions.loss = 0.1;
+    Session session(conditions, 5, 10);
+    CHECK(!session.client.isConnected());
+    session.authenticate();
+    CHECK(session.client.isConnected());
+    for (int round = 0; round < 20; ++round) {
+        session.server.push("server", "round " + to_string(round));
+        session.drain(500);
+        session.client.sendMessage(make_unique<MsgMessage>("tester", "answer " + to_string(round)));
+    }
+    session.drain(3000);
+    CHECK(session.server.messages().size() == 20);
+    CHECK(session.delivered.size() == 20);
+
+    // Once connected, a later port change can't take the session over
+    session.server.changePort();
+    session.server.push("server", "hijack");
+    session.drain(3000);
+    CHECK(session.delivered.size() == 20);
+    CHECK(session.server.stats().pushFailed == 1);
+    CHECK(session.transport->filtered() > 0);
+}
+
+static void testStrayDatagrams() {
+    cout << "stray datagrams\n";
+    Session session({}, 10);
+    auto stray = MsgSpec::encodeUDP(7, "intruder", "redirect me");
+    sockaddr_in client = SimulatedNetwork::address(CLIENT_PORT);
+
+    // Before the port is known: wrong host, dropped by the client without a CONFIRM
+    session.network.send(SimulatedNetwork::address(SERVER_PORT, "10.0.0.66"), client, stray.data(), stray.size());
+    session.drain(100);
+    CHECK(session.client.strayDatagrams() == 1);
+    CHECK(session.delivered.empty());
+    CHECK(session.network.stats().unreachable == 0);
+
+    // A REPLY that answers no AUTH/JOIN of ours (Ref_MessageID 0, or never sent) must not fix the port
+    sockaddr_in otherPort = SimulatedNetwork::address(SERVER_PORT + 1);
+    for (uint16_t refId : {0, 1}) {
+        auto reply = ReplySpec::encodeUDP(static_cast<uint16_t>(100 + refId), true, refId, "redirect");
+        session.network.send(otherPort, client, reply.data(), reply.size());
+        session.drain(100);
+        CHECK(!session.client.isConnected());
+    }
+
+    // After it: same host, other port, dropped by the connected transport
+    session.authenticate();
+    CHECK(session.client.isConnected());
+    session.network.send(SimulatedNetwork::address(SERVER_PORT + 1), client, stray.data(), stray.size());
+    session.drain(100);
+    CHECK(session.transport->filtered() == 1);
+    CHECK(session.delivered.empty());
+    auto sent = session.sendAll(10);
+    CHECK(session.server.messages() == sent);
+}
+
+static void testForeignConfirm() {
+    cout << "CONFIRM from a foreign port\n";
+    Session session({}, 12);
+    // Matches the AUTH (MessageID 1) and arrives ahead of the server's own CONFIRM
+    auto confirm = ConfirmSpec::encodeUDP(1);
+    session.network.send(SimulatedNetwork::address(SERVER_PORT + 1), SimulatedNetwork::address(CLIENT_PORT),
+        confirm.data(), confirm.size());
+    session.client.sendMessage(make_unique<AuthMessage>("user", "tester", "secret"));
+    CHECK(!session.client.isConnected());
+
+    // The port is not learned from it: the JOIN goes to the server, not to the port nobody listens on
+    session.client.sendMessage(make_unique<JoinMessage>("general", "tester"));
+    session.drain(1000);
+    CHECK(session.network.stats().unreachable == 0);
+    CHECK(session.client.retransmits() == 0);
+    CHECK(session.client.isConnected());
+    CHECK(session.replies == 2);
+}
+
+static void testControlOvertakesRetransmits() {
+    cout << "control overtakes a retransmitting MSG\n";
+    SimulatedNetwork network({}, 13);
+    UDPClient client(simulatedArgs(250, 3), make_unique<SimulatedTransport>(network, CLIENT_PORT));
+    bool controlWaiting = true;
+    client.setPreempt([&] { return controlWaiting; });
+
+    // Nobody listens yet, so the MSG is parked after one timeout instead of retrying for four
+    uint64_t start = network.now();
+    client.sendMessage(make_unique<MsgMessage>("tester", "stuck"));
+    CHECK(client.hasParked());
+    CHECK(network.now() - start < 2 * 250 * 1000000ULL);
+    CHECK(client.retransmits() == 0);
+
+    // The JOIN goes out while the MSG is parked, then the MSG continues with its MessageID
+    SimulatedServer server(network, SERVER_PORT, 250, 3);
+    client.sendMessage(make_unique<JoinMessage>("general", "tester"));
+    controlWaiting = false;
+    client.resumeParked();
+    CHECK(!client.hasParked());
+    CHECK(client.retransmits() == 1);
+    CHECK(server.messages() == vector<string>{"stuck"});
+    CHECK(server.stats().duplicates == 0);
+
+    // A CONFIRM of the parked MSG that arrives while the JOIN waits for its own ends it without a retransmission
+    controlWaiting = true;
+    SimulatedNetwork quiet({}, 14);
+    UDPClient other(simulatedArgs(250, 3), make_unique<SimulatedTransport>(quiet, CLIENT_PORT));
+    other.setPreempt([&] { return controlWaiting; });
+    other.sendMessage(make_unique<MsgMessage>("tester", "late"));
+    CHECK(other.hasParked());
+    auto confirm = ConfirmSpec::encodeUDP(other.lastMessageId());
+    quiet.send(SimulatedNetwork::address(SERVER_PORT), SimulatedNetwork::address(CLIENT_PORT), confirm.data(), confirm.size());
+    SimulatedServer answering(quiet, SERVER_PORT, 250, 3);
+    other.sendMessage(make_unique<JoinMessage>("general", "tester"));
+    controlWaiting = false;
+    other.resumeParked();
+    CHECK(!other.hasParked());
+    CHECK(other.retransmits() == 0);
+    CHECK(answering.messages().empty());
+}
+
+static void testDeterminism() {
+    cout << "same seed, same run\n";
+    NetworkConditions conditions;
+    conditions.loss = 0.3;
+    conditions.duplicate = 0.1;
+    conditions.reorder = 0.1;
+    conditions.jitterNs = 1000000;
+    auto run = [&](uint64_t seed) {
+        Session session(conditions, seed, 20);
+        session.authenticate();
+        session.sendAll(100);
+        return make_tuple(session.network.now(), session.client.retransmits(), session.network.stats().dropped,
+                          session.server.stats().duplicates);
+    };
+    CHECK(run(6) == run(6));
+    CHECK(run(6) != run(7));
+}
+
+static void testGivesUp() {
+    cout << "total loss\n";
+    NetworkConditions conditions;
+    conditions.loss = 1.0;
+    Session session(conditions, 8, 3, 250);
+    uint64_t start = session.network.now();
+    bool threw = false;
+    try {
+        session.client.sendMessage(make_unique<AuthMessage>("user", "tester", "secret"));
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    // One send and three retransmits, each waiting the full timeout
+    CHECK(session.network.now() - start == 4 * 250 * 1000000ULL);
+    CHECK(session.client.retransmits() == 3);
+}
+
+static void testVirtualClock() {
+    cout << "an hour of 50 % loss\n";
+    NetworkConditions conditions;
+    conditions.loss = 0.5;
+    Session session(conditions, 9, 60);
+    auto wallStart = chrono::steady_clock::now();
+    session.authenticate();
+    auto sent = session.sendAll(6000);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+    double simulated = (session.network.now() - SimulatedNetwork::START_NS) / 1e9;
+    cout << "  " << simulated << " s simulated in " << wall << " s\n";
+    CHECK(session.server.messages() == sent);
+    CHECK(simulated > 3600);
+    CHECK(wall < 60);
+}
+
+static void testReplyCorrelation() {
+    cout << "pipelined requests, reordered REPLYs\n";
+    NetworkConditions conditions;
+    conditions.reorder = 0.5;
+    Session session(conditions, 10);
+    RequestTracker tracker(true);
+    // AUTH and four JOINs in flight at once, the REPLYs may come back in any order
+    session.client.sendMessage(make_unique<AuthMessage>("user", "tester", "secret"));
+    tracker.sent(1, MessageType::AUTH, session.client.lastMessageId(), 0);
+    for (uint32_t tag = 2; tag <= 5; ++tag) {
+        session.client.sendMessage(make_unique<JoinMessage>("channel" + to_string(tag), "tester"));
+        tracker.sent(tag, MessageType::JOIN, session.client.lastMessageId(), 0);
+    }
+    CHECK(tracker.inFlight() == 5);
+    set<uint32_t> answered;
+    MessageView view;
+    uint64_t deadline = session.network.now() + 1000000000ULL;
+    while (session.network.now() < deadline || session.client.hasBufferedMessage()) {
+        if (!session.client.receiveView(view) || view.getType() != MessageType::REPLY) {
+            continue;
+        }
+        PendingRequest request;
+        auto reply = view.materialize();
+        CHECK(tracker.matchReply(static_cast<const ReplyMessage&>(*reply).getRefMsgId(), request));
+        answered.insert(request.tag);
+    }
+    CHECK(answered == set<uint32_t>({1, 2, 3, 4, 5}));
+    CHECK(tracker.inFlight() == 0);
+    PendingRequest request;
+    CHECK(!tracker.matchReply(1, request));
+
+    // TCP: no references, the oldest request takes the next REPLY; a request whose deadline fired is gone
+    TimerWheel timers(0);
+    RequestTracker fifo(false);
+    fifo.sent(7, MessageType::AUTH, 0, timers.schedule(REPLY_TIMEOUT_NS, 7));
+    fifo.sent(8, MessageType::JOIN, 0, timers.schedule(REPLY_TIMEOUT_NS + 1000000000ULL, 8));
+    // The wait may end early where a timer moves down a level, never after its deadline
+    CHECK(timers.timeoutMs(0) > 0 && timers.timeoutMs(0) <= 5000);
+    vector<uint32_t> expired;
+    auto expire = [&](uint64_t tag) {
+        if (fifo.expire(static_cast<uint32_t>(tag), request)) {
+            expired.push_back(request.tag);
+        }
+    };
+    CHECK(timers.advance(REPLY_TIMEOUT_NS - 1, expire) == 0);
+    CHECK(timers.advance(REPLY_TIMEOUT_NS, expire) == 1 && expired == vector<uint32_t>({7}));
+    CHECK(timers.timeoutMs(REPLY_TIMEOUT_NS) > 0 && timers.timeoutMs(REPLY_TIMEOUT_NS) <= 1000);
+    CHECK(fifo.matchReply(0, request) && request.tag == 8);
+    CHECK(timers.cancel(request.deadline) && !timers.cancel(request.deadline));
+    CHECK(timers.timeoutMs(REPLY_TIMEOUT_NS) == -1);
+}
+
+static void testReceiveBufferGrowth() {
+    cout << "kernel receive drops grow the socket buffer (loopback)\n";
+    SocketTransport transport(1 << 20);
+    sockaddr_in local{};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(local);
+    CHECK(bind(transport.fd(), reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0);
+    getsockname(transport.fd(), reinterpret_cast<sockaddr*>(&local), &length);
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    vector<uint8_t> datagram(1000, 'x');
+    uint8_t buffer[2048];
+    sockaddr_in from{};
+    uint64_t kernelNs;
+    // Nobody reads while each burst arrives, so whatever exceeds the buffer is dropped
+    for (int burst = 0; burst < 3; ++burst) {
+        for (int i = 0; i < 4000; ++i) {
+            sendto(sender, datagram.data(), datagram.size(), 0, reinterpret_cast<sockaddr*>(&local), sizeof(local));
+        }
+        while (transport.receiveFrom(buffer, sizeof(buffer), from, kernelNs) > 0) {
+        }
+    }
+    close(sender);
+    const ReceiveBufferStats& stats = *transport.receiveBuffer();
+    cout << "  " << stats.drops << " dropped, " << stats.initialBytes / 1024 << " -> " << stats.bytes / 1024 << " KiB\n";
+    CHECK(stats.drops > 0);
+    CHECK(stats.resizes > 0 && stats.bytes > stats.initialBytes);
+    CHECK(stats.bytes <= stats.ceilingBytes);
+}
+
+int main() {
+    // Debug builds trace every datagram
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDERR_FILENO);
+
+    testCleanNetwork();
+    testLoss();
+    testDuplication();
+    testReorder();
+    testDynamicPort();
+    testStrayDatagrams();
+    testForeignConfirm();
+    testControlOvertakesRetransmits();
+    testDeterminism();
+    testGivesUp();
+    testVirtualClock();
+    testReplyCorrelation();
+    testReceiveBufferGrowth();
+
+    cout << (failures == 0 ? "All UDP reliability tests passed\n" : to_string(failures) + " check(s) failed\n") << flush;
+    return failures == 0 ? 0 : 1;
+}